@@ -0,0 +1,575 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+# include <windows.h>
+# include <psapi.h>
+#else
+# include <sys/resource.h>
+#endif
+
+#include "lily_api_embed.h"
+#include "lily_parser.h"
+
+/* This measures how quickly the front of the interpreter gets through source
+   files. Each file is lexed (without parsing), then compiled (without running)
+   on a fresh state, and the vm is prepared for the result. Results are written
+   to stdout as one json object per file, so that they can be collected and
+   compared across builds.
+   The suite mode writes out sources of different shapes, and runs each one in
+   a new process, so that the peak memory of each is its own. */
+
+static void usage(void)
+{
+    fputs("Usage: lily_bench [option] ... file ...\n"
+          "Options:\n"
+          "-h             : Print this help and exit.\n"
+          "-n N           : Run each file N times (default 10).\n"
+          "-t             : Files are templates (code is between <?lily ?>).\n"
+          "-scale N       : Multiply the size of generated sources by N.\n"
+          "-gen dir       : Write generated sources into dir and exit.\n"
+          "-suite dir     : Write generated sources into dir, then benchmark\n"
+          "                 each of them in a process of its own.\n"
+          "file           : A source file to benchmark.\n", stderr);
+    exit(EXIT_FAILURE);
+}
+
+int runs = 10;
+int scale = 1;
+int is_template = 0;
+
+/** Measuring **/
+
+static double seconds_since(clock_t start)
+{
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* The most memory this process has used so far, in kilobytes. */
+static long peak_kb(void)
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return (long)(pmc.PeakWorkingSetSize / 1024);
+
+    return -1;
+#else
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+
+# ifdef __APPLE__
+    return (long)(usage.ru_maxrss / 1024);
+# else
+    return (long)usage.ru_maxrss;
+# endif
+#endif
+}
+
+static void count_file(const char *path, long *bytes, long *lines)
+{
+    FILE *f = fopen(path, "rb");
+    int ch;
+
+    *bytes = 0;
+    *lines = 0;
+
+    if (f == NULL) {
+        *bytes = -1;
+        return;
+    }
+
+    while ((ch = fgetc(f)) != EOF) {
+        (*bytes)++;
+        if (ch == '\n')
+            (*lines)++;
+    }
+
+    fclose(f);
+}
+
+static void render_nothing(const char *text, void *data)
+{
+    (void)text;
+    (void)data;
+}
+
+static void flush_nothing(lily_out_chunk *chunks, int count, void *data)
+{
+    (void)chunks;
+    (void)count;
+    (void)data;
+}
+
+/* Run the lexer over 'path' until eof, without parsing any of it. Returns 0 if
+   the lexer raised an error. */
+static int lex_file(lily_state *s, const char *path)
+{
+    lily_parse_state *parser = s->parser;
+    lily_lex_state *lex = parser->lex;
+    int result = 1;
+
+    lex->render_func = render_nothing;
+    lex->token = tk_invalid;
+    lily_set_in_template(lex, is_template);
+
+    if (setjmp(parser->raiser->all_jumps->jump) == 0) {
+        lily_load_source(lex, et_file, path);
+
+        while (lex->token != tk_eof) {
+            lily_lexer(lex);
+
+            if (lex->token == tk_end_tag)
+                lily_lexer_handle_content(lex);
+        }
+    }
+    else
+        result = 0;
+
+    lily_pop_lex_entry(lex);
+    lily_set_in_template(lex, 0);
+    return result;
+}
+
+typedef struct {
+    double lex;
+    double compile;
+    double vm_prep;
+    double render;
+} phase_times;
+
+/* Compile 'path' without running it, then prepare the vm as the parser would
+   before running it. */
+static int compile_file(const char *path, phase_times *times)
+{
+    lily_state *s = lily_new_state();
+    lily_parse_state *parser = s->parser;
+    clock_t start;
+    int ok;
+
+    parser->compile_only = 1;
+    start = clock();
+    ok = lily_parse_file(s, path);
+    times->compile += seconds_since(start);
+    parser->compile_only = 0;
+
+    if (ok) {
+        start = clock();
+        lily_register_classes(parser->symtab, parser->vm);
+        lily_prepare_main(parser->emit);
+        lily_vm_prep(parser->vm, parser->symtab,
+                parser->symtab->literals->data, parser->foreign_values);
+        times->vm_prep += seconds_since(start);
+    }
+    else
+        fputs(lily_get_error(s), stderr);
+
+    lily_free_state(s);
+    return ok;
+}
+
+/* Templates are prepared (which includes preparing the vm), then rendered. */
+static int compile_template(const char *path, phase_times *times)
+{
+    lily_state *s = lily_new_state();
+    clock_t start;
+    int ok = 0;
+
+    lily_op_flush_func(s, flush_nothing);
+
+    start = clock();
+    lily_function_val *f = lily_prepare_template_file(s, path);
+    times->compile += seconds_since(start);
+
+    if (f) {
+        start = clock();
+        ok = lily_render_prepared(s, f);
+        lily_flush_output(s);
+        times->render += seconds_since(start);
+    }
+
+    if (ok == 0)
+        fputs(lily_get_error(s), stderr);
+
+    lily_free_state(s);
+    return ok;
+}
+
+static double mb_per_s(long bytes, double seconds)
+{
+    if (seconds <= 0.0)
+        return 0.0;
+
+    return ((double)bytes / (1024.0 * 1024.0)) / seconds;
+}
+
+static int bench_file(const char *path)
+{
+    phase_times times = {0.0, 0.0, 0.0, 0.0};
+    long bytes, lines;
+    int i, ok = 1;
+
+    count_file(path, &bytes, &lines);
+
+    if (bytes == -1) {
+        fprintf(stderr, "lily_bench: Cannot open '%s'.\n", path);
+        return 0;
+    }
+
+    lily_state *s = lily_new_state();
+
+    /* One run first, so literals and buffers are already at their size. */
+    ok = lex_file(s, path);
+
+    clock_t start = clock();
+
+    for (i = 0;i < runs && ok;i++)
+        ok = lex_file(s, path);
+
+    times.lex = seconds_since(start);
+    lily_free_state(s);
+
+    for (i = 0;i < runs && ok;i++) {
+        if (is_template == 0)
+            ok = compile_file(path, &times);
+        else
+            ok = compile_template(path, &times);
+    }
+
+    if (ok == 0) {
+        fprintf(stderr, "lily_bench: '%s' failed.\n", path);
+        return 0;
+    }
+
+    double lex = times.lex / runs;
+    double compile = times.compile / runs;
+    /* Compiling lexes too, so take that out to get parse and emit alone. */
+    double parse_emit = compile > lex ? compile - lex : 0.0;
+
+    printf("{\"source\": \"%s\", \"template\": %s, \"bytes\": %ld, "
+           "\"lines\": %ld, \"runs\": %d, \"lex_s\": %.6f, "
+           "\"lex_mb_per_s\": %.2f, \"parse_emit_s\": %.6f, ",
+           path, is_template ? "true" : "false", bytes, lines, runs, lex,
+           mb_per_s(bytes, lex), parse_emit);
+
+    /* Preparing a template prepares the vm, so it's counted in parse_emit. */
+    if (is_template == 0)
+        printf("\"vm_prep_s\": %.6f, ", times.vm_prep / runs);
+    else
+        printf("\"vm_prep_s\": null, \"render_s\": %.6f, ",
+                times.render / runs);
+
+    printf("\"compile_mb_per_s\": %.2f, \"peak_kb\": %ld}\n",
+           mb_per_s(bytes, compile), peak_kb());
+    fflush(stdout);
+    return 1;
+}
+
+/** Source generation **/
+
+static FILE *open_source(const char *dir, const char *name)
+{
+    char path[1024];
+
+    snprintf(path, sizeof(path), "%s/%s.lily", dir, name);
+
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        fprintf(stderr, "lily_bench: Cannot write '%s'.\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    return f;
+}
+
+/* Many small functions. */
+static void gen_functions(const char *dir)
+{
+    FILE *f = open_source(dir, "functions");
+    int i, count = 4000 * scale;
+
+    for (i = 0;i < count;i++) {
+        fprintf(f,
+"define f_%d(a: Integer, b: Integer): Integer {\n"
+"    var c = a + b * %d\n"
+"    if c > 100: {\n"
+"        c = c - 1\n"
+"    }\n"
+"    return c\n"
+"}\n\n", i, i);
+    }
+
+    fclose(f);
+}
+
+/* Blocks and expressions nested deeply inside of functions. */
+static void gen_nesting(const char *dir)
+{
+    FILE *f = open_source(dir, "nesting");
+    int i, j, count = 300 * scale, depth = 24;
+
+    for (i = 0;i < count;i++) {
+        fprintf(f, "define n_%d(a: Integer): Integer {\n", i);
+        fprintf(f, "    var total = 0\n");
+
+        for (j = 0;j < depth;j++)
+            fprintf(f, "%*sif a > %d: {\n", 4 * (j + 1), "", j);
+
+        fprintf(f, "%*stotal = ", 4 * (depth + 1), "");
+        for (j = 0;j < depth;j++)
+            fputc('(', f);
+
+        fputs("a", f);
+        for (j = 0;j < depth;j++)
+            fprintf(f, " + %d)", j);
+
+        fputc('\n', f);
+
+        for (j = depth - 1;j >= 0;j--)
+            fprintf(f, "%*s}\n", 4 * (j + 1), "");
+
+        fprintf(f, "    return total\n}\n\n");
+    }
+
+    fclose(f);
+}
+
+/* Huge lists of Integer, Double, and String literals. */
+static void gen_literals(const char *dir)
+{
+    FILE *f = open_source(dir, "literals");
+    int i, count = 4000 * scale;
+
+    fputs("var ints = [", f);
+    for (i = 0;i < count;i++)
+        fprintf(f, "%s%d", i % 16 ? ", " : (i ? ",\n    " : ""), i * 7);
+
+    fputs("]\n\nvar doubles = [", f);
+    for (i = 0;i < count;i++)
+        fprintf(f, "%s%d.5", i % 16 ? ", " : (i ? ",\n    " : ""), i);
+
+    fputs("]\n\nvar strings = [", f);
+    for (i = 0;i < count;i++)
+        fprintf(f, "%s\"str%d\"", i % 8 ? ", " : (i ? ",\n    " : ""), i);
+
+    fputs("]\n", f);
+    fclose(f);
+}
+
+/* Many classes (with methods) and enums. */
+static void gen_classes(const char *dir)
+{
+    FILE *f = open_source(dir, "classes");
+    int i, count = 1000 * scale;
+
+    for (i = 0;i < count;i++) {
+        fprintf(f,
+"class C_%d(value: Integer) {\n"
+"    var @value = value\n"
+"    var @name = \"C_%d\"\n"
+"    define get: Integer { return @value + %d }\n"
+"}\n\n"
+"enum E_%d {\n"
+"    E_%d_one(Integer),\n"
+"    E_%d_two(String),\n"
+"    E_%d_three\n"
+"}\n\n", i, i, i, i, i, i, i);
+    }
+
+    fclose(f);
+}
+
+/* Generic functions with many different List, Tuple, Option, Hash, and
+   Function types in their signatures and bodies. */
+static void gen_generics(const char *dir)
+{
+    FILE *f = open_source(dir, "generics");
+    const char *arg_types[] = {
+        "Integer", "String", "Double", "List[Integer]",
+        "Tuple[Integer, String]", "Option[A]", "Function(A => B)",
+        "Hash[String, A]",
+    };
+    int i, j, count = 4000 * scale;
+
+    for (i = 0;i < count;i++) {
+        fprintf(f, "define g_%d[A, B](a: A, f: Function(A => B)", i);
+
+        /* Each function's extra arguments are picked by the digits of its
+           number, so that the types made keep changing. */
+        for (j = 0;j < 4;j++)
+            fprintf(f, ", p%d: %s", j, arg_types[(i >> (j * 3)) & 7]);
+
+        fprintf(f,
+"): Tuple[A, B, Integer] {\n"
+"    var pairs = [<[a, f(a)]>, <[a, f(a)]>]\n"
+"    var fn = (|x: A| <[x, f(x), %d]>)\n"
+"    return fn(a)\n"
+"}\n\n", i);
+    }
+
+    fclose(f);
+}
+
+/* One file importing many small modules. */
+static void gen_imports(const char *dir)
+{
+    FILE *f = open_source(dir, "imports");
+    int i, count = 200 * scale;
+
+    for (i = 0;i < count;i++) {
+        char name[32];
+
+        snprintf(name, sizeof(name), "imp_%d", i);
+
+        FILE *m = open_source(dir, name);
+
+        fprintf(m,
+"define g(a: Integer): Integer { return a + %d }\n\n"
+"class M_%d(value: Integer) {\n"
+"    var @value = value\n"
+"}\n", i, i);
+        fclose(m);
+
+        fprintf(f, "import imp_%d\n", i);
+    }
+
+    fputs("\nvar total = 0\n", f);
+    for (i = 0;i < count;i++)
+        fprintf(f, "total = imp_%d.g(total) + imp_%d.M_%d(%d).value\n", i, i,
+                i, i);
+
+    fclose(f);
+}
+
+/* A long template of content and code. */
+static void gen_template(const char *dir)
+{
+    FILE *f = open_source(dir, "template");
+    int i, count = 4000 * scale;
+
+    fputs("<?lily var total = 0 ?>\n<html>\n<body>\n", f);
+
+    for (i = 0;i < count;i++) {
+        fprintf(f,
+"<div class=\"row\" id=\"row-%d\">\n"
+"  <span>Some static content that goes with row %d.</span>\n"
+"<?lily total = total + %d ?>\n"
+"</div>\n", i, i, i);
+    }
+
+    fputs("</body>\n</html>\n<?lily print(total) ?>\n", f);
+    fclose(f);
+}
+
+typedef struct {
+    const char *name;
+    void (*gen)(const char *);
+    int is_template;
+} shape;
+
+static shape shapes[] = {
+    {"functions", gen_functions, 0},
+    {"nesting",   gen_nesting,   0},
+    {"literals",  gen_literals,  0},
+    {"classes",   gen_classes,   0},
+    {"generics",  gen_generics,  0},
+    {"imports",   gen_imports,   0},
+    {"template",  gen_template,  1},
+    {NULL,        NULL,          0},
+};
+
+static void gen_all(const char *dir)
+{
+    int i;
+
+    for (i = 0;shapes[i].name;i++)
+        shapes[i].gen(dir);
+}
+
+/* Run this program once for each shape, so that each has a process (and peak
+   memory) of its own. */
+static int run_suite(const char *self, const char *dir)
+{
+    int i, ok = 1;
+
+    gen_all(dir);
+
+    for (i = 0;shapes[i].name;i++) {
+        char command[2048];
+
+        snprintf(command, sizeof(command), "\"%s\" -n %d%s \"%s/%s.lily\"",
+                self, runs, shapes[i].is_template ? " -t" : "", dir,
+                shapes[i].name);
+
+        fflush(stdout);
+        if (system(command) != 0)
+            ok = 0;
+    }
+
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    char *gen_dir = NULL;
+    char *suite_dir = NULL;
+    int i, ok = 1;
+
+    for (i = 1;i < argc;i++) {
+        char *arg = argv[i];
+
+        if (strcmp("-h", arg) == 0)
+            usage();
+        else if (strcmp("-t", arg) == 0)
+            is_template = 1;
+        else if (strcmp("-n", arg) == 0 ||
+                 strcmp("-scale", arg) == 0) {
+            i++;
+            if (i == argc)
+                usage();
+
+            int value = atoi(argv[i]);
+            if (value < 1)
+                usage();
+
+            if (arg[1] == 'n')
+                runs = value;
+            else
+                scale = value;
+        }
+        else if (strcmp("-gen", arg) == 0 ||
+                 strcmp("-suite", arg) == 0) {
+            i++;
+            if (i == argc)
+                usage();
+
+            if (arg[1] == 'g')
+                gen_dir = argv[i];
+            else
+                suite_dir = argv[i];
+        }
+        else
+            break;
+    }
+
+    if (gen_dir) {
+        gen_all(gen_dir);
+        return EXIT_SUCCESS;
+    }
+
+    if (suite_dir)
+        return run_suite(argv[0], suite_dir) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    if (i == argc)
+        usage();
+
+    for (;i < argc;i++)
+        ok &= bench_file(argv[i]);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
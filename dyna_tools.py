@@ -134,6 +134,7 @@ class PropertyEntry:
         self.scope = ("%s %s" % (data.group(1) or "", data.group(2))).lstrip()
         self.name = data.group(3).strip()
         self.proto = data.group(4).strip()
+        self.clean_proto = self.proto.replace(" ", "")
         self.e_type = "property"
         self.dyna_len = 0
 
@@ -342,6 +343,125 @@ def gen_html(filename):
     s = gen_markdown(filename)
     return markdown.markdown(s, extensions=["markdown.extensions.fenced_code"])
 
+# Functions, vars, and properties also get a descriptor of their type, so that
+# the interpreter can build the type without lexing the prototype. Descriptors
+# are written in prefix order. A class is its name and a \0. A class with
+# subtypes is '[', the count, the name, then the subtypes. A Function is '(',
+# the argument count, the return type ('-' if there isn't one), then each of
+# the arguments. Arguments may start with '*' (optional) or '.' (varargs). A
+# scoop type is '$' and the number. Functions start with their generic count.
+
+def desc_byte(n):
+    # Always use 3 digits, so that the escape never takes in what follows.
+    return "\\%03o" % n
+
+class ProtoReader:
+    def __init__(self, text):
+        self.text = text
+        self.pos = 0
+
+    def peek(self, s):
+        return self.text.startswith(s, self.pos)
+
+    def take(self, s):
+        if self.peek(s) == False:
+            raise ValueError("Expected '%s' at %d of '%s'." % (s, self.pos,
+                    self.text))
+
+        self.pos += len(s)
+
+    def word(self):
+        m = re.compile("\\w+").match(self.text, self.pos)
+        if m == None:
+            raise ValueError("Expected a name at %d of '%s'." % (self.pos,
+                    self.text))
+
+        self.pos = m.end()
+        return m.group(0)
+
+def desc_arg(r):
+    if r.peek("*"):
+        r.take("*")
+        return "*" + desc_type(r)
+
+    result = desc_type(r)
+    if r.peek("..."):
+        r.take("...")
+        result = "." + result
+
+    return result
+
+def desc_args(r):
+    args = []
+
+    while r.peek(")") == False and r.peek("=>") == False:
+        args.append(desc_arg(r))
+        if r.peek(","):
+            r.take(",")
+        else:
+            break
+
+    return args
+
+def desc_type(r):
+    name = r.word()
+
+    if name.isdigit():
+        return "$" + desc_byte(int(name))
+    elif name == "Function":
+        r.take("(")
+        args = desc_args(r)
+        result = "-"
+        if r.peek("=>"):
+            r.take("=>")
+            result = desc_type(r)
+
+        r.take(")")
+        return "(" + desc_byte(len(args)) + result + "".join(args)
+    elif r.peek("["):
+        r.take("[")
+        subtypes = [desc_type(r)]
+        while r.peek(","):
+            r.take(",")
+            subtypes.append(desc_type(r))
+
+        r.take("]")
+        return "[%s%s\\000%s" % (desc_byte(len(subtypes)), name,
+                "".join(subtypes))
+    else:
+        return name + "\\000"
+
+def gen_descriptor(e):
+    r = ProtoReader(e.clean_proto)
+
+    if e.e_type in ["var", "property"]:
+        return desc_type(r)
+
+    generics = 0
+    if r.peek("["):
+        r.take("[")
+        while r.peek("]") == False:
+            r.word()
+            generics += 1
+            if r.peek(","):
+                r.take(",")
+
+        r.take("]")
+
+    args = []
+    if r.peek("("):
+        r.take("(")
+        args = desc_args(r)
+        r.take(")")
+
+    result = "-"
+    if r.peek(":"):
+        r.take(":")
+        result = desc_type(r)
+
+    return "%s(%s%s%s" % (desc_byte(generics), desc_byte(len(args)), result,
+            "".join(args))
+
 def run_dyna_entry(e, accum):
     increase = 1
 
@@ -374,6 +494,12 @@ def run_dyna_entry(e, accum):
     if suffix:
         suffix = "\\0" + suffix
 
+    if e.e_type in ["define", "var", "method", "constructor", "property"]:
+        if suffix == "":
+            suffix = "\\0"
+
+        suffix += "\\0" + gen_descriptor(e)
+
     accum.append('    ,"%s\\%s%s%s"' % (letter, oct(dyna_len), name, suffix))
 
     try:
@@ -426,10 +552,11 @@ Generate dynaload information based on comment blocks in a given filename.
     if package_entry.name == "builtin":
         used = []
 
+    # The D after the cid names marks the table as having descriptors.
     header = """\
 const char *lily%s_dynaload_table[] = {
-    "\\%d%s\\0"\
-""" % (name, len(used), "\\0".join(used))
+    "\\%d%sD"\
+""" % (name, len(used), "".join([u + "\\0" for u in used]))
 
     result = [header] + result
     result.append('    ,"Z"')
@@ -0,0 +1,246 @@
+#!/usr/bin/env python
+#
+# keyword_table.py
+# This writes src/lily_keyword_table.h, which parser uses to find keywords and
+# constants. Each name is found through a perfect hash: The shorthash of the
+# name (up to the first 8 bytes, as a number) is multiplied by a constant, and
+# the top bits of the result pick a slot holding the id of the name.
+
+import os, re, sys
+
+# The ids of these follow their order here.
+constants = ["true", "self", "false", "__file__", "__line__", "__function__"]
+
+keywords = ["if", "do", "var", "for", "try", "case", "else", "elif", "enum",
+        "while", "raise", "match", "break", "class", "scoped", "define",
+        "return", "except", "import", "private", "protected", "continue"]
+
+header_path = os.path.join(os.path.dirname(os.path.abspath(__file__)), "src",
+        "lily_keyword_table.h")
+
+MASK = (1 << 64) - 1
+
+def usage():
+    message = \
+"""\
+keyword_table.py [check]
+
+With no arguments, src/lily_keyword_table.h is written from the keyword and
+constant lists within this file. A multiplier that still gives each name a slot
+of its own is kept, so that adding a name only changes what it has to.
+
+check:
+    Exit with an error if a keyword or constant shares a slot with another,
+    or if src/lily_keyword_table.h isn't what the lists here make.
+"""
+    print(message)
+    sys.exit(0)
+
+def shorthash(name):
+    ret = 0
+
+    for i, ch in enumerate(name[:8]):
+        ret |= ord(ch) << (i * 8)
+
+    return ret
+
+def slot_of(name, mult, shift):
+    return ((shorthash(name) * mult) & MASK) >> shift
+
+def make_slots(names, mult, shift):
+    slots = [-1] * (1 << (64 - shift))
+
+    for i, n in enumerate(names):
+        s = slot_of(n, mult, shift)
+        if slots[s] != -1:
+            return None
+
+        slots[s] = i
+
+    return slots
+
+def next_mult(state):
+    # splitmix64, so that a search always gives the same multiplier.
+    state = (state + 0x9E3779B97F4A7C15) & MASK
+    z = state
+    z = ((z ^ (z >> 30)) * 0xBF58476D1CE4E5B9) & MASK
+    z = ((z ^ (z >> 27)) * 0x94D049BB133111EB) & MASK
+    return (state, (z ^ (z >> 31)) | 1)
+
+def find_mult(names, old_mult, old_shift):
+    if old_mult is not None and make_slots(names, old_mult, old_shift):
+        return (old_mult, old_shift)
+
+    bits = 1
+    while (1 << bits) < len(names):
+        bits += 1
+
+    while 1:
+        state = 0
+
+        for i in range(200000):
+            (state, mult) = next_mult(state)
+            if make_slots(names, mult, 64 - bits):
+                return (mult, 64 - bits)
+
+        bits += 1
+
+def old_setting(text, name):
+    m = re.search("#define %s\\s+(\\d+)" % name, text)
+    if m is None:
+        return None
+
+    return int(m.group(1))
+
+# '__file__' is CONST__FILE__, not CONST___FILE__.
+def id_name(prefix, name):
+    if name.startswith("_"):
+        return prefix + name.upper()
+
+    return prefix + "_" + name.upper()
+
+def gen_entries(names):
+    lines = []
+
+    for n in names:
+        lines.append('    %-17s%d},' % ('{"%s",' % n, shorthash(n)))
+
+    return "\n".join(lines)
+
+def gen_slots(slots, per_line):
+    lines = []
+
+    for i in range(0, len(slots), per_line):
+        row = slots[i:i + per_line]
+        lines.append("    " + " ".join(["%2d," % s for s in row]))
+
+    return "\n".join(lines)
+
+def gen_header(old_text):
+    (const_mult, const_shift) = find_mult(constants,
+            old_setting(old_text, "CONST_HASH_MULT"),
+            old_setting(old_text, "CONST_HASH_SHIFT"))
+    (key_mult, key_shift) = find_mult(keywords,
+            old_setting(old_text, "KEY_HASH_MULT"),
+            old_setting(old_text, "KEY_HASH_SHIFT"))
+
+    const_ids = "\n".join(["#define %-17s %d" % (id_name("CONST", n), i)
+            for i, n in enumerate(constants)])
+    key_ids = "\n".join(["# define %-17s%2d" % (id_name("KEY", n), i)
+            for i, n in enumerate(keywords)])
+
+    return """\
+#ifndef LILY_KEYWORD_TABLE_H
+# define LILY_KEYWORD_TABLE_H
+
+/* This file is made by keyword_table.py. Change the lists there, and run it
+   again instead of editing this by hand. */
+
+typedef struct {
+    const char *name;
+    uint64_t shorthash;
+} keyword_entry;
+
+keyword_entry constants[] = {
+%s
+};
+
+%s
+#define %-17s %d
+
+/* Keywords and constants are found through a perfect hash of the shorthash of
+   a name. Multiplying by the given number and keeping the top bits gives each
+   name a slot of its own, which holds the id of the name (or -1). A name that
+   lands on a slot still needs to be checked, because any word can be hashed. */
+
+#define CONST_HASH_MULT   %dULL
+#define CONST_HASH_SHIFT  %d
+
+int8_t constant_slots[] = {
+%s
+};
+
+keyword_entry keywords[] = {
+%s
+};
+
+%s
+# define %-17s%2d
+
+#define KEY_HASH_MULT     %dULL
+#define KEY_HASH_SHIFT    %d
+
+int8_t keyword_slots[] = {
+%s
+};
+
+#endif
+""" % (gen_entries(constants), const_ids, "CONST_LAST_ID",
+       len(constants) - 1, const_mult, const_shift,
+       gen_slots(make_slots(constants, const_mult, const_shift), 8),
+       gen_entries(keywords), key_ids, "KEY_LAST_ID", len(keywords) - 1,
+       key_mult, key_shift,
+       gen_slots(make_slots(keywords, key_mult, key_shift), 16))
+
+def read_header():
+    try:
+        f = open(header_path, "r")
+        text = f.read()
+        f.close()
+    except IOError:
+        text = ""
+
+    return text
+
+def check_unique(text, kind, names, mult_name, shift_name):
+    mult = old_setting(text, mult_name)
+    shift = old_setting(text, shift_name)
+
+    if mult is None or shift is None:
+        print("keyword_table.py: %s is missing from the header." % mult_name)
+        return 0
+
+    seen = {}
+    ok = 1
+
+    for n in names:
+        s = slot_of(n, mult, shift)
+        if s in seen:
+            print("keyword_table.py: The %s '%s' and '%s' share slot %d." %
+                    (kind, seen[s], n, s))
+            ok = 0
+        else:
+            seen[s] = n
+
+    return ok
+
+def do_check():
+    text = read_header()
+    ok = check_unique(text, "constants", constants, "CONST_HASH_MULT",
+                "CONST_HASH_SHIFT")
+    ok = check_unique(text, "keywords", keywords, "KEY_HASH_MULT",
+                "KEY_HASH_SHIFT") and ok
+
+    if ok and gen_header(text) != text:
+        print("keyword_table.py: src/lily_keyword_table.h is out of date. "
+              "Run keyword_table.py to write it again.")
+        ok = 0
+
+    sys.exit(0 if ok else 1)
+
+def do_write():
+    text = read_header()
+    new_text = gen_header(text)
+
+    if new_text != text:
+        f = open(header_path, "w")
+        f.write(new_text)
+        f.close()
+        print("keyword_table.py: Wrote '%s'." % (header_path))
+
+if len(sys.argv) == 1:
+    do_write()
+elif sys.argv[1] == "check":
+    do_check()
+else:
+    usage()
@@ -97,9 +97,69 @@ def process_test_dir(basepath):
         for filepath in filepath_list:
             run_test(options, dirpath, filepath)
 
+def run_api_test(name):
+    global pass_count, error_count, crash_count, test_count, verbose
+
+    test_count += 1
+
+    subp = subprocess.Popen(["./lily_api_test", name], stdout=subprocess.PIPE,
+            stderr=subprocess.PIPE)
+    (subp_stdout, subp_stderr) = subp.communicate()
+    subp.wait()
+
+    if subp.returncode != 0 or subp_stderr != "":
+        if subp.returncode < 0:
+            message = "!!!CRASHED!!!"
+            crash_count += 1
+        else:
+            message = "!!!FAILED!!!"
+            error_count += 1
+
+        print("#%d api test %s %s\n" % (test_count, name, message))
+
+        if verbose:
+            print("Received:\n`%s`" % subp_stderr.rstrip("\r\n"))
+    else:
+        pass_count += 1
+
+def process_api_tests():
+    # These are tests of the embedding api, written in C (see test/api). They're
+    # built along with the interpreter.
+    if not os.path.exists("lily_api_test"):
+        return
+
+    subp = subprocess.Popen(["./lily_api_test", "-list"],
+            stdout=subprocess.PIPE)
+    (subp_stdout, subp_stderr) = subp.communicate()
+
+    for name in subp_stdout.split():
+        run_api_test(name)
+
+def check_keyword_table():
+    global pass_count, error_count, test_count, verbose
+
+    # Each keyword and constant needs a slot of its own in the table that
+    # keyword_table.py writes.
+    test_count += 1
+
+    subp = subprocess.Popen([sys.executable, "keyword_table.py", "check"],
+            stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    (subp_stdout, subp_stderr) = subp.communicate()
+
+    if subp.returncode != 0:
+        error_count += 1
+        print("#%d keyword table !!!FAILED!!!\n" % (test_count))
+
+        if verbose:
+            print("Received:\n`%s`" % subp_stdout.rstrip("\r\n"))
+    else:
+        pass_count += 1
+
 process_test_dir('test' + os.sep + 'fail')
 process_test_dir('test' + os.sep + 'pass')
 process_test_dir('try')
+process_api_tests()
+check_keyword_table()
 
 print ('Final stats: %d tests passed, %d errors, %d crashed.' \
         % (pass_count, error_count, crash_count))
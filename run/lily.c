@@ -14,6 +14,11 @@ static void usage()
           "                 Everything else is printed to stdout.\n"
           "                 By default, everything is treated as code.\n"
           "-s string      : The program is a string (end of options).\n"
+          "-aot out.c     : Translate the file given to C instead of running it.\n"
+          "                 The result can be built as a library to import.\n"
+          "-cache dir     : Keep the file given as compiled code in dir, and run\n"
+          "                 that instead if the file hasn't changed.\n"
+          "                 Use -cache . to keep it next to the file.\n"
           "-gstart N      : Initial # of objects allowed before a gc sweep.\n"
           "-gmul N        : (# allowed * N) when sweep can't free anything.\n"
           "file           : The program is the given filename.\n", stderr);
@@ -25,6 +30,8 @@ int do_tags = 0;
 int gc_start = -1;
 int gc_multiplier = -1;
 char *to_process = NULL;
+char *aot_path = NULL;
+char *cache_dir = NULL;
 
 static void process_args(int argc, char **argv, int *argc_offset)
 {
@@ -49,6 +56,23 @@ static void process_args(int argc, char **argv, int *argc_offset)
 
             gc_multiplier = atoi(argv[i]);
         }
+        else if (strcmp("-aot", arg) == 0) {
+            i++;
+            if (i + 1 >= argc)
+                usage();
+
+            aot_path = argv[i];
+        }
+        else if (strcmp("-cache", arg) == 0) {
+            i++;
+            if (i + 1 >= argc)
+                usage();
+
+            cache_dir = argv[i];
+            /* The interpreter puts the cache next to the file for "". */
+            if (strcmp(cache_dir, ".") == 0)
+                cache_dir = "";
+        }
         else if (strcmp("-s", arg) == 0) {
             i++;
             if (i == argc)
@@ -83,9 +107,29 @@ int main(int argc, char **argv)
 
     lily_op_argv(state, argc - argc_offset, argv + argc_offset);
 
+    if (cache_dir)
+        lily_op_code_cache(state, cache_dir);
+
     int result;
 
-    if (do_tags) {
+    if (aot_path) {
+        const char *text;
+        if (is_file == 0 || do_tags)
+            usage();
+
+        result = lily_aot_file(state, to_process, &text);
+        if (result) {
+            FILE *f = fopen(aot_path, "w");
+            if (f == NULL) {
+                fprintf(stderr, "Cannot open '%s' for writing.\n", aot_path);
+                exit(EXIT_FAILURE);
+            }
+
+            fputs(text, f);
+            fclose(f);
+        }
+    }
+    else if (do_tags) {
         if (is_file == 1)
             result = lily_render_file(state, to_process);
         else
@@ -0,0 +1,21 @@
+# This is run by the build (not by configure) to write the header that holds
+# the key of code caches. SOURCES is the sources of the interpreter, split by
+# '|', and OUTPUT is the header to write. The header is only touched if the key
+# changed.
+string(REPLACE "|" ";" sources "${SOURCES}")
+list(SORT sources)
+set(cache_key "")
+
+foreach(path ${sources})
+    file(SHA1 "${path}" hash)
+    set(cache_key "${cache_key}${hash}")
+endforeach()
+
+string(SHA1 cache_key "${cache_key}")
+file(WRITE "${OUTPUT}.tmp"
+"/* Contents autogenerated by cache_key.cmake. */
+#define LILY_CACHE_KEY \"${cache_key}\"
+")
+execute_process(COMMAND ${CMAKE_COMMAND} -E copy_if_different
+    "${OUTPUT}.tmp" "${OUTPUT}")
+file(REMOVE "${OUTPUT}.tmp")
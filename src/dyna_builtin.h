@@ -2,134 +2,134 @@
 #include "lily_api_dyna.h"
 
 const char *lily_builtin_dynaload_table[] = {
-    "\0\0"
-    ,"R\0stdin\0File"
-    ,"R\0stderr\0File"
-    ,"R\0stdout\0File"
-    ,"F\0print\0[A](A)"
-    ,"F\0calltrace\0:List[String]"
-    ,"F\0assert\0(Boolean,*String)"
+    "\0D"
+    ,"R\0stdin\0File\0File\000"
+    ,"R\0stderr\0File\0File\000"
+    ,"R\0stdout\0File\0File\000"
+    ,"F\0print\0[A](A)\0\001(\001-A\000"
+    ,"F\0calltrace\0:List[String]\0\000(\000[\001List\000String\000"
+    ,"F\0assert\0(Boolean,*String)\0\000(\002-Boolean\000*String\000"
     ,"N\0AssertionError\0< Exception"
     ,"C\02Boolean"
-    ,"m\0to_i\0(Boolean):Integer"
-    ,"m\0to_s\0(Boolean):String"
+    ,"m\0to_i\0(Boolean):Integer\0\000(\001Integer\000Boolean\000"
+    ,"m\0to_s\0(Boolean):String\0\000(\001String\000Boolean\000"
     ,"C\01Byte"
-    ,"m\0to_i\0(Byte):Integer"
+    ,"m\0to_i\0(Byte):Integer\0\000(\001Integer\000Byte\000"
     ,"C\04ByteString"
-    ,"m\0each_byte\0(ByteString,Function(Byte))"
-    ,"m\0encode\0(ByteString,*String):Option[String]"
-    ,"m\0size\0(ByteString):Integer"
-    ,"m\0slice\0(ByteString,*Integer,*Integer):ByteString"
+    ,"m\0each_byte\0(ByteString,Function(Byte))\0\000(\002-ByteString\000(\001-Byte\000"
+    ,"m\0encode\0(ByteString,*String):Option[String]\0\000(\002[\001Option\000String\000ByteString\000*String\000"
+    ,"m\0size\0(ByteString):Integer\0\000(\001Integer\000ByteString\000"
+    ,"m\0slice\0(ByteString,*Integer,*Integer):ByteString\0\000(\003ByteString\000ByteString\000*Integer\000*Integer\000"
     ,"N\01DivisionByZeroError\0< Exception"
-    ,"m\0<new>\0(String):DivisionByZeroError"
+    ,"m\0<new>\0(String):DivisionByZeroError\0\000(\001DivisionByZeroError\000String\000"
     ,"C\01Double"
-    ,"m\0to_i\0(Double):Integer"
+    ,"m\0to_i\0(Double):Integer\0\000(\001Integer\000Double\000"
     ,"C\01Dynamic"
-    ,"m\0<new>\0[A](A):Dynamic"
+    ,"m\0<new>\0[A](A):Dynamic\0\001(\001Dynamic\000A\000"
     ,"N\03Exception\0"
-    ,"m\0<new>\0(String):Exception"
-    ,"3\0message\0String"
-    ,"3\0traceback\0List[String]"
+    ,"m\0<new>\0(String):Exception\0\000(\001Exception\000String\000"
+    ,"3\0message\0String\0String\000"
+    ,"3\0traceback\0List[String]\0[\001List\000String\000"
     ,"C\07File"
-    ,"m\0close\0(File)"
-    ,"m\0each_line\0(File,Function(ByteString))"
-    ,"m\0open\0(String,String):File"
-    ,"m\0print\0[A](File,A)"
-    ,"m\0read\0(File,*Integer):ByteString"
-    ,"m\0read_line\0(File):ByteString"
-    ,"m\0write\0[A](File,A)"
+    ,"m\0close\0(File)\0\000(\001-File\000"
+    ,"m\0each_line\0(File,Function(ByteString))\0\000(\002-File\000(\001-ByteString\000"
+    ,"m\0open\0(String,String):File\0\000(\002File\000String\000String\000"
+    ,"m\0print\0[A](File,A)\0\001(\002-File\000A\000"
+    ,"m\0read\0(File,*Integer):ByteString\0\000(\002ByteString\000File\000*Integer\000"
+    ,"m\0read_line\0(File):ByteString\0\000(\001ByteString\000File\000"
+    ,"m\0write\0[A](File,A)\0\001(\002-File\000A\000"
     ,"C\01Function"
-    ,"m\0doc\0(Function(1)):String"
+    ,"m\0doc\0(Function(1)):String\0\000(\001String\000(\001-$\001"
     ,"C\013Hash"
-    ,"m\0clear\0[A,B](Hash[A,B])"
-    ,"m\0delete\0[A,B](Hash[A,B],A)"
-    ,"m\0each_pair\0[A,B](Hash[A,B],Function(A,B))"
-    ,"m\0get\0[A,B](Hash[A,B],A,B):B"
-    ,"m\0has_key\0[A,B](Hash[A,B],A):Boolean"
-    ,"m\0keys\0[A,B](Hash[A,B]):List[A]"
-    ,"m\0map_values\0[A,B,C](Hash[A,B],Function(B=>C)):Hash[A,C]"
-    ,"m\0merge\0[A,B](Hash[A,B],Hash[A,B]...):Hash[A,B]"
-    ,"m\0reject\0[A,B](Hash[A,B],Function(A,B=>Boolean)):Hash[A,B]"
-    ,"m\0select\0[A,B](Hash[A,B],Function(A,B=>Boolean)):Hash[A,B]"
-    ,"m\0size\0[A,B](Hash[A,B]):Integer"
+    ,"m\0clear\0[A,B](Hash[A,B])\0\002(\001-[\002Hash\000A\000B\000"
+    ,"m\0delete\0[A,B](Hash[A,B],A)\0\002(\002-[\002Hash\000A\000B\000A\000"
+    ,"m\0each_pair\0[A,B](Hash[A,B],Function(A,B))\0\002(\002-[\002Hash\000A\000B\000(\002-A\000B\000"
+    ,"m\0get\0[A,B](Hash[A,B],A,B):B\0\002(\003B\000[\002Hash\000A\000B\000A\000B\000"
+    ,"m\0has_key\0[A,B](Hash[A,B],A):Boolean\0\002(\002Boolean\000[\002Hash\000A\000B\000A\000"
+    ,"m\0keys\0[A,B](Hash[A,B]):List[A]\0\002(\001[\001List\000A\000[\002Hash\000A\000B\000"
+    ,"m\0map_values\0[A,B,C](Hash[A,B],Function(B=>C)):Hash[A,C]\0\003(\002[\002Hash\000A\000C\000[\002Hash\000A\000B\000(\001C\000B\000"
+    ,"m\0merge\0[A,B](Hash[A,B],Hash[A,B]...):Hash[A,B]\0\002(\002[\002Hash\000A\000B\000[\002Hash\000A\000B\000.[\002Hash\000A\000B\000"
+    ,"m\0reject\0[A,B](Hash[A,B],Function(A,B=>Boolean)):Hash[A,B]\0\002(\002[\002Hash\000A\000B\000[\002Hash\000A\000B\000(\002Boolean\000A\000B\000"
+    ,"m\0select\0[A,B](Hash[A,B],Function(A,B=>Boolean)):Hash[A,B]\0\002(\002[\002Hash\000A\000B\000[\002Hash\000A\000B\000(\002Boolean\000A\000B\000"
+    ,"m\0size\0[A,B](Hash[A,B]):Integer\0\002(\001Integer\000[\002Hash\000A\000B\000"
     ,"N\01IndexError\0< Exception"
-    ,"m\0<new>\0(String):IndexError"
+    ,"m\0<new>\0(String):IndexError\0\000(\001IndexError\000String\000"
     ,"C\04Integer"
-    ,"m\0to_bool\0(Integer):Boolean"
-    ,"m\0to_byte\0(Integer):Byte"
-    ,"m\0to_d\0(Integer):Double"
-    ,"m\0to_s\0(Integer):String"
+    ,"m\0to_bool\0(Integer):Boolean\0\000(\001Boolean\000Integer\000"
+    ,"m\0to_byte\0(Integer):Byte\0\000(\001Byte\000Integer\000"
+    ,"m\0to_d\0(Integer):Double\0\000(\001Double\000Integer\000"
+    ,"m\0to_s\0(Integer):String\0\000(\001String\000Integer\000"
     ,"N\01IOError\0< Exception"
-    ,"m\0<new>\0(String):IOError"
+    ,"m\0<new>\0(String):IOError\0\000(\001IOError\000String\000"
     ,"N\01KeyError\0< Exception"
-    ,"m\0<new>\0(String):KeyError"
+    ,"m\0<new>\0(String):KeyError\0\000(\001KeyError\000String\000"
     ,"C\022List"
-    ,"m\0clear\0[A](List[A])"
-    ,"m\0count\0[A](List[A],Function(A=>Boolean)):Integer"
-    ,"m\0delete_at\0[A](List[A],Integer)"
-    ,"m\0each\0[A](List[A],Function(A)):List[A]"
-    ,"m\0each_index\0[A](List[A],Function(Integer)):List[A]"
-    ,"m\0fold\0[A](List[A],A,Function(A,A=>A)):A"
-    ,"m\0insert\0[A](List[A],Integer,A)"
-    ,"m\0join\0[A](List[A],*String):String"
-    ,"m\0map\0[A,B](List[A],Function(A=>B)):List[B]"
-    ,"m\0pop\0[A](List[A]):A"
-    ,"m\0push\0[A](List[A],A)"
-    ,"m\0reject\0[A](List[A],Function(A=>Boolean)):List[A]"
-    ,"m\0repeat\0[A](Integer,A):List[A]"
-    ,"m\0select\0[A](List[A],Function(A=>Boolean)):List[A]"
-    ,"m\0size\0[A](List[A]):Integer"
-    ,"m\0shift\0[A](List[A]):A"
-    ,"m\0slice\0[A](List[A],*Integer,*Integer):List[A]"
-    ,"m\0unshift\0[A](List[A],A)"
+    ,"m\0clear\0[A](List[A])\0\001(\001-[\001List\000A\000"
+    ,"m\0count\0[A](List[A],Function(A=>Boolean)):Integer\0\001(\002Integer\000[\001List\000A\000(\001Boolean\000A\000"
+    ,"m\0delete_at\0[A](List[A],Integer)\0\001(\002-[\001List\000A\000Integer\000"
+    ,"m\0each\0[A](List[A],Function(A)):List[A]\0\001(\002[\001List\000A\000[\001List\000A\000(\001-A\000"
+    ,"m\0each_index\0[A](List[A],Function(Integer)):List[A]\0\001(\002[\001List\000A\000[\001List\000A\000(\001-Integer\000"
+    ,"m\0fold\0[A](List[A],A,Function(A,A=>A)):A\0\001(\003A\000[\001List\000A\000A\000(\002A\000A\000A\000"
+    ,"m\0insert\0[A](List[A],Integer,A)\0\001(\003-[\001List\000A\000Integer\000A\000"
+    ,"m\0join\0[A](List[A],*String):String\0\001(\002String\000[\001List\000A\000*String\000"
+    ,"m\0map\0[A,B](List[A],Function(A=>B)):List[B]\0\002(\002[\001List\000B\000[\001List\000A\000(\001B\000A\000"
+    ,"m\0pop\0[A](List[A]):A\0\001(\001A\000[\001List\000A\000"
+    ,"m\0push\0[A](List[A],A)\0\001(\002-[\001List\000A\000A\000"
+    ,"m\0reject\0[A](List[A],Function(A=>Boolean)):List[A]\0\001(\002[\001List\000A\000[\001List\000A\000(\001Boolean\000A\000"
+    ,"m\0repeat\0[A](Integer,A):List[A]\0\001(\002[\001List\000A\000Integer\000A\000"
+    ,"m\0select\0[A](List[A],Function(A=>Boolean)):List[A]\0\001(\002[\001List\000A\000[\001List\000A\000(\001Boolean\000A\000"
+    ,"m\0size\0[A](List[A]):Integer\0\001(\001Integer\000[\001List\000A\000"
+    ,"m\0shift\0[A](List[A]):A\0\001(\001A\000[\001List\000A\000"
+    ,"m\0slice\0[A](List[A],*Integer,*Integer):List[A]\0\001(\003[\001List\000A\000[\001List\000A\000*Integer\000*Integer\000"
+    ,"m\0unshift\0[A](List[A],A)\0\001(\002-[\001List\000A\000A\000"
     ,"E\012Option\0[A]"
-    ,"m\0and\0[A,B](Option[A],Option[B]):Option[B]"
-    ,"m\0and_then\0[A,B](Option[A],Function(A=>Option[B])):Option[B]"
-    ,"m\0is_none\0[A](Option[A]):Boolean"
-    ,"m\0is_some\0[A](Option[A]):Boolean"
-    ,"m\0map\0[A,B](Option[A],Function(A=>B)):Option[B]"
-    ,"m\0or\0[A](Option[A],Option[A]):Option[A]"
-    ,"m\0or_else\0[A](Option[A],Function(=>Option[A])):Option[A]"
-    ,"m\0unwrap\0[A](Option[A]):A"
-    ,"m\0unwrap_or\0[A](Option[A],A):A"
-    ,"m\0unwrap_or_else\0[A](Option[A],Function(=>A)):A"
+    ,"m\0and\0[A,B](Option[A],Option[B]):Option[B]\0\002(\002[\001Option\000B\000[\001Option\000A\000[\001Option\000B\000"
+    ,"m\0and_then\0[A,B](Option[A],Function(A=>Option[B])):Option[B]\0\002(\002[\001Option\000B\000[\001Option\000A\000(\001[\001Option\000B\000A\000"
+    ,"m\0is_none\0[A](Option[A]):Boolean\0\001(\001Boolean\000[\001Option\000A\000"
+    ,"m\0is_some\0[A](Option[A]):Boolean\0\001(\001Boolean\000[\001Option\000A\000"
+    ,"m\0map\0[A,B](Option[A],Function(A=>B)):Option[B]\0\002(\002[\001Option\000B\000[\001Option\000A\000(\001B\000A\000"
+    ,"m\0or\0[A](Option[A],Option[A]):Option[A]\0\001(\002[\001Option\000A\000[\001Option\000A\000[\001Option\000A\000"
+    ,"m\0or_else\0[A](Option[A],Function(=>Option[A])):Option[A]\0\001(\002[\001Option\000A\000[\001Option\000A\000(\000[\001Option\000A\000"
+    ,"m\0unwrap\0[A](Option[A]):A\0\001(\001A\000[\001Option\000A\000"
+    ,"m\0unwrap_or\0[A](Option[A],A):A\0\001(\002A\000[\001Option\000A\000A\000"
+    ,"m\0unwrap_or_else\0[A](Option[A],Function(=>A)):A\0\001(\002A\000[\001Option\000A\000(\000A\000"
     ,"V\0Some\0(A)"
     ,"V\0None\0"
     ,"E\04Result\0[A, B]"
-    ,"m\0failure\0[A,B](Result[A,B]):Option[A]"
-    ,"m\0is_failure\0[A,B](Result[A,B]):Boolean"
-    ,"m\0is_success\0[A,B](Result[A,B]):Boolean"
-    ,"m\0success\0[A,B](Result[A,B]):Option[B]"
+    ,"m\0failure\0[A,B](Result[A,B]):Option[A]\0\002(\001[\001Option\000A\000[\002Result\000A\000B\000"
+    ,"m\0is_failure\0[A,B](Result[A,B]):Boolean\0\002(\001Boolean\000[\002Result\000A\000B\000"
+    ,"m\0is_success\0[A,B](Result[A,B]):Boolean\0\002(\001Boolean\000[\002Result\000A\000B\000"
+    ,"m\0success\0[A,B](Result[A,B]):Option[B]\0\002(\001[\001Option\000B\000[\002Result\000A\000B\000"
     ,"V\0Failure\0(A)"
     ,"V\0Success\0(B)"
     ,"N\01RuntimeError\0< Exception"
-    ,"m\0<new>\0(String):RuntimeError"
+    ,"m\0<new>\0(String):RuntimeError\0\000(\001RuntimeError\000String\000"
     ,"C\024String"
-    ,"m\0format\0(String,1...):String"
-    ,"m\0ends_with\0(String,String):Boolean"
-    ,"m\0find\0(String,String,*Integer):Option[Integer]"
-    ,"m\0html_encode\0(String):String"
-    ,"m\0is_alnum\0(String):Boolean"
-    ,"m\0is_alpha\0(String):Boolean"
-    ,"m\0is_digit\0(String):Boolean"
-    ,"m\0is_space\0(String):Boolean"
-    ,"m\0lower\0(String):String"
-    ,"m\0lstrip\0(String,String):String"
-    ,"m\0parse_i\0(String):Option[Integer]"
-    ,"m\0replace\0(String,String,String):String"
-    ,"m\0rstrip\0(String,String):String"
-    ,"m\0slice\0(String,*Integer,*Integer):String"
-    ,"m\0split\0(String,*String):List[String]"
-    ,"m\0starts_with\0(String,String):Boolean"
-    ,"m\0strip\0(String,String):String"
-    ,"m\0to_bytestring\0(String):ByteString"
-    ,"m\0trim\0(String):String"
-    ,"m\0upper\0(String):String"
+    ,"m\0format\0(String,1...):String\0\000(\002String\000String\000.$\001"
+    ,"m\0ends_with\0(String,String):Boolean\0\000(\002Boolean\000String\000String\000"
+    ,"m\0find\0(String,String,*Integer):Option[Integer]\0\000(\003[\001Option\000Integer\000String\000String\000*Integer\000"
+    ,"m\0html_encode\0(String):String\0\000(\001String\000String\000"
+    ,"m\0is_alnum\0(String):Boolean\0\000(\001Boolean\000String\000"
+    ,"m\0is_alpha\0(String):Boolean\0\000(\001Boolean\000String\000"
+    ,"m\0is_digit\0(String):Boolean\0\000(\001Boolean\000String\000"
+    ,"m\0is_space\0(String):Boolean\0\000(\001Boolean\000String\000"
+    ,"m\0lower\0(String):String\0\000(\001String\000String\000"
+    ,"m\0lstrip\0(String,String):String\0\000(\002String\000String\000String\000"
+    ,"m\0parse_i\0(String):Option[Integer]\0\000(\001[\001Option\000Integer\000String\000"
+    ,"m\0replace\0(String,String,String):String\0\000(\003String\000String\000String\000String\000"
+    ,"m\0rstrip\0(String,String):String\0\000(\002String\000String\000String\000"
+    ,"m\0slice\0(String,*Integer,*Integer):String\0\000(\003String\000String\000*Integer\000*Integer\000"
+    ,"m\0split\0(String,*String):List[String]\0\000(\002[\001List\000String\000String\000*String\000"
+    ,"m\0starts_with\0(String,String):Boolean\0\000(\002Boolean\000String\000String\000"
+    ,"m\0strip\0(String,String):String\0\000(\002String\000String\000String\000"
+    ,"m\0to_bytestring\0(String):ByteString\0\000(\001ByteString\000String\000"
+    ,"m\0trim\0(String):String\0\000(\001String\000String\000"
+    ,"m\0upper\0(String):String\0\000(\001String\000String\000"
     ,"C\02Tuple"
-    ,"m\0merge\0(Tuple[1],Tuple[2]):Tuple[1,2]"
-    ,"m\0push\0[A](Tuple[1],A):Tuple[1,A]"
+    ,"m\0merge\0(Tuple[1],Tuple[2]):Tuple[1,2]\0\000(\002[\002Tuple\000$\001$\002[\001Tuple\000$\001[\001Tuple\000$\002"
+    ,"m\0push\0[A](Tuple[1],A):Tuple[1,A]\0\001(\002[\002Tuple\000$\001A\000[\001Tuple\000$\001A\000"
     ,"N\01ValueError\0< Exception"
-    ,"m\0<new>\0(String):ValueError"
+    ,"m\0<new>\0(String):ValueError\0\000(\001ValueError\000String\000"
     ,"Z"
 };
 
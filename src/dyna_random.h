@@ -2,10 +2,10 @@
 #include "lily_api_dyna.h"
 
 const char *lily_random_dynaload_table[] = {
-    "\1Random\0"
-    ,"C\2Random"
-    ,"m\0<new>\0(*Integer):Random"
-    ,"m\0between\0(Random,Integer,Integer):Integer"
+    "\1Random\0D"
+    ,"C\02Random"
+    ,"m\0<new>\0(*Integer):Random\0\000(\001Random\000*Integer\000"
+    ,"m\0between\0(Random,Integer,Integer):Integer\0\000(\003Integer\000Random\000Integer\000Integer\000"
     ,"Z"
 };
 
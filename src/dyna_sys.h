@@ -2,9 +2,9 @@
 #include "lily_api_dyna.h"
 
 const char *lily_sys_dynaload_table[] = {
-    "\0\0"
-    ,"R\0argv\0List[String]"
-    ,"F\0getenv\0(String):Option[String]"
+    "\0D"
+    ,"R\0argv\0List[String]\0[\001List\000String\000"
+    ,"F\0getenv\0(String):Option[String]\0\000(\001[\001Option\000String\000String\000"
     ,"Z"
 };
 
@@ -2,12 +2,12 @@
 #include "lily_api_dyna.h"
 
 const char *lily_time_dynaload_table[] = {
-    "\1Time\0"
-    ,"C\4Time"
-    ,"m\0clock\0:Double"
-    ,"m\0now\0:Time"
-    ,"m\0to_s\0(Time):String"
-    ,"m\0since_epoch\0(Time):Integer"
+    "\1Time\0D"
+    ,"C\04Time"
+    ,"m\0clock\0:Double\0\000(\000Double\000"
+    ,"m\0now\0:Time\0\000(\000Time\000"
+    ,"m\0to_s\0(Time):String\0\000(\001String\000Time\000"
+    ,"m\0since_epoch\0(Time):Integer\0\000(\001Integer\000Time\000"
     ,"Z"
 };
 
@@ -1,17 +1,264 @@
+#include <string.h>
+
 #include "lily_alloc.h"
 
+/* Each block in an arena starts with a header holding the size of the block, so
+   that realloc knows how much to copy out of it. The second word of the header
+   is set if the block is freed while its arena is active. Blocks are kept at
+   this alignment so that any type can be stored in them. */
+#define ARENA_HEADER 16
+
+#define block_size(ptr) (*(size_t *)((char *)(ptr) - ARENA_HEADER))
+#define block_freed(ptr) (*(size_t *)((char *)(ptr) - ARENA_HEADER / 2))
+
+/** Arenas are made, used, and freed by whichever thread is working with the
+    snapshot or clone that holds them. The arenas that are active belong to the
+    thread that activated them. Every thread needs to know about every arena
+    though, since memory from any of them might be freed (a clone running on
+    one thread frees code from the snapshot's readonly arena that another
+    thread also uses).
+
+    Changes to the list of arenas are made under a spin lock, but lookups
+    never take it. Each change publishes a new, immutable table of arenas, and
+    the table it replaces is freed once every lookup that might be reading it
+    is done. Lookups say they're reading by counting themselves in the current
+    epoch, and a change moves to the next epoch, then waits until the count of
+    the last one drains. Most memory isn't from an arena, so the lowest and
+    highest addresses of all arenas are kept as well. Pointers outside of that
+    range, or inside of an arena active on the thread, don't need the table. **/
+
+#if defined(_MSC_VER) && !defined(__clang__)
+# include <windows.h>
+# define THREAD_LOCAL __declspec(thread)
+
+static volatile LONG registry_lock = 0;
+# define lock_registry() \
+    while (InterlockedExchange(&registry_lock, 1)) YieldProcessor()
+# define unlock_registry() InterlockedExchange(&registry_lock, 0)
+
+/* Aligned reads and writes of a word are atomic on Windows. */
+typedef volatile uintptr_t atomic_word;
+# define load_word(w) (w)
+# define store_word(w, v) ((w) = (v))
+
+/* Interlocked functions are full barriers. Going up gives the old count. */
+typedef volatile LONG atomic_count;
+# define count_of(c) (c)
+# define count_up(c) (InterlockedIncrement(&(c)) - 1)
+# define count_down(c) InterlockedDecrement(&(c))
+# define spin() YieldProcessor()
+#else
+# include <stdatomic.h>
+# define THREAD_LOCAL _Thread_local
+
+static atomic_flag registry_lock = ATOMIC_FLAG_INIT;
+# define lock_registry() \
+    while (atomic_flag_test_and_set_explicit(&registry_lock, \
+            memory_order_acquire)) {}
+# define unlock_registry() \
+    atomic_flag_clear_explicit(&registry_lock, memory_order_release)
+
+typedef _Atomic uintptr_t atomic_word;
+# define load_word(w) atomic_load_explicit(&(w), memory_order_acquire)
+# define store_word(w, v) atomic_store_explicit(&(w), v, memory_order_release)
+
+/* These are sequentially consistent, so that a lookup's count is seen before
+   it looks at the epoch again. */
+typedef atomic_long atomic_count;
+# define count_of(c) atomic_load(&(c))
+# define count_up(c) atomic_fetch_add(&(c), 1)
+# define count_down(c) atomic_fetch_sub(&(c), 1)
+# define spin()
+#endif
+
+static THREAD_LOCAL lily_arena *active_arena = NULL;
+static THREAD_LOCAL lily_arena *readonly_arena = NULL;
+
+/* How many threads have an arena active. While none do, lily_malloc can skip
+   looking at the (thread-local) arenas. */
+static atomic_word active_count = 0;
+
+/* Live arenas, sorted by base address. A table is never changed once it has
+   been published. */
+typedef struct {
+    int count;
+    lily_arena *arenas[];
+} arena_table;
+
+static atomic_word current_table = 0;
+
+/* Lookups in progress, by the parity of the epoch they started in. */
+static atomic_count epoch = 0;
+static atomic_count readers[2] = {0, 0};
+
+/* The range of addresses that arenas cover. When there are no arenas, the low
+   end is above the high end, so that no pointer is inside. */
+static atomic_word arena_low = UINTPTR_MAX;
+static atomic_word arena_high = 0;
+
+static lily_arena *find_arena(arena_table *t, void *ptr)
+{
+    char *p = (char *)ptr;
+    int lo = 0, hi = t->count - 1;
+
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        lily_arena *a = t->arenas[mid];
+
+        if (p < a->base)
+            hi = mid - 1;
+        else if (p >= a->base + a->size)
+            lo = mid + 1;
+        else
+            return a;
+    }
+
+    return NULL;
+}
+
+#define inside(a, p) \
+    ((a) && \
+     (p) >= (uintptr_t)(a)->base && \
+     (p) < (uintptr_t)(a)->base + (a)->size)
+
+/* This finds the arena that 'ptr' is inside of, or NULL if it's from the heap.
+   The arena can't go away while memory inside of it is still in use, so the
+   result can be used after the lookup is done. */
+static lily_arena *arena_of(void *ptr)
+{
+    uintptr_t p = (uintptr_t)ptr;
+
+    if (p < load_word(arena_low) || p >= load_word(arena_high))
+        return NULL;
+
+    if (inside(active_arena, p))
+        return active_arena;
+
+    if (inside(readonly_arena, p))
+        return readonly_arena;
+
+    long e;
+
+    while (1) {
+        e = count_of(epoch);
+        count_up(readers[e & 1]);
+
+        /* If the epoch moved before this lookup was counted, the change that
+           moved it may not be waiting on this count. */
+        if (count_of(epoch) == e)
+            break;
+
+        count_down(readers[e & 1]);
+    }
+
+    arena_table *t = (arena_table *)load_word(current_table);
+    lily_arena *a = t ? find_arena(t, ptr) : NULL;
+
+    count_down(readers[e & 1]);
+    return a;
+}
+
+/* Call this with the lock held. The table given (NULL if there are no arenas)
+   replaces the current one, and the old one is freed once no lookup can be
+   reading it. */
+static void publish_table(arena_table *t)
+{
+    arena_table *old = (arena_table *)load_word(current_table);
+
+    store_word(current_table, (uintptr_t)t);
+
+    if (t == NULL) {
+        store_word(arena_low, UINTPTR_MAX);
+        store_word(arena_high, 0);
+    }
+    else {
+        lily_arena *last = t->arenas[t->count - 1];
+
+        store_word(arena_low, (uintptr_t)t->arenas[0]->base);
+        store_word(arena_high, (uintptr_t)(last->base + last->size));
+    }
+
+    if (old == NULL)
+        return;
+
+    long e = count_up(epoch);
+
+    while (count_of(readers[e & 1]))
+        spin();
+
+    free(old);
+}
+
+static arena_table *new_table(int count)
+{
+    arena_table *t = malloc(sizeof(*t) + count * sizeof(lily_arena *));
+    if (t == NULL)
+        abort();
+
+    t->count = count;
+    return t;
+}
+
+static void *arena_malloc(lily_arena *a, size_t size)
+{
+    size_t need = ARENA_HEADER +
+            ((size + ARENA_HEADER - 1) & ~(size_t)(ARENA_HEADER - 1));
+
+    if (a->size - a->pos < need) {
+        a->overflowed = 1;
+        return NULL;
+    }
+
+    char *block = a->base + a->pos;
+    a->pos += need;
+    *(size_t *)block = size;
+    return block + ARENA_HEADER;
+}
+
 void *lily_malloc(size_t size)
 {
-    void *result = malloc(size);
+    void *result;
+
+    if (load_word(active_count) == 0 ||
+        active_arena == NULL ||
+        (result = arena_malloc(active_arena, size)) == NULL)
+        result = malloc(size);
+
     if (result == NULL)
         abort();
 
     return result;
 }
 
+void *lily_malloc_readonly(size_t size)
+{
+    void *result;
+
+    if (load_word(active_count) == 0 ||
+        readonly_arena == NULL ||
+        (result = arena_malloc(readonly_arena, size)) == NULL)
+        result = lily_malloc(size);
+
+    return result;
+}
+
 void *lily_realloc(void *ptr, size_t new_size)
 {
-    void *result = realloc(ptr, new_size);
+    void *result;
+
+    if (ptr && arena_of(ptr)) {
+        size_t old_size = block_size(ptr);
+
+        result = lily_malloc(new_size);
+        memcpy(result, ptr, old_size < new_size ? old_size : new_size);
+        lily_free(ptr);
+        return result;
+    }
+
+    if (ptr == NULL)
+        return lily_malloc(new_size);
+
+    result = realloc(ptr, new_size);
     if (result == NULL)
         abort();
 
@@ -20,5 +267,174 @@ void *lily_realloc(void *ptr, size_t new_size)
 
 void lily_free(void *ptr)
 {
+    if (ptr) {
+        lily_arena *a = arena_of(ptr);
+
+        if (a) {
+            /* Other arenas may be shared, so only the active one is written
+               to. */
+            if (a == active_arena)
+                block_freed(ptr) = 1;
+
+            return;
+        }
+    }
+
     free(ptr);
 }
+
+lily_arena *lily_new_arena(size_t size)
+{
+    lily_arena *a = malloc(sizeof(*a));
+    if (a == NULL)
+        abort();
+
+    size = (size + ARENA_HEADER - 1) & ~(size_t)(ARENA_HEADER - 1);
+
+    /* Zeroing the memory keeps padding and unused space the same each time
+       the arena is filled. */
+    a->base = calloc(1, size ? size : ARENA_HEADER);
+    if (a->base == NULL)
+        abort();
+
+    a->size = size;
+    a->pos = 0;
+    a->overflowed = 0;
+    a->refcount = 1;
+
+    lock_registry();
+
+    arena_table *old = (arena_table *)load_word(current_table);
+    int count = old ? old->count : 0;
+    arena_table *t = new_table(count + 1);
+    int i, j;
+
+    for (i = 0, j = 0;i < count;i++, j++) {
+        if (i == j && old->arenas[i]->base > a->base)
+            t->arenas[j++] = a;
+
+        t->arenas[j] = old->arenas[i];
+    }
+
+    if (i == j)
+        t->arenas[j] = a;
+
+    publish_table(t);
+    unlock_registry();
+    return a;
+}
+
+/* A snapshot's readonly arena is shared by clones on any thread, so the count
+   is changed under the lock. */
+lily_arena *lily_arena_ref(lily_arena *a)
+{
+    lock_registry();
+    a->refcount++;
+    unlock_registry();
+    return a;
+}
+
+void lily_free_arena(lily_arena *a)
+{
+    lock_registry();
+
+    a->refcount--;
+    if (a->refcount) {
+        unlock_registry();
+        return;
+    }
+
+    arena_table *old = (arena_table *)load_word(current_table);
+    arena_table *t = NULL;
+    int i, j;
+
+    if (old->count != 1) {
+        t = new_table(old->count - 1);
+
+        for (i = 0, j = 0;i < old->count;i++) {
+            if (old->arenas[i] != a)
+                t->arenas[j++] = old->arenas[i];
+        }
+    }
+
+    /* Lookups that might see this arena are done once this returns. */
+    publish_table(t);
+    unlock_registry();
+
+    if (active_arena == a)
+        lily_arena_swap(NULL);
+
+    if (readonly_arena == a)
+        lily_readonly_arena_swap(NULL);
+
+    free(a->base);
+    free(a);
+}
+
+uint32_t lily_arena_live_ranges(lily_arena *a, size_t **ranges_out)
+{
+    uint32_t count = 0, space = 16;
+    size_t *ranges = lily_malloc(space * 2 * sizeof(size_t));
+    size_t pos = 0;
+
+    while (pos < a->pos) {
+        char *ptr = a->base + pos + ARENA_HEADER;
+        size_t need = ARENA_HEADER +
+                ((block_size(ptr) + ARENA_HEADER - 1) &
+                 ~(size_t)(ARENA_HEADER - 1));
+
+        if (block_freed(ptr) == 0) {
+            if (count && ranges[count * 2 - 1] == pos)
+                ranges[count * 2 - 1] = pos + need;
+            else {
+                if (count == space) {
+                    space *= 2;
+                    ranges = lily_realloc(ranges, space * 2 * sizeof(size_t));
+                }
+
+                ranges[count * 2] = pos;
+                ranges[count * 2 + 1] = pos + need;
+                count++;
+            }
+        }
+
+        pos += need;
+    }
+
+    *ranges_out = ranges;
+    return count;
+}
+
+/* Threads with either kind of arena active are counted. Other threads may be
+   swapping too, so the count is changed under the lock. */
+static void swap_count(lily_arena *old, lily_arena *new_arena,
+        lily_arena *other)
+{
+    if (other || (old == NULL) == (new_arena == NULL))
+        return;
+
+    lock_registry();
+
+    if (new_arena)
+        store_word(active_count, load_word(active_count) + 1);
+    else
+        store_word(active_count, load_word(active_count) - 1);
+
+    unlock_registry();
+}
+
+lily_arena *lily_arena_swap(lily_arena *a)
+{
+    lily_arena *old = active_arena;
+    swap_count(old, a, readonly_arena);
+    active_arena = a;
+    return old;
+}
+
+lily_arena *lily_readonly_arena_swap(lily_arena *a)
+{
+    lily_arena *old = readonly_arena;
+    swap_count(old, a, active_arena);
+    readonly_arena = a;
+    return old;
+}
@@ -1,10 +1,46 @@
 #ifndef LILY_API_ALLOC_H
 # define LILY_API_ALLOC_H
 
+# include <stdint.h>
 # include <stdlib.h>
 
 void *lily_malloc(size_t);
 void *lily_realloc(void *, size_t);
 void lily_free(void *);
 
+/* An arena is a single block of memory that allocations can be carved out of.
+   While an arena is active, every lily_malloc is served from it until it runs
+   out (after which the heap is used and the arena is marked as overflowed).
+   Memory inside of a live arena is never given to free: lily_free ignores it,
+   and lily_realloc copies it into a new block from lily_malloc (so while an
+   arena is active, the new block is usually inside of that arena too). The
+   arena itself is released all at once, when the last reference to it is
+   dropped. Each thread has its own active arena. Arenas can be made,
+   referenced, and freed from any thread, but one arena shouldn't be active on
+   two threads at once. */
+typedef struct lily_arena_ {
+    char *base;
+    size_t size;
+    size_t pos;
+    int overflowed;
+    int refcount;
+} lily_arena;
+
+lily_arena *lily_new_arena(size_t);
+lily_arena *lily_arena_ref(lily_arena *);
+void lily_free_arena(lily_arena *);
+lily_arena *lily_arena_swap(lily_arena *);
+
+/* Blocks freed while their arena is active are remembered. This finds the runs
+   of blocks that haven't been freed, and sets 'ranges' to the start and end
+   offset of each (the caller frees it). The number of runs is returned. */
+uint32_t lily_arena_live_ranges(lily_arena *, size_t **);
+
+/* This is for memory that holds no pointers, and is never written to once it
+   has been filled in (such as the code of a function). While a readonly arena
+   is active, this memory comes from there instead of the active arena. That
+   lets states cloned from a snapshot share it instead of copying it. */
+void *lily_malloc_readonly(size_t);
+lily_arena *lily_readonly_arena_swap(lily_arena *);
+
 #endif
@@ -0,0 +1,662 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "lily_alloc.h"
+#include "lily_aot.h"
+#include "lily_value_flags.h"
+
+#include "lily_int_code_iter.h"
+#include "lily_int_opcode.h"
+
+/** This translates the functions of a module into C source. The result is a
+    library that can be imported in place of the module, with the same
+    dynaload table and loader that dyna_tools.py generates for packages written
+    in C.
+
+    Translation is done one function at a time, directly from the bytecode that
+    the emitter wrote. Registers are untyped at runtime, so the translator
+    tracks the class that was last written to each register. Lily's code is
+    structured so that a register is always written before it is read, in the
+    order that the code is laid out. That makes a single forward pass enough to
+    know what kind of value a register holds.
+
+    The subset supported is the one where native code wins the most: functions
+    that take and return Integer, Double, or Boolean, doing arithmetic,
+    comparisons, branches, loops, and calls to other functions in the module.
+    Anything else is a SyntaxError naming the function, since the library would
+    otherwise be missing it. **/
+
+typedef struct {
+    lily_var *var;
+    lily_function_val *func;
+} aot_entry;
+
+typedef struct {
+    lily_symtab *symtab;
+    lily_raiser *raiser;
+    lily_msgbuf *msgbuf;
+
+    aot_entry *entries;
+    int entry_count;
+
+    /* The class of the last value written to each register (0 if unknown). */
+    uint16_t *reg_class;
+    /* 1 if a code position is the target of a jump, 0 otherwise. */
+    uint8_t *targets;
+
+    const char *func_name;
+} lily_aot_state;
+
+static int is_aot_class(lily_type *type)
+{
+    int id = type->cls->id;
+
+    return (type->subtype_count == 0 &&
+            (id == LILY_INTEGER_ID ||
+             id == LILY_DOUBLE_ID ||
+             id == LILY_BOOLEAN_ID));
+}
+
+static int is_unit_return(lily_type *type)
+{
+    return (type == NULL || type->cls->id == LILY_UNIT_ID);
+}
+
+static const char *c_type_for(lily_type *type)
+{
+    if (is_unit_return(type))
+        return "void";
+    else if (type->cls->id == LILY_DOUBLE_ID)
+        return "double";
+    else
+        return "int64_t";
+}
+
+static const char *field_for(int class_id)
+{
+    if (class_id == LILY_DOUBLE_ID)
+        return "doubleval";
+    else
+        return "integer";
+}
+
+static void aot_error(lily_aot_state *as, const char *reason)
+{
+    lily_raise_syn(as->raiser, "Cannot compile function '%s': %s.",
+            as->func_name, reason);
+}
+
+/* Make sure that register 'reg' holds a value of a class that is supported.
+   The class is returned. */
+static int need_reg(lily_aot_state *as, int reg)
+{
+    int cls = as->reg_class[reg];
+
+    if (cls == 0)
+        aot_error(as, "a register is read before it has a known value");
+
+    return cls;
+}
+
+static aot_entry *entry_for_spot(lily_aot_state *as, int spot)
+{
+    int i;
+    for (i = 0;i < as->entry_count;i++) {
+        if (as->entries[i].var->reg_spot == spot)
+            return &as->entries[i];
+    }
+
+    return NULL;
+}
+
+/* This checks that a var holding a define can be turned into a C function.
+   Failure is a SyntaxError, since the library would be missing that function
+   otherwise. */
+static void check_signature(lily_aot_state *as, lily_var *var)
+{
+    lily_type *type = var->type;
+    int i;
+
+    as->func_name = var->name;
+
+    if (var->flags & VAR_NEEDS_CLOSURE)
+        aot_error(as, "closures are not supported");
+
+    if (type->flags & (TYPE_IS_VARARGS | TYPE_HAS_OPTARGS))
+        aot_error(as, "variable and optional arguments are not supported");
+
+    if (is_unit_return(type->subtypes[0]) == 0 &&
+        is_aot_class(type->subtypes[0]) == 0)
+        aot_error(as, "the return type must be Integer, Double, or Boolean");
+
+    for (i = 1;i < type->subtype_count;i++) {
+        if (is_aot_class(type->subtypes[i]) == 0)
+            aot_error(as,
+                    "argument types must be Integer, Double, or Boolean");
+    }
+}
+
+static void add_int64(lily_msgbuf *msgbuf, int64_t value)
+{
+    char buffer[32];
+
+    /* INT64_MIN can't be written as a negated literal. */
+    if (value == INT64_MIN)
+        strcpy(buffer, "INT64_MIN");
+    else
+        snprintf(buffer, sizeof(buffer), "INT64_C(%lld)", (long long)value);
+
+    lily_mb_add(msgbuf, buffer);
+}
+
+static void add_double(lily_msgbuf *msgbuf, double value)
+{
+    char buffer[64];
+
+    /* Hex floats round-trip exactly. */
+    snprintf(buffer, sizeof(buffer), "%a", value);
+    lily_mb_add(msgbuf, buffer);
+}
+
+/* Binary ops are all 'op, line, left, right, result'. */
+static void write_binary(lily_aot_state *as, uint16_t *code, int need_class,
+        const char *op)
+{
+    lily_msgbuf *msgbuf = as->msgbuf;
+    int lhs = code[2], rhs = code[3], result = code[4];
+    const char *field = field_for(need_class);
+
+    if (need_reg(as, lhs) != need_class ||
+        need_reg(as, rhs) != need_class)
+        aot_error(as, "operands have mixed types");
+
+    if (strcmp(op, "/") == 0 || strcmp(op, "%") == 0) {
+        lily_mb_add_fmt(msgbuf,
+                "    if (r[%d].%s == 0)\n"
+                "        lily_DivisionByZeroError(s, "
+                "\"Attempt to divide by zero.\");\n", rhs, field);
+    }
+
+    lily_mb_add_fmt(msgbuf, "    r[%d].%s = r[%d].%s %s r[%d].%s;\n",
+            result, field, lhs, field, op, rhs, field);
+    as->reg_class[result] = need_class;
+}
+
+static void write_compare(lily_aot_state *as, uint16_t *code, const char *op)
+{
+    int lhs = code[2], rhs = code[3], result = code[4];
+    int cls = need_reg(as, lhs);
+
+    if (cls != need_reg(as, rhs))
+        aot_error(as, "operands have mixed types");
+
+    const char *field = field_for(cls);
+
+    lily_mb_add_fmt(as->msgbuf, "    r[%d].integer = (r[%d].%s %s r[%d].%s);\n",
+            result, lhs, field, op, rhs, field);
+    as->reg_class[result] = LILY_BOOLEAN_ID;
+}
+
+static void write_call(lily_aot_state *as, uint16_t *code)
+{
+    lily_msgbuf *msgbuf = as->msgbuf;
+    aot_entry *target = entry_for_spot(as, code[2]);
+    int count = code[3], result = code[4];
+    int i;
+
+    if (target == NULL)
+        aot_error(as, "calls outside of this module are not supported");
+
+    lily_type *type = target->var->type;
+
+    lily_mb_add(msgbuf, "    ");
+    if (is_unit_return(type->subtypes[0]) == 0)
+        lily_mb_add_fmt(msgbuf, "r[%d].%s = ", result,
+                field_for(type->subtypes[0]->cls->id));
+
+    lily_mb_add_fmt(msgbuf, "aot_%s(s", target->var->name);
+    for (i = 0;i < count;i++) {
+        int reg = code[5 + i];
+        int cls = need_reg(as, reg);
+        if (cls != type->subtypes[i + 1]->cls->id)
+            aot_error(as, "an argument does not match the type wanted");
+
+        lily_mb_add_fmt(msgbuf, ", r[%d].%s", reg, field_for(cls));
+    }
+    lily_mb_add(msgbuf, ");\n");
+
+    if (is_unit_return(type->subtypes[0]))
+        as->reg_class[result] = 0;
+    else
+        as->reg_class[result] = type->subtypes[0]->cls->id;
+}
+
+static void write_readonly(lily_aot_state *as, uint16_t *code)
+{
+    lily_literal *lit = (lily_literal *)lily_vs_nth(as->symtab->literals,
+            code[2]);
+    int result = code[3];
+
+    if (lit->class_id == LILY_INTEGER_ID) {
+        lily_mb_add_fmt(as->msgbuf, "    r[%d].integer = ", result);
+        add_int64(as->msgbuf, lit->value.integer);
+    }
+    else if (lit->class_id == LILY_DOUBLE_ID) {
+        lily_mb_add_fmt(as->msgbuf, "    r[%d].doubleval = ", result);
+        add_double(as->msgbuf, lit->value.doubleval);
+    }
+    else
+        aot_error(as, "only Integer and Double literals are supported");
+
+    lily_mb_add(as->msgbuf, ";\n");
+    as->reg_class[result] = lit->class_id;
+}
+
+/* Each jump is relative to the start of the opcode it's within. */
+static void mark_targets(lily_aot_state *as, lily_function_val *f)
+{
+    lily_code_iter ci;
+    lily_ci_from_native(&ci, f);
+
+    memset(as->targets, 0, f->code_len + 1);
+
+    while (lily_ci_next(&ci)) {
+        int stop = ci.offset + ci.round_total;
+        int i;
+
+        for (i = stop - ci.jumps_7;i < stop;i++) {
+            int16_t jump = (int16_t)ci.buffer[i];
+            if (jump)
+                as->targets[ci.offset + jump] = 1;
+        }
+    }
+}
+
+static void write_signature(lily_msgbuf *msgbuf, aot_entry *entry)
+{
+    lily_type *type = entry->var->type;
+    int i;
+
+    lily_mb_add_fmt(msgbuf, "static %s aot_%s(lily_state *s",
+            c_type_for(type->subtypes[0]), entry->var->name);
+
+    for (i = 1;i < type->subtype_count;i++)
+        lily_mb_add_fmt(msgbuf, ", %s a%d", c_type_for(type->subtypes[i]),
+                i - 1);
+
+    lily_mb_add_char(msgbuf, ')');
+}
+
+static void write_function(lily_aot_state *as, aot_entry *entry)
+{
+    lily_msgbuf *msgbuf = as->msgbuf;
+    lily_function_val *f = entry->func;
+    lily_type *type = entry->var->type;
+    int i;
+
+    as->func_name = entry->var->name;
+    as->reg_class = lily_realloc(as->reg_class,
+            (f->reg_count + 1) * sizeof(uint16_t));
+    as->targets = lily_realloc(as->targets, f->code_len + 1);
+
+    memset(as->reg_class, 0, (f->reg_count + 1) * sizeof(uint16_t));
+    mark_targets(as, f);
+
+    write_signature(msgbuf, entry);
+
+    for (i = 1;i < type->subtype_count;i++)
+        as->reg_class[i - 1] = type->subtypes[i]->cls->id;
+
+    lily_mb_add_fmt(msgbuf, "\n{\n    aot_reg r[%d];\n",
+            f->reg_count ? f->reg_count : 1);
+
+    for (i = 1;i < type->subtype_count;i++)
+        lily_mb_add_fmt(msgbuf, "    r[%d].%s = a%d;\n", i - 1,
+                field_for(type->subtypes[i]->cls->id), i - 1);
+
+    lily_code_iter ci;
+    lily_ci_from_native(&ci, f);
+
+    while (lily_ci_next(&ci)) {
+        uint16_t *code = ci.buffer + ci.offset;
+        int cls;
+
+        if (as->targets[ci.offset])
+            lily_mb_add_fmt(msgbuf, "L%d: ;\n", ci.offset);
+
+        switch (ci.opcode) {
+            case o_fast_assign:
+            case o_assign:
+                cls = need_reg(as, code[2]);
+                lily_mb_add_fmt(msgbuf, "    r[%d] = r[%d];\n", code[3],
+                        code[2]);
+                as->reg_class[code[3]] = cls;
+                break;
+            case o_integer_add:
+                write_binary(as, code, LILY_INTEGER_ID, "+");
+                break;
+            case o_integer_minus:
+                write_binary(as, code, LILY_INTEGER_ID, "-");
+                break;
+            case o_integer_mul:
+                write_binary(as, code, LILY_INTEGER_ID, "*");
+                break;
+            case o_integer_div:
+                write_binary(as, code, LILY_INTEGER_ID, "/");
+                break;
+            case o_modulo:
+                write_binary(as, code, LILY_INTEGER_ID, "%");
+                break;
+            case o_left_shift:
+                write_binary(as, code, LILY_INTEGER_ID, "<<");
+                break;
+            case o_right_shift:
+                write_binary(as, code, LILY_INTEGER_ID, ">>");
+                break;
+            case o_bitwise_and:
+                write_binary(as, code, LILY_INTEGER_ID, "&");
+                break;
+            case o_bitwise_or:
+                write_binary(as, code, LILY_INTEGER_ID, "|");
+                break;
+            case o_bitwise_xor:
+                write_binary(as, code, LILY_INTEGER_ID, "^");
+                break;
+            case o_double_add:
+                write_binary(as, code, LILY_DOUBLE_ID, "+");
+                break;
+            case o_double_minus:
+                write_binary(as, code, LILY_DOUBLE_ID, "-");
+                break;
+            case o_double_mul:
+                write_binary(as, code, LILY_DOUBLE_ID, "*");
+                break;
+            case o_double_div:
+                write_binary(as, code, LILY_DOUBLE_ID, "/");
+                break;
+            case o_is_equal:
+                write_compare(as, code, "==");
+                break;
+            case o_not_eq:
+                write_compare(as, code, "!=");
+                break;
+            case o_less:
+                write_compare(as, code, "<");
+                break;
+            case o_less_eq:
+                write_compare(as, code, "<=");
+                break;
+            case o_greater:
+                write_compare(as, code, ">");
+                break;
+            case o_greater_eq:
+                write_compare(as, code, ">=");
+                break;
+            case o_unary_not:
+                cls = need_reg(as, code[2]);
+                if (cls == LILY_DOUBLE_ID)
+                    aot_error(as, "'!' on a Double is not supported");
+
+                lily_mb_add_fmt(msgbuf, "    r[%d].integer = !r[%d].integer;\n",
+                        code[3], code[2]);
+                as->reg_class[code[3]] = cls;
+                break;
+            case o_unary_minus:
+                if (need_reg(as, code[2]) != LILY_INTEGER_ID)
+                    aot_error(as, "unary '-' is only supported on Integer");
+
+                lily_mb_add_fmt(msgbuf, "    r[%d].integer = -r[%d].integer;\n",
+                        code[3], code[2]);
+                as->reg_class[code[3]] = LILY_INTEGER_ID;
+                break;
+            case o_jump:
+                lily_mb_add_fmt(msgbuf, "    goto L%d;\n",
+                        ci.offset + (int16_t)code[1]);
+                break;
+            case o_jump_if:
+                if (need_reg(as, code[2]) == LILY_DOUBLE_ID)
+                    aot_error(as, "a Double cannot be used as a condition");
+
+                /* The vm jumps when (value == 0) is not the check value. */
+                lily_mb_add_fmt(msgbuf, "    if (r[%d].integer %s 0) goto L%d;\n",
+                        code[2], code[1] ? "!=" : "==",
+                        ci.offset + (int16_t)code[3]);
+                break;
+            case o_native_call:
+                write_call(as, code);
+                break;
+            case o_return_val:
+                if (is_unit_return(type->subtypes[0]))
+                    aot_error(as, "a value is returned from a Unit function");
+
+                need_reg(as, code[2]);
+                lily_mb_add_fmt(msgbuf, "    return r[%d].%s;\n", code[2],
+                        field_for(type->subtypes[0]->cls->id));
+                break;
+            case o_return_unit:
+                lily_mb_add(msgbuf, "    return;\n");
+                break;
+            case o_get_readonly:
+                write_readonly(as, code);
+                break;
+            case o_get_integer:
+                lily_mb_add_fmt(msgbuf, "    r[%d].integer = %d;\n", code[3],
+                        (int16_t)code[2]);
+                as->reg_class[code[3]] = LILY_INTEGER_ID;
+                break;
+            case o_get_boolean:
+                lily_mb_add_fmt(msgbuf, "    r[%d].integer = %d;\n", code[3],
+                        code[2]);
+                as->reg_class[code[3]] = LILY_BOOLEAN_ID;
+                break;
+            case o_for_setup:
+                /* start, stop, step, then the internal loop counter. */
+                lily_mb_add_fmt(msgbuf,
+                        "    if (r[%d].integer == 0)\n"
+                        "        lily_ValueError(s, \"for loop step cannot be 0.\");\n"
+                        "    r[%d].integer = r[%d].integer - r[%d].integer;\n"
+                        "    r[%d].integer = r[%d].integer;\n",
+                        code[4], code[5], code[2], code[4], code[2], code[5]);
+                as->reg_class[code[5]] = LILY_INTEGER_ID;
+                break;
+            case o_integer_for:
+                /* loop counter, stop, step, user counter, then the exit. */
+                lily_mb_add_fmt(msgbuf,
+                        "    {\n"
+                        "        int64_t for_temp = r[%d].integer + r[%d].integer;\n"
+                        "        if ((r[%d].integer > 0)\n"
+                        "                ? (for_temp <= r[%d].integer)\n"
+                        "                : (for_temp >= r[%d].integer)) {\n"
+                        "            r[%d].integer = for_temp;\n"
+                        "            r[%d].integer = for_temp;\n"
+                        "        }\n"
+                        "        else\n"
+                        "            goto L%d;\n"
+                        "    }\n",
+                        code[2], code[4], code[4], code[3], code[3], code[5],
+                        code[2], ci.offset + (int16_t)code[6]);
+                as->reg_class[code[5]] = LILY_INTEGER_ID;
+                break;
+            case o_get_global:
+            case o_set_global:
+                aot_error(as, "globals are not supported");
+                break;
+            default:
+                aot_error(as, "it uses an operation that is not supported");
+                break;
+        }
+    }
+
+    lily_mb_add(msgbuf, "}\n\n");
+}
+
+static void write_wrapper(lily_aot_state *as, const char *name,
+        aot_entry *entry)
+{
+    lily_msgbuf *msgbuf = as->msgbuf;
+    lily_type *type = entry->var->type;
+    lily_type *ret = type->subtypes[0];
+    int i;
+
+    lily_mb_add_fmt(msgbuf, "void lily_%s__%s(lily_state *s)\n{\n    ", name,
+            entry->var->name);
+
+    if (is_unit_return(ret) == 0)
+        lily_mb_add_fmt(msgbuf, "lily_return_%s(s, ",
+                ret->cls->id == LILY_BOOLEAN_ID ? "boolean" :
+                ret->cls->id == LILY_DOUBLE_ID ? "double" : "integer");
+
+    lily_mb_add_fmt(msgbuf, "aot_%s(s", entry->var->name);
+
+    for (i = 1;i < type->subtype_count;i++) {
+        int id = type->subtypes[i]->cls->id;
+        lily_mb_add_fmt(msgbuf, ", lily_arg_%s(s, %d)",
+                id == LILY_BOOLEAN_ID ? "boolean" :
+                id == LILY_DOUBLE_ID ? "double" : "integer", i - 1);
+    }
+
+    if (is_unit_return(ret) == 0)
+        lily_mb_add(msgbuf, "));\n}\n\n");
+    else
+        lily_mb_add(msgbuf, ");\n    lily_return_unit(s);\n}\n\n");
+}
+
+/* This writes the dynaload table and loader in the same form that dyna_tools.py
+   writes them, but with the name that library loading looks for. */
+static void write_dynaload(lily_aot_state *as, const char *name)
+{
+    lily_msgbuf *msgbuf = as->msgbuf;
+    int i, j;
+
+    lily_mb_add(msgbuf, "const char *lily_dynaload_table[] = {\n"
+                        "    \"\\0\\0\"\n");
+
+    for (i = 0;i < as->entry_count;i++) {
+        lily_type *type = as->entries[i].var->type;
+        lily_mb_add_fmt(msgbuf, "    ,\"F\\0%s\\0", as->entries[i].var->name);
+
+        if (type->subtype_count > 1) {
+            lily_mb_add_char(msgbuf, '(');
+            for (j = 1;j < type->subtype_count;j++) {
+                if (j != 1)
+                    lily_mb_add_char(msgbuf, ',');
+                lily_mb_add(msgbuf, type->subtypes[j]->cls->name);
+            }
+            lily_mb_add_char(msgbuf, ')');
+        }
+
+        if (is_unit_return(type->subtypes[0]) == 0)
+            lily_mb_add_fmt(msgbuf, ":%s", type->subtypes[0]->cls->name);
+
+        lily_mb_add(msgbuf, "\"\n");
+    }
+
+    lily_mb_add(msgbuf, "    ,\"Z\"\n};\n\n");
+    lily_mb_add_fmt(msgbuf, "void *lily_%s_loader(lily_state *s, int id)\n{\n"
+                            "    switch (id) {\n", name);
+
+    for (i = 0;i < as->entry_count;i++)
+        lily_mb_add_fmt(msgbuf, "        case %d: return lily_%s__%s;\n", i + 1,
+                name, as->entries[i].var->name);
+
+    lily_mb_add(msgbuf, "        default: return NULL;\n    }\n}\n");
+}
+
+void lily_aot_write_module(lily_symtab *symtab, lily_raiser *raiser,
+        lily_module_entry *module, const char *name, lily_msgbuf *msgbuf)
+{
+    lily_aot_state as;
+    lily_var *var_iter;
+    int i, count = 0;
+
+    for (i = 0;name[i];i++) {
+        char ch = name[i];
+        if ((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') ||
+            (ch >= '0' && ch <= '9') || ch == '_')
+            continue;
+
+        lily_raise_syn(raiser, "Module name '%s' is not a valid C identifier.",
+                name);
+    }
+
+    if (module->class_chain)
+        lily_raise_syn(raiser,
+                "Cannot compile module '%s': Classes are not supported.", name);
+
+    for (var_iter = module->var_chain;var_iter;var_iter = var_iter->next) {
+        if (var_iter->flags & VAR_IS_READONLY &&
+            var_iter != symtab->main_var)
+            count++;
+    }
+
+    as.symtab = symtab;
+    as.raiser = raiser;
+    as.msgbuf = msgbuf;
+    as.entries = lily_malloc((count + 1) * sizeof(aot_entry));
+    as.entry_count = 0;
+    as.reg_class = NULL;
+    as.targets = NULL;
+
+    /* The var chain is newest first, so walk it backward to keep the table in
+       the order that the functions were declared. */
+    for (i = count - 1, var_iter = module->var_chain;
+         var_iter;
+         var_iter = var_iter->next) {
+        if ((var_iter->flags & VAR_IS_READONLY) == 0 ||
+            var_iter == symtab->main_var)
+            continue;
+
+        lily_value *v = lily_vs_nth(symtab->literals, var_iter->reg_spot);
+
+        as.entries[i].var = var_iter;
+        as.entries[i].func = v->value.function;
+        i--;
+    }
+
+    as.entry_count = count;
+
+    lily_jump_link *link = lily_jump_setup(raiser);
+    if (setjmp(link->jump) == 0) {
+        /* Calls are written using the signatures of their targets, so all of
+           them need to be checked before any function is written. */
+        for (i = 0;i < count;i++)
+            check_signature(&as, as.entries[i].var);
+
+        lily_mb_add_fmt(msgbuf,
+                "/* Contents autogenerated by lily -aot from %s. */\n"
+                "#include <stdint.h>\n"
+                "#include <stddef.h>\n\n"
+                "#include \"lily_api_dyna.h\"\n"
+                "#include \"lily_api_value.h\"\n\n"
+                "typedef union {\n"
+                "    int64_t integer;\n"
+                "    double doubleval;\n"
+                "} aot_reg;\n\n", module->path);
+
+        for (i = 0;i < count;i++) {
+            write_signature(msgbuf, &as.entries[i]);
+            lily_mb_add(msgbuf, ";\n");
+        }
+
+        lily_mb_add_char(msgbuf, '\n');
+
+        for (i = 0;i < count;i++)
+            write_function(&as, &as.entries[i]);
+
+        for (i = 0;i < count;i++)
+            write_wrapper(&as, name, &as.entries[i]);
+
+        write_dynaload(&as, name);
+
+        lily_free(as.entries);
+        lily_free(as.reg_class);
+        lily_free(as.targets);
+        lily_release_jump(raiser);
+    }
+    else {
+        lily_free(as.entries);
+        lily_free(as.reg_class);
+        lily_free(as.targets);
+        lily_jump_back(raiser);
+    }
+}
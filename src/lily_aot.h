@@ -0,0 +1,15 @@
+#ifndef LILY_AOT_H
+# define LILY_AOT_H
+
+# include "lily_api_msgbuf.h"
+# include "lily_raiser.h"
+# include "lily_symtab.h"
+
+/* This writes C source for 'module' into 'msgbuf'. The source, once compiled
+   into a shared library named after 'name', can be imported in place of the
+   module. If something in the module cannot be translated, then SyntaxError is
+   raised through the raiser given. */
+void lily_aot_write_module(lily_symtab *, lily_raiser *, lily_module_entry *,
+        const char *, lily_msgbuf *);
+
+#endif
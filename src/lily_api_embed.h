@@ -1,6 +1,8 @@
 #ifndef LILY_API_EMBED_H
 # define LILY_API_EMBED_H
 
+# include <stddef.h>
+
 # ifndef LILY_STATE
 #  define LILY_STATE
 typedef struct lily_vm_state_ lily_state;
@@ -21,11 +23,92 @@ void lily_op_gc_multiplier(lily_state *, int);
 void lily_op_render_func(lily_state *, lily_render_func);
 
 char **lily_op_get_argv(lily_state *, int *);
+const char *lily_op_get_code_cache(lily_state *);
 void *lily_op_get_data(lily_state *);
 int lily_op_get_gc_start(lily_state *);
 int lily_op_get_gc_multiplier(lily_state *);
 lily_render_func lily_op_get_render_func(lily_state *);
 
+/* This sets a directory that the first file parsed (or rendered) is cached into
+   as compiled code. An empty string puts the cache next to the file. Later
+   states given the same file and directory load the cache instead, as long as
+   none of the files that went into it have changed. A state that loaded a
+   cache knows the classes and enums inside of it, but not the vars, so more
+   code parsed afterward can only use the former. A cache is not made if the
+   file (or a module that it imports) has a type that can't be saved. Such a
+   file is parsed every time. Imported libraries are loaded again when the
+   cache is used. */
+void lily_op_code_cache(lily_state *, const char *);
+
+/* If this is set to 1, an imported module doesn't run where it's imported.
+   Instead, it runs the first time that one of its vars is used, from anywhere.
+   Functions of the module that don't use its vars can be called without the
+   module running. A function that does use one runs the module when it gets
+   there. An exception raised while the module runs can't be caught, since the
+   module's vars may not all have values. This is off by default. Imports are
+   not lazy while a code cache is being made. */
+void lily_op_lazy_imports(lily_state *, int);
+
+/* Output is given to the flush function as chunks. A chunk is only valid while
+   the flush function is running. The layout matches struct iovec. */
+# ifndef LILY_OUT_CHUNK
+#  define LILY_OUT_CHUNK
+typedef struct {
+    const char *data;
+    size_t size;
+} lily_out_chunk;
+
+typedef void (*lily_flush_func)(lily_out_chunk *, int, void *);
+# endif
+
+/* If a flush function is set, template content and what is printed to stdout
+   are collected instead of being written as they come. The flush function gets
+   them (and the data set by lily_op_data) when the size set by
+   lily_op_flush_size (64K by default) is reached, or lily_flush_output is
+   called. Anything left is flushed when the state is freed. */
+void lily_op_flush_func(lily_state *, lily_flush_func);
+void lily_op_flush_size(lily_state *, int);
+void lily_flush_output(lily_state *);
+
+/* A snapshot holds a state that has been set up (modules imported, code run,
+   and so on) so that states can be cloned from it without doing the setup
+   again. The setup function is called on a new state, and returns 1 if setup
+   succeeded or 0 if it failed. It's called at least twice, and must do the
+   same work each time. Strings given to the state during setup must outlive the
+   snapshot and clones. Returns NULL if setup fails.
+
+   Snapshots and clones can be made, used, and freed on any thread, and several
+   threads can clone the same snapshot at once. A snapshot can be freed before
+   the clones made from it (but not while it's being cloned). A state must only
+   be used by one thread at a time, and setup must not use other states. */
+typedef struct lily_snapshot_ lily_snapshot;
+typedef int (*lily_setup_func)(lily_state *, void *);
+
+lily_snapshot *lily_new_snapshot(lily_setup_func, void *);
+void lily_free_snapshot(lily_snapshot *);
+
+/* This returns a new state that starts where the snapshot's setup ended. The
+   state is independent of the snapshot and other clones, and is freed with
+   lily_free_state. Clones share the code of the functions made by setup, so
+   each clone only copies the data that setup left behind. */
+lily_state *lily_clone_state(lily_snapshot *);
+
+/* This marks the state as it is now (modules loaded, code run, and so on) as
+   the point that lily_reset_state returns it to. Resetting drops the vars,
+   classes, modules, and code made after the mark, but keeps the memory that
+   the state has grown into (registers, frames, buffers). Vars from before the
+   mark get back the values they had when it was made. The mark keeps a copy
+   of each List, Hash, and other container those vars hold, and each reset
+   hands out a fresh copy of it. Changes made inside of them after the mark
+   (such as pushing onto a List) are undone too. */
+void lily_mark_state(lily_state *);
+void lily_reset_state(lily_state *);
+
+/* This makes 'import <name>' load the source given, instead of searching for a
+   file. The source is run the first time that it's imported. It's not copied,
+   so it must outlive the state. */
+void lily_register_source(lily_state *, const char *, const char *);
+
 int lily_parse_string(lily_state *, const char *, const char *);
 int lily_parse_file(lily_state *, const char *);
 int lily_parse_expr(lily_state *, const char *, char *, const char **);
@@ -33,6 +116,30 @@ int lily_parse_expr(lily_state *, const char *, char *, const char **);
 int lily_render_string(lily_state *, const char *, const char *);
 int lily_render_file(lily_state *, const char *);
 
+/* These compile a template once, into a function that renders it. Content is
+   sent to the render function (with the data) that the state has when the
+   function is rendered, instead of while preparing (unlike other options, those
+   two can be changed at any time). Returns NULL on failure.
+   The function is valid for as long as the state is (or until a reset drops
+   it). The first takes the name and text of the template. */
+struct lily_function_val_ *lily_prepare_template(lily_state *, const char *,
+        const char *);
+struct lily_function_val_ *lily_prepare_template_file(lily_state *,
+        const char *);
+
+/* This renders a template from one of the above. Returns 1 on success, 0 on
+   failure. */
+int lily_render_prepared(lily_state *, struct lily_function_val_ *);
+
+/* This compiles a file (without running it), and translates the functions
+   inside into C source for a library that can be imported instead. Returns 1
+   and sets the last argument to the source on success, or 0 on failure.
+   Only a small part of the language can be translated: the file can only have
+   defines (no classes or toplevel code), and they can only work with Integer,
+   Double, and Boolean values and call each other. Anything else is a
+   SyntaxError. */
+int lily_aot_file(lily_state *, const char *, const char **);
+
 /* This searches in the scope of the first file loaded, and attempts to find a
    global function based on the name given. Returns either a valid, callable
    function value or NULL. */
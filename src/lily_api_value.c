@@ -78,8 +78,8 @@ void lily_##name##_set(__VA_ARGS__, lily_value * v) \
 lily_value *lily_##name##_get(__VA_ARGS__) \
 { return source->action; }
 
-DEFINE_PAIR(boxed_nth, value.container->values[i], lily_value *source, int i)
-DEFINE_PAIR(nth, values[i], lily_container_val *source, int i)
+DEFINE_PAIR(boxed_nth, value.container->values + i, lily_value *source, int i)
+DEFINE_PAIR(nth, values + i, lily_container_val *source, int i)
 
 DEFINE_SETTERS(return, call_chain->return_target, lily_vm_state *source)
 
@@ -155,7 +155,7 @@ uint16_t lily_arg_class_id(lily_state *s, int index)
 
 lily_value *lily_arg_nth_get(lily_state *s, int reg_i, int container_i)
 {
-    return s->call_chain->locals[reg_i]->value.container->values[container_i];
+    return s->call_chain->locals[reg_i]->value.container->values + container_i;
 }
 
 int lily_arg_is_some(lily_state *s, int i)
@@ -198,10 +198,13 @@ void lily_pop_value(lily_state *s)
 
 /* Raw value creation functions. */
 
+/* Containers other than List never change size, so their values go in the
+   same block as the container, right after it. */
 lily_container_val *new_container(uint16_t class_id, int num_values)
 {
-    lily_container_val *cv = lily_malloc(sizeof(lily_container_val));
-    cv->values = lily_malloc(num_values * sizeof(lily_value *));
+    lily_container_val *cv = lily_malloc(sizeof(lily_container_val) +
+            num_values * sizeof(lily_value));
+    cv->values = (lily_value *)(cv + 1);
     cv->refcount = 0;
     cv->num_values = num_values;
     cv->extra_space = 0;
@@ -209,11 +212,8 @@ lily_container_val *new_container(uint16_t class_id, int num_values)
     cv->gc_entry = NULL;
 
     int i;
-    for (i = 0;i < num_values;i++) {
-        lily_value *elem = lily_malloc(sizeof(lily_value));
-        elem->flags = 0;
-        cv->values[i] = elem;
-    }
+    for (i = 0;i < num_values;i++)
+        cv->values[i].flags = 0;
 
     return cv;
 }
@@ -255,7 +255,19 @@ lily_foreign_val *lily_new_foreign(lily_state *s, uint16_t id,
 
 lily_container_val *lily_new_list(int num_values)
 {
-    return new_container(LILY_LIST_ID, num_values);
+    lily_container_val *lv = lily_malloc(sizeof(lily_container_val));
+    lv->values = lily_malloc(num_values * sizeof(lily_value));
+    lv->refcount = 0;
+    lv->num_values = num_values;
+    lv->extra_space = 0;
+    lv->class_id = LILY_LIST_ID;
+    lv->gc_entry = NULL;
+
+    int i;
+    for (i = 0;i < num_values;i++)
+        lv->values[i].flags = 0;
+
+    return lv;
 }
 
 lily_container_val *lily_new_instance(uint16_t class_id, int initial)
@@ -263,11 +275,12 @@ lily_container_val *lily_new_instance(uint16_t class_id, int initial)
     return new_container(class_id, initial);
 }
 
-static lily_string_val *new_sv(char *buffer, int size)
+/* The text of a string is in the same block as the string, right after it. */
+static lily_string_val *new_sv(int size)
 {
-    lily_string_val *sv = lily_malloc(sizeof(lily_string_val));
+    lily_string_val *sv = lily_malloc(sizeof(lily_string_val) + size + 1);
     sv->refcount = 0;
-    sv->string = buffer;
+    sv->string = (char *)(sv + 1);
     sv->size = size;
     return sv;
 }
@@ -278,11 +291,11 @@ static lily_string_val *new_sv(char *buffer, int size)
    will */
 lily_string_val *lily_new_string_sized(const char *source, int len)
 {
-    char *buffer = lily_malloc(len + 1);
-    memcpy(buffer, source, len);
-    buffer[len] = '\0';
+    lily_string_val *sv = new_sv(len);
+    memcpy(sv->string, source, len);
+    sv->string[len] = '\0';
 
-    return new_sv(buffer, len);
+    return sv;
 }
 
 /* Create a new RAW lily_string_val. The newly-made string shall contain a copy
@@ -290,10 +303,10 @@ lily_string_val *lily_new_string_sized(const char *source, int len)
 lily_string_val *lily_new_string(const char *source)
 {
     int len = strlen(source);
-    char *buffer = lily_malloc(len + 1);
-    strcpy(buffer, source);
+    lily_string_val *sv = new_sv(len);
+    memcpy(sv->string, source, len + 1);
 
-    return new_sv(buffer, len);
+    return sv;
 }
 
 lily_container_val *lily_new_tuple(int num_values)
@@ -367,6 +380,10 @@ FILE *lily_file_for_read(lily_state *s, lily_file_val *filev)
     if (filev->read_ok == 0)
         lily_IOError(s, "File not open for reading.");
 
+    /* Make sure a prompt that was printed is seen before waiting on input. */
+    if (filev->inner_file == stdin && s->sink)
+        lily_sink_flush(s->sink);
+
     return filev->inner_file;
 }
 
@@ -432,12 +449,8 @@ static void destroy_container(lily_value *v)
     }
 
     int i;
-    for (i = 0;i < iv->num_values;i++) {
-        lily_deref(iv->values[i]);
-        lily_free(iv->values[i]);
-    }
-
-    lily_free(iv->values);
+    for (i = 0;i < iv->num_values;i++)
+        lily_deref(iv->values + i);
 
     if (full_destroy)
         lily_free(iv);
@@ -448,21 +461,19 @@ static void destroy_list(lily_value *v)
     lily_container_val *lv = v->value.container;
 
     int i;
-    for (i = 0;i < lv->num_values;i++) {
-        lily_deref(lv->values[i]);
-        lily_free(lv->values[i]);
-    }
+    for (i = 0;i < lv->num_values;i++)
+        lily_deref(lv->values + i);
+
+    /* Tuples share this, but their values are inline. */
+    if (lv->class_id == LILY_LIST_ID)
+        lily_free(lv->values);
 
-    lily_free(lv->values);
     lily_free(lv);
 }
 
 static void destroy_string(lily_value *v)
 {
-    lily_string_val *sv = v->value.string;
-
-    lily_free(sv->string);
-    lily_free(sv);
+    lily_free(v->value.string);
 }
 
 static void destroy_function(lily_value *v)
@@ -607,8 +618,8 @@ static int subvalue_eq(lily_state *s, int *depth, lily_value *left,
         ok = 1;
         int i;
         for (i = 0;i < left_list->num_values;i++) {
-            lily_value *left_item = left_list->values[i];
-            lily_value *right_item = right_list->values[i];
+            lily_value *left_item = left_list->values + i;
+            lily_value *right_item = right_list->values + i;
             (*depth)++;
             if (lily_value_compare_raw(s, depth, left_item, right_item) == 0) {
                 (*depth)--;
@@ -106,7 +106,9 @@ char *lily_bytestring_raw(lily_bytestring_val *);
 int lily_bytestring_length(lily_bytestring_val *);
 
 /* Container operations
-   Any lily_new_* function that returns lily_container_val can use these. */
+   Any lily_new_* function that returns lily_container_val can use these. The
+   values of a container are stored inline, so the value that nth_get returns
+   is only good until a List that holds it changes size. */
 uint32_t lily_container_num_values(lily_container_val *);
 lily_value *lily_boxed_nth_get(lily_value *, int);
 lily_value *lily_nth_get(lily_container_val *, int);
@@ -141,6 +143,7 @@ lily_hash_val *lily_new_hash_numtable_sized(int);
 lily_hash_val *lily_new_hash_strtable(void);
 lily_hash_val *lily_new_hash_strtable_sized(int);
 lily_hash_val *lily_new_hash_like_sized(lily_hash_val *, int);
+lily_hash_val *lily_new_hash_copy(lily_hash_val *);
 lily_value *lily_hash_find_value(lily_hash_val *, lily_value *);
 void lily_hash_insert_value(lily_hash_val *, lily_value *, lily_value *);
 void lily_hash_insert_str(lily_hash_val *, lily_string_val *, lily_value *);
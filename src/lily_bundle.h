@@ -0,0 +1,10 @@
+#ifndef LILY_BUNDLE_H
+# define LILY_BUNDLE_H
+
+# include "lily_api_embed.h"
+
+/* This is written by the build when LILY_BUNDLE or LILY_BUNDLE_PACKAGES are
+   given. It registers the modules and packages inside of the bundle. */
+void lily_register_bundle(lily_state *);
+
+#endif
@@ -0,0 +1,815 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+# include <process.h>
+# define getpid _getpid
+#else
+# include <unistd.h>
+#endif
+
+#include "lily_alloc.h"
+#include "lily_code_cache.h"
+#include "lily_config.h"
+#include "lily_int_opcode.h"
+
+/* The cache is only valid for the interpreter that wrote it: Opcodes, the
+   dynaload tables, and value layouts can all change between builds. The CMake
+   build writes LILY_CACHE_KEY (a hash of every source of the interpreter) into
+   a header, and writes it again whenever a source changes. Builds without it
+   fall back to when this file was built, which misses changes made to other
+   files. The number of opcodes is also checked, as a last line of defense. */
+#define CACHE_MAGIC "LILYC"
+#define CACHE_VERSION 4
+
+#ifdef LILY_CACHE_KEY_HEADER
+# include "lily_cache_key.h"
+#else
+# define LILY_CACHE_KEY __DATE__ " " __TIME__
+#endif
+
+lily_code_cache *lily_new_code_cache(void)
+{
+    lily_code_cache *cache = lily_malloc(sizeof(lily_code_cache));
+
+    cache->modules = NULL;
+    cache->literals = NULL;
+    cache->symbols = NULL;
+    cache->types = NULL;
+    cache->type_args = NULL;
+    cache->classes = NULL;
+    cache->members = NULL;
+    cache->segments = lily_malloc(4 * sizeof(lily_cache_segment));
+    cache->module_count = 0;
+    cache->global_count = 0;
+    cache->literal_count = 0;
+    cache->literal_start = 0;
+    cache->symbol_count = 0;
+    cache->type_count = 0;
+    cache->type_arg_count = 0;
+    cache->class_count = 0;
+    cache->member_count = 0;
+    cache->next_class_id = 0;
+    cache->pad = 0;
+    cache->segment_count = 0;
+    cache->segment_size = 4;
+    cache->buffer = NULL;
+
+    return cache;
+}
+
+void lily_free_code_cache(lily_code_cache *cache)
+{
+    uint32_t i;
+
+    if (cache->buffer) {
+        for (i = 0;i < cache->literal_count;i++) {
+            lily_cache_literal *lit = &cache->literals[i];
+            if (lit->kind == cache_native)
+                lily_free(lit->code);
+        }
+    }
+
+    for (i = 0;i < cache->segment_count;i++) {
+        lily_free(cache->segments[i].code);
+        lily_free(cache->segments[i].text);
+    }
+
+    lily_free(cache->buffer);
+    lily_free(cache->modules);
+    lily_free(cache->literals);
+    lily_free(cache->symbols);
+    lily_free(cache->types);
+    lily_free(cache->type_args);
+    lily_free(cache->classes);
+    lily_free(cache->members);
+    lily_free(cache->segments);
+    lily_free(cache);
+}
+
+static lily_cache_segment *new_segment(lily_code_cache *cache)
+{
+    if (cache->segment_count == cache->segment_size) {
+        cache->segment_size *= 2;
+        cache->segments = lily_realloc(cache->segments,
+                cache->segment_size * sizeof(lily_cache_segment));
+    }
+
+    lily_cache_segment *seg = &cache->segments[cache->segment_count];
+    cache->segment_count++;
+
+    seg->code = NULL;
+    seg->text = NULL;
+    seg->size = 0;
+    seg->reg_count = 0;
+    return seg;
+}
+
+/* This copies code that __main__ is about to run. */
+void lily_cache_add_code(lily_code_cache *cache, uint16_t *code, uint32_t size,
+        uint16_t reg_count)
+{
+    lily_cache_segment *seg = new_segment(cache);
+
+    seg->code = lily_malloc((size + 1) * sizeof(uint16_t));
+    memcpy(seg->code, code, size * sizeof(uint16_t));
+    seg->size = size;
+    seg->reg_count = reg_count;
+}
+
+/* This copies content that was rendered in template mode. */
+void lily_cache_add_text(lily_code_cache *cache, const char *text)
+{
+    lily_cache_segment *seg = new_segment(cache);
+    uint32_t size = strlen(text);
+
+    seg->text = lily_malloc(size + 1);
+    strcpy(seg->text, text);
+    seg->size = size;
+}
+
+/* Get the modification time and size of the file at 'path'. Returns 1 if the
+   file could be examined, 0 otherwise. */
+int lily_cache_stamp(const char *path, int64_t *mtime, int64_t *size)
+{
+    struct stat st;
+
+    if (stat(path, &st) != 0)
+        return 0;
+
+    *mtime = (int64_t)st.st_mtime;
+    *size = (int64_t)st.st_size;
+    return 1;
+}
+
+/* This returns (in a newly-made string) where the cache of 'path' should be.
+   If 'dir' is empty, the cache goes next to the source (foo.lily becomes
+   foo.lilyc). Otherwise, it goes in 'dir' with path separators swapped so that
+   different files with the same name don't collide. */
+char *lily_code_cache_path(const char *dir, const char *path)
+{
+    int dir_len = strlen(dir);
+    int path_len = strlen(path);
+    char *result = lily_malloc(dir_len + path_len + 3);
+
+    if (dir_len == 0) {
+        strcpy(result, path);
+        strcat(result, "c");
+        return result;
+    }
+
+    strcpy(result, dir);
+
+    char *iter = result + dir_len;
+
+    if (iter[-1] != LILY_PATH_CHAR) {
+        *iter = LILY_PATH_CHAR;
+        iter++;
+    }
+
+    strcpy(iter, path);
+
+    while (*iter) {
+        if (*iter == LILY_PATH_CHAR)
+            *iter = '%';
+
+        iter++;
+    }
+
+    strcat(result, "c");
+    return result;
+}
+
+/***
+ *      ____                _
+ *     |  _ \ ___  __ _  __| |
+ *     | |_) / _ \/ _` |/ _` |
+ *     |  _ <  __/ (_| | (_| |
+ *     |_| \_\___|\__,_|\__,_|
+ *
+ */
+
+/** Caches are written in the native byte order, since they're only valid for
+    the interpreter that wrote them anyway. The reader never trusts a count or
+    a size that would go past the end of the file. If any read fails, the
+    reader's 'ok' is set to 0 and it keeps handing out zeroes. **/
+
+typedef struct {
+    char *buffer;
+    uint32_t pos;
+    uint32_t size;
+    uint32_t ok;
+} lily_cache_reader;
+
+static void read_raw(lily_cache_reader *r, void *dest, uint32_t size)
+{
+    if (r->ok == 0 || r->size - r->pos < size) {
+        r->ok = 0;
+        memset(dest, 0, size);
+        return;
+    }
+
+    memcpy(dest, r->buffer + r->pos, size);
+    r->pos += size;
+}
+
+static uint16_t read_u16(lily_cache_reader *r)
+{
+    uint16_t result;
+    read_raw(r, &result, sizeof(result));
+    return result;
+}
+
+static uint32_t read_u32(lily_cache_reader *r)
+{
+    uint32_t result;
+    read_raw(r, &result, sizeof(result));
+    return result;
+}
+
+static int64_t read_i64(lily_cache_reader *r)
+{
+    int64_t result;
+    read_raw(r, &result, sizeof(result));
+    return result;
+}
+
+/* Strings are kept in the buffer, so this returns a pointer into it. */
+static const char *read_str(lily_cache_reader *r)
+{
+    if (r->ok == 0)
+        return "";
+
+    char *start = r->buffer + r->pos;
+    char *end = memchr(start, '\0', r->size - r->pos);
+
+    if (end == NULL) {
+        r->ok = 0;
+        return "";
+    }
+
+    r->pos += (end - start) + 1;
+    return start;
+}
+
+/* Read a count of items that are at least 'min_size' bytes each. */
+static uint32_t read_count(lily_cache_reader *r, uint32_t min_size)
+{
+    uint32_t count = read_u32(r);
+
+    if ((r->size - r->pos) / min_size < count) {
+        r->ok = 0;
+        count = 0;
+    }
+
+    return count;
+}
+
+static uint16_t *read_code(lily_cache_reader *r, uint32_t size)
+{
+    if ((r->size - r->pos) / sizeof(uint16_t) < size) {
+        r->ok = 0;
+        size = 0;
+    }
+
+    uint16_t *code = lily_malloc((size + 1) * sizeof(uint16_t));
+    read_raw(r, code, size * sizeof(uint16_t));
+    return code;
+}
+
+static void read_modules(lily_cache_reader *r, lily_code_cache *cache)
+{
+    uint32_t count = read_count(r, 5);
+    uint32_t i;
+
+    cache->modules = lily_malloc((count + 1) * sizeof(lily_cache_module));
+    cache->module_count = count;
+
+    for (i = 0;i < count;i++) {
+        lily_cache_module *m = &cache->modules[i];
+
+        m->path = read_str(r);
+        m->has_source = read_u16(r);
+        m->is_library = read_u16(r);
+        if (m->has_source || m->is_library) {
+            m->mtime = read_i64(r);
+            m->size = read_i64(r);
+        }
+    }
+}
+
+static void read_literals(lily_cache_reader *r, lily_code_cache *cache)
+{
+    cache->literal_start = read_u32(r);
+
+    uint32_t count = read_count(r, 16);
+    uint32_t i;
+
+    cache->literals = lily_malloc((count + 1) * sizeof(lily_cache_literal));
+
+    for (i = 0;i < count && r->ok;i++) {
+        lily_cache_literal *lit = &cache->literals[i];
+
+        lit->kind = read_u16(r);
+        lit->flags = read_u16(r);
+        lit->module = read_u16(r);
+        lit->reg_count = read_u16(r);
+        lit->size = read_u32(r);
+        lit->line_num = read_u32(r);
+        lit->class_name = NULL;
+        lit->name = NULL;
+
+        /* The count must cover this literal before code is made, so that
+           teardown knows to free it. */
+        cache->literal_count = i + 1;
+
+        switch (lit->kind) {
+            case cache_integer:
+                lit->integer = read_i64(r);
+                break;
+            case cache_double:
+                read_raw(r, &lit->doubleval, sizeof(double));
+                break;
+            case cache_string:
+            case cache_bytestring:
+                lit->text = r->buffer + r->pos;
+                if (r->size - r->pos < lit->size + 1 ||
+                    lit->text[lit->size] != '\0')
+                    r->ok = 0;
+                else
+                    r->pos += lit->size + 1;
+                break;
+            case cache_native:
+                lit->name = read_str(r);
+                lit->code = read_code(r, lit->size);
+                break;
+            case cache_foreign:
+                lit->class_name = read_str(r);
+                lit->name = read_str(r);
+                if (lit->class_name[0] == '\0')
+                    lit->class_name = NULL;
+                break;
+            default:
+                /* Don't let teardown think this has code to free. */
+                lit->kind = cache_integer;
+                r->ok = 0;
+                break;
+        }
+    }
+}
+
+static void read_symbols(lily_cache_reader *r, lily_code_cache *cache)
+{
+    uint32_t count = read_count(r, 7);
+    uint32_t i;
+
+    cache->symbols = lily_malloc((count + 1) * sizeof(lily_cache_symbol));
+    cache->symbol_count = count;
+
+    for (i = 0;i < count;i++) {
+        lily_cache_symbol *sym = &cache->symbols[i];
+
+        sym->name = read_str(r);
+        sym->module = read_u16(r);
+        sym->id = read_u16(r);
+        sym->flags = read_u16(r);
+    }
+}
+
+/* Types only refer to types before them. Anything else is damage. */
+static void read_types(lily_cache_reader *r, lily_code_cache *cache)
+{
+    uint32_t count = read_count(r, 12);
+    uint32_t i, j;
+
+    cache->types = lily_malloc((count + 1) * sizeof(lily_cache_type));
+    cache->type_count = count;
+
+    for (i = 0;i < count;i++) {
+        lily_cache_type *t = &cache->types[i];
+
+        t->class_id = read_u16(r);
+        t->flags = read_u16(r);
+        t->generic_pos = read_u16(r);
+        t->subtype_count = read_u16(r);
+        t->cache_flags = read_u32(r);
+        t->subtype_start = 0;
+    }
+
+    count = read_count(r, 2);
+    cache->type_args = lily_malloc((count + 1) * sizeof(uint16_t));
+    cache->type_arg_count = count;
+    read_raw(r, cache->type_args, count * sizeof(uint16_t));
+
+    for (i = 0, count = 0;i < cache->type_count && r->ok;i++) {
+        lily_cache_type *t = &cache->types[i];
+
+        t->subtype_start = count;
+        count += t->subtype_count;
+
+        if (count > cache->type_arg_count) {
+            r->ok = 0;
+            break;
+        }
+
+        for (j = t->subtype_start;j < count;j++) {
+            uint16_t index = cache->type_args[j];
+
+            if (index != CACHE_NO_TYPE && index >= i)
+                r->ok = 0;
+        }
+    }
+
+    if (count != cache->type_arg_count)
+        r->ok = 0;
+}
+
+static uint16_t read_type_index(lily_cache_reader *r, lily_code_cache *cache)
+{
+    uint16_t index = read_u16(r);
+
+    if (index != CACHE_NO_TYPE && index >= cache->type_count)
+        r->ok = 0;
+
+    return index;
+}
+
+static void read_classes(lily_cache_reader *r, lily_code_cache *cache)
+{
+    uint32_t count = read_count(r, 21);
+    uint32_t i, member_total = 0;
+
+    cache->classes = lily_malloc((count + 1) * sizeof(lily_cache_class));
+    cache->class_count = count;
+
+    for (i = 0;i < count;i++) {
+        lily_cache_class *c = &cache->classes[i];
+
+        c->name = read_str(r);
+        c->module = read_u16(r);
+        c->id = read_u16(r);
+        c->item_kind = read_u16(r);
+        c->flags = read_u16(r);
+        c->parent_id = read_u16(r);
+        c->inherit_depth = read_u16(r);
+        c->generic_count = (int16_t)read_u16(r);
+        c->prop_count = read_u16(r);
+        c->type = read_type_index(r, cache);
+        c->member_count = read_u16(r);
+        c->member_start = member_total;
+        member_total += c->member_count;
+
+        if (c->module >= cache->module_count ||
+            (i && c->id <= cache->classes[i - 1].id))
+            r->ok = 0;
+    }
+
+    count = read_count(r, 11);
+    cache->members = lily_malloc((count + 1) * sizeof(lily_cache_member));
+    cache->member_count = count;
+
+    if (count != member_total)
+        r->ok = 0;
+
+    for (i = 0;i < count;i++) {
+        lily_cache_member *m = &cache->members[i];
+
+        m->name = read_str(r);
+        m->item_kind = read_u16(r);
+        m->flags = read_u16(r);
+        m->type = read_type_index(r, cache);
+        m->spot = read_u32(r);
+    }
+
+    cache->next_class_id = read_u32(r);
+}
+
+static void read_segments(lily_cache_reader *r, lily_code_cache *cache)
+{
+    uint32_t count = read_count(r, 6);
+    uint32_t i;
+
+    for (i = 0;i < count && r->ok;i++) {
+        lily_cache_segment *seg = new_segment(cache);
+        uint16_t is_code = read_u16(r);
+
+        if (is_code) {
+            seg->reg_count = read_u16(r);
+            seg->size = read_u32(r);
+            seg->code = read_code(r, seg->size);
+        }
+        else {
+            uint32_t size = read_u32(r);
+
+            if (r->size - r->pos < size) {
+                r->ok = 0;
+                size = 0;
+            }
+
+            seg->text = lily_malloc(size + 1);
+            read_raw(r, seg->text, size);
+            seg->text[size] = '\0';
+            seg->size = size;
+        }
+    }
+}
+
+/* This checks that the sources haven't changed since the cache was made. */
+static int sources_match(lily_code_cache *cache)
+{
+    int i;
+
+    for (i = 0;i < cache->module_count;i++) {
+        lily_cache_module *m = &cache->modules[i];
+        int64_t mtime, size;
+
+        if (m->has_source == 0 && m->is_library == 0)
+            continue;
+
+        if (lily_cache_stamp(m->path, &mtime, &size) == 0 ||
+            m->mtime != mtime ||
+            m->size != size)
+            return 0;
+    }
+
+    return 1;
+}
+
+static char *read_whole_file(const char *path, uint32_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+        return NULL;
+
+    char *buffer = NULL;
+    long file_size;
+
+    if (fseek(f, 0, SEEK_END) == 0 &&
+        (file_size = ftell(f)) > 0 &&
+        fseek(f, 0, SEEK_SET) == 0) {
+        buffer = lily_malloc(file_size);
+
+        if (fread(buffer, 1, file_size, f) != (size_t)file_size) {
+            lily_free(buffer);
+            buffer = NULL;
+        }
+        else
+            *size = (uint32_t)file_size;
+    }
+
+    fclose(f);
+    return buffer;
+}
+
+/* This reads the cache at 'path'. The result is NULL if there is no cache, if
+   it was written by a different interpreter, if it's damaged, or if any of the
+   sources it was made from have changed since. */
+lily_code_cache *lily_read_code_cache(const char *path)
+{
+    lily_cache_reader r;
+
+    r.buffer = read_whole_file(path, &r.size);
+    if (r.buffer == NULL)
+        return NULL;
+
+    r.pos = 0;
+    r.ok = 1;
+
+    lily_code_cache *cache = lily_new_code_cache();
+    cache->buffer = r.buffer;
+
+    if (strcmp(read_str(&r), CACHE_MAGIC) != 0 ||
+        read_u16(&r) != CACHE_VERSION ||
+        strcmp(read_str(&r), LILY_CACHE_KEY) != 0 ||
+        read_u16(&r) != o_return_from_vm)
+        r.ok = 0;
+
+    if (r.ok)
+        read_modules(&r, cache);
+
+    if (r.ok && sources_match(cache) == 0)
+        r.ok = 0;
+
+    if (r.ok) {
+        read_literals(&r, cache);
+        read_symbols(&r, cache);
+        read_types(&r, cache);
+        read_classes(&r, cache);
+        cache->global_count = read_u16(&r);
+        read_segments(&r, cache);
+    }
+
+    if (r.ok == 0 || r.pos != r.size) {
+        lily_free_code_cache(cache);
+        cache = NULL;
+    }
+
+    return cache;
+}
+
+/***
+ *     __        __    _ _
+ *     \ \      / / __(_) |_ ___
+ *      \ \ /\ / / '__| | __/ _ \
+ *       \ V  V /| |  | | ||  __/
+ *        \_/\_/ |_|  |_|\__\___|
+ *
+ */
+
+static void write_raw(FILE *f, const void *source, uint32_t size)
+{
+    fwrite(source, 1, size, f);
+}
+
+static void write_u16(FILE *f, uint16_t value)
+{
+    write_raw(f, &value, sizeof(value));
+}
+
+static void write_u32(FILE *f, uint32_t value)
+{
+    write_raw(f, &value, sizeof(value));
+}
+
+static void write_i64(FILE *f, int64_t value)
+{
+    write_raw(f, &value, sizeof(value));
+}
+
+static void write_str(FILE *f, const char *str)
+{
+    if (str == NULL)
+        str = "";
+
+    write_raw(f, str, strlen(str) + 1);
+}
+
+static void write_literal(FILE *f, lily_cache_literal *lit)
+{
+    write_u16(f, lit->kind);
+    write_u16(f, lit->flags);
+    write_u16(f, lit->module);
+    write_u16(f, lit->reg_count);
+    write_u32(f, lit->size);
+    write_u32(f, lit->line_num);
+
+    switch (lit->kind) {
+        case cache_integer:
+            write_i64(f, lit->integer);
+            break;
+        case cache_double:
+            write_raw(f, &lit->doubleval, sizeof(double));
+            break;
+        case cache_string:
+        case cache_bytestring:
+            write_raw(f, lit->text, lit->size);
+            write_raw(f, "", 1);
+            break;
+        case cache_native:
+            write_str(f, lit->name);
+            write_raw(f, lit->code, lit->size * sizeof(uint16_t));
+            break;
+        case cache_foreign:
+            write_str(f, lit->class_name);
+            write_str(f, lit->name);
+            break;
+    }
+}
+
+/* This writes 'cache' to 'path'. The cache is written to a temporary file that
+   is then moved over, so that a reader never sees half of a cache. Several
+   processes (or states) may be writing a cache for the same file at once, so
+   the temporary file is named after the process and the cache being written,
+   and is only opened if it doesn't already exist. Returns 1 on success, 0 on
+   failure. */
+int lily_write_code_cache(lily_code_cache *cache, const char *path)
+{
+    int path_len = strlen(path);
+    /* Room for the path, two numbers, and the separators. */
+    char *temp_path = lily_malloc(path_len + 64);
+    uint32_t i;
+
+    sprintf(temp_path, "%s.%ld.%lx.tmp", path, (long)getpid(),
+            (unsigned long)(uintptr_t)cache);
+
+    FILE *f = fopen(temp_path, "wbx");
+    if (f == NULL) {
+        lily_free(temp_path);
+        return 0;
+    }
+
+    write_str(f, CACHE_MAGIC);
+    write_u16(f, CACHE_VERSION);
+    write_str(f, LILY_CACHE_KEY);
+    write_u16(f, o_return_from_vm);
+
+    write_u32(f, cache->module_count);
+    for (i = 0;i < cache->module_count;i++) {
+        lily_cache_module *m = &cache->modules[i];
+
+        write_str(f, m->path);
+        write_u16(f, m->has_source);
+        write_u16(f, m->is_library);
+        if (m->has_source || m->is_library) {
+            write_i64(f, m->mtime);
+            write_i64(f, m->size);
+        }
+    }
+
+    write_u32(f, cache->literal_start);
+    write_u32(f, cache->literal_count);
+    for (i = 0;i < cache->literal_count;i++)
+        write_literal(f, &cache->literals[i]);
+
+    write_u32(f, cache->symbol_count);
+    for (i = 0;i < cache->symbol_count;i++) {
+        lily_cache_symbol *sym = &cache->symbols[i];
+
+        write_str(f, sym->name);
+        write_u16(f, sym->module);
+        write_u16(f, sym->id);
+        write_u16(f, sym->flags);
+    }
+
+    write_u32(f, cache->type_count);
+    for (i = 0;i < cache->type_count;i++) {
+        lily_cache_type *t = &cache->types[i];
+
+        write_u16(f, t->class_id);
+        write_u16(f, t->flags);
+        write_u16(f, t->generic_pos);
+        write_u16(f, t->subtype_count);
+        write_u32(f, t->cache_flags);
+    }
+
+    write_u32(f, cache->type_arg_count);
+    write_raw(f, cache->type_args, cache->type_arg_count * sizeof(uint16_t));
+
+    write_u32(f, cache->class_count);
+    for (i = 0;i < cache->class_count;i++) {
+        lily_cache_class *c = &cache->classes[i];
+
+        write_str(f, c->name);
+        write_u16(f, c->module);
+        write_u16(f, c->id);
+        write_u16(f, c->item_kind);
+        write_u16(f, c->flags);
+        write_u16(f, c->parent_id);
+        write_u16(f, c->inherit_depth);
+        write_u16(f, (uint16_t)c->generic_count);
+        write_u16(f, c->prop_count);
+        write_u16(f, c->type);
+        write_u16(f, c->member_count);
+    }
+
+    write_u32(f, cache->member_count);
+    for (i = 0;i < cache->member_count;i++) {
+        lily_cache_member *m = &cache->members[i];
+
+        write_str(f, m->name);
+        write_u16(f, m->item_kind);
+        write_u16(f, m->flags);
+        write_u16(f, m->type);
+        write_u32(f, m->spot);
+    }
+
+    write_u32(f, cache->next_class_id);
+    write_u16(f, cache->global_count);
+
+    write_u32(f, cache->segment_count);
+    for (i = 0;i < cache->segment_count;i++) {
+        lily_cache_segment *seg = &cache->segments[i];
+
+        if (seg->code) {
+            write_u16(f, 1);
+            write_u16(f, seg->reg_count);
+            write_u32(f, seg->size);
+            write_raw(f, seg->code, seg->size * sizeof(uint16_t));
+        }
+        else {
+            write_u16(f, 0);
+            write_u32(f, seg->size);
+            write_raw(f, seg->text, seg->size);
+        }
+    }
+
+    int ok = (ferror(f) == 0);
+
+    if (fclose(f) != 0)
+        ok = 0;
+
+    if (ok) {
+#ifdef _WIN32
+        /* Windows won't rename over a file that exists. */
+        remove(path);
+#endif
+        ok = (rename(temp_path, path) == 0);
+    }
+
+    if (ok == 0)
+        remove(temp_path);
+
+    lily_free(temp_path);
+    return ok;
+}
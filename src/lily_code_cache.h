@@ -0,0 +1,189 @@
+#ifndef LILY_CODE_CACHE_H
+# define LILY_CODE_CACHE_H
+
+# include <inttypes.h>
+
+/* A code cache holds what parser leaves behind after a file has been fully
+   processed: The readonly table, the code of __main__ for each pass, and what
+   was dynaloaded. Parser can replay a cache instead of lexing, parsing, and
+   emitting the same file again. Since the vm only runs code against tables,
+   nothing here holds the names of vars that aren't loaded. Classes and enums
+   declared in Lily code are kept (with the types of their members), since they
+   have to be built again for their ids to mean anything. */
+
+typedef enum {
+    cache_integer,
+    cache_double,
+    cache_string,
+    cache_bytestring,
+    cache_native,
+    cache_foreign
+} lily_cache_kind;
+
+/* This native function can be found by name (a toplevel define). */
+# define CACHE_IS_VISIBLE 0x1
+
+/* This symbol is a var. If not set, it's a class. */
+# define CACHE_IS_VAR     0x2
+
+/* This native function is a method of a class declared in Lily code. */
+# define CACHE_IS_METHOD  0x4
+
+/* This type is a class acting as a type. */
+# define CACHE_TYPE_IS_CLASS 0x1
+
+/* Type indexes use this for NULL. */
+# define CACHE_NO_TYPE UINT16_MAX
+
+typedef struct {
+    /* For modules with source or from a library, this is that file. For
+       registered modules, this is the name they were registered with. */
+    const char *path;
+    /* Files are checked against these to see if they've changed. */
+    int64_t mtime;
+    int64_t size;
+    uint16_t has_source;
+    /* This module was loaded from a library, which is loaded again when the
+       cache is run. */
+    uint16_t is_library;
+    uint32_t pad;
+} lily_cache_module;
+
+typedef struct {
+    uint16_t kind;
+    uint16_t flags;
+    /* Functions: Index of the module they were made in, in load order. */
+    uint16_t module;
+    /* Native functions: How many registers they need. */
+    uint16_t reg_count;
+    /* Native functions: Code size. Strings and ByteStrings: Byte length. */
+    uint32_t size;
+    uint32_t line_num;
+    union {
+        int64_t integer;
+        double doubleval;
+        const char *text;
+        uint16_t *code;
+    };
+    /* Foreign methods only: The class the method is inside of. */
+    const char *class_name;
+    /* Functions only. */
+    const char *name;
+} lily_cache_literal;
+
+/* A class or var that was dynaloaded from a library module. The id is either
+   the class id, or the global register of the var. */
+typedef struct {
+    const char *name;
+    uint16_t module;
+    uint16_t id;
+    uint16_t flags;
+    uint16_t pad;
+} lily_cache_symbol;
+
+/* Types are written subtypes first, so that each one only refers to types that
+   come before it. The subtypes of a type are 'subtype_count' indexes, starting
+   at 'subtype_start' of the cache's type_args. */
+typedef struct {
+    uint16_t class_id;
+    uint16_t flags;
+    uint16_t generic_pos;
+    uint16_t subtype_count;
+    uint32_t subtype_start;
+    /* CACHE_TYPE_IS_CLASS, or 0. */
+    uint32_t cache_flags;
+} lily_cache_type;
+
+/* A class, enum, or variant that was declared in Lily code. These are sorted by
+   id, and made again in that order. */
+typedef struct {
+    const char *name;
+    uint16_t module;
+    uint16_t id;
+    uint16_t item_kind;
+    uint16_t flags;
+    /* Classes: The class inherited from, or 0. Variants: Their enum. */
+    uint16_t parent_id;
+    uint16_t inherit_depth;
+    int16_t generic_count;
+    /* Classes: How many properties instances have. Enums: The variant count. */
+    uint16_t prop_count;
+    /* Classes and enums: The type of self. Variants: The type that builds them,
+       or CACHE_NO_TYPE if they're empty. */
+    uint16_t type;
+    uint16_t member_count;
+    /* Where the members of this class start in the cache's members. */
+    uint32_t member_start;
+} lily_cache_class;
+
+/* A property or method of a class, in the order the class has them. Methods
+   use 'spot' for their spot in the readonly table, properties for their id. */
+typedef struct {
+    const char *name;
+    uint16_t item_kind;
+    uint16_t flags;
+    uint16_t type;
+    uint16_t pad;
+    uint32_t spot;
+} lily_cache_member;
+
+/* Template mode alternates between content and code. For content, code is NULL
+   and text holds what was rendered. */
+typedef struct {
+    uint16_t *code;
+    char *text;
+    uint32_t size;
+    uint16_t reg_count;
+    uint16_t pad;
+} lily_cache_segment;
+
+typedef struct lily_code_cache_ {
+    lily_cache_module *modules;
+    lily_cache_literal *literals;
+    lily_cache_symbol *symbols;
+    lily_cache_type *types;
+    uint16_t *type_args;
+    lily_cache_class *classes;
+    lily_cache_member *members;
+    lily_cache_segment *segments;
+
+    uint16_t module_count;
+    uint16_t global_count;
+    uint32_t literal_count;
+
+    /* Literals before this one exist before any parsing is done. */
+    uint32_t literal_start;
+    uint32_t symbol_count;
+
+    uint32_t type_count;
+    uint32_t type_arg_count;
+
+    uint32_t class_count;
+    uint32_t member_count;
+
+    /* The id the next new class would have had. */
+    uint32_t next_class_id;
+    uint32_t pad;
+
+    uint32_t segment_count;
+    uint32_t segment_size;
+
+    /* If the cache was read in, this holds the file. Strings point into it,
+       and the code of native functions is owned by the cache. Otherwise, only
+       the segments are owned by the cache. */
+    char *buffer;
+} lily_code_cache;
+
+lily_code_cache *lily_new_code_cache(void);
+void lily_free_code_cache(lily_code_cache *);
+
+void lily_cache_add_code(lily_code_cache *, uint16_t *, uint32_t, uint16_t);
+void lily_cache_add_text(lily_code_cache *, const char *);
+
+int lily_cache_stamp(const char *, int64_t *, int64_t *);
+char *lily_code_cache_path(const char *, const char *);
+
+lily_code_cache *lily_read_code_cache(const char *);
+int lily_write_code_cache(lily_code_cache *, const char *);
+
+#endif
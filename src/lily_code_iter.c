@@ -250,6 +250,12 @@ int lily_ci_next(lily_code_iter *iter)
             iter->line = 1;
             iter->inputs_3 = 1;
 
+            iter->round_total = 3;
+            break;
+        case o_render_content:
+            iter->line = 1;
+            iter->special_1 = 1;
+
             iter->round_total = 3;
             break;
         case o_new_instance_basic:
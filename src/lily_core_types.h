@@ -8,6 +8,7 @@
 struct lily_var_;
 struct lily_type_;
 struct lily_vm_state_;
+struct lily_symbol_index_;
 
 /* A module that has a dynaload table should also come with a loader. The loader
    is responsible for fetching functions and initializing variables. */
@@ -82,6 +83,14 @@ typedef struct lily_class_ {
        that were created within this class.
        To make it clear: Only -real- types go here. */
     struct lily_type_ *all_subtypes;
+
+    /* Once a class has enough types, this is a hash table over them so that
+       type maker doesn't have to walk all of them. NULL until then. */
+    struct lily_type_table_ *type_table;
+
+    /* An index over members, for classes that have a lot of them. This is
+       NULL until it's needed. */
+    struct lily_symbol_index_ *member_index;
 } lily_class;
 
 typedef struct lily_type_ {
@@ -104,6 +113,12 @@ typedef struct lily_type_ {
        If this type is actually a class, then subtype_count will be set to 0,
        and that should be checked before using this. */
     struct lily_type_ **subtypes;
+
+    /* A hash of the class, flags, and subtypes of this type. This is made from
+       the content of the subtypes (not their addresses), so it's the same for
+       the same type every time. Only set for types with subtypes. */
+    uint32_t hash;
+    uint32_t pad;
 } lily_type;
 
 
@@ -260,6 +275,13 @@ typedef struct lily_module_entry_ {
     /* The vars declared within this module. */
     lily_var *var_chain;
 
+    /* Hash indexes over the chains above, and over the toplevel entries of the
+       dynaload table. Each is made when it's first needed. */
+    struct lily_symbol_index_ *link_index;
+    struct lily_symbol_index_ *class_index;
+    struct lily_symbol_index_ *var_index;
+    struct lily_symbol_index_ *dynaload_index;
+
     /* For modules backed by a shared library, the handle of that library. */
     void *handle;
 
@@ -269,6 +291,10 @@ typedef struct lily_module_entry_ {
 
     lily_loader loader;
 
+    /* For modules registered with their source, this is that source. The
+       module is run from it when it's first imported. */
+    const char *source;
+
     uint16_t *cid_table;
 } lily_module_entry;
 
@@ -380,12 +406,30 @@ typedef struct lily_module_entry_ {
    function. */
 #define VAR_IS_FOREIGN_FUNC     0x400
 
+/* This var has been closed over, and an inner function assigns to it. If this
+   is not set, then a closed over var is only ever written by the function that
+   declared it. That function's register is always fresh, so the emitter does
+   not need to reload the var from the closure before each read. */
+#define VAR_UPVALUE_ASSIGNED    0x800
+
+/* This storage holds a value that must outlive the expression that created it
+   (ex: 'self' in a constructor, or the value being matched against). It will
+   not be handed out to another expression until it is unlocked. */
+#define STORAGE_IS_LOCKED       0x1000
+
 /* This module was added by being registered. */
 #define MODULE_IS_REGISTERED 0x1
 
 /* Parser's import handler needs to execute this module's code. */
 #define MODULE_NOT_EXECUTED  0x2
 
+/* Every class in the cid table of this module has been found, so the table
+   does not need to be updated again. */
+#define MODULE_CID_TABLE_FULL 0x4
+
+/* The dynaload table of this module has type descriptors. */
+#define MODULE_HAS_DESCRIPTORS 0x8
+
 #define LILY_INTEGER_ID     1
 #define LILY_DOUBLE_ID      2
 #define LILY_STRING_ID      3
@@ -265,6 +265,31 @@ lily_var *lily_emit_new_define_var(lily_emit_state *emit, lily_type *type,
     return new_var;
 }
 
+/* This creates a var for a define that was loaded from a code cache instead of
+   being parsed. The function is given a copy of the code provided. The var is
+   not linked anywhere, and the function belongs to the active module. */
+lily_var *lily_emit_new_cached_define_var(lily_emit_state *emit,
+        lily_type *type, const char *name, uint16_t *code, uint32_t code_len,
+        uint16_t reg_count, uint32_t line_num)
+{
+    lily_var *new_var = lily_new_raw_unlinked_var(emit->symtab, type, name);
+
+    new_var->line_num = line_num;
+    new_var->reg_spot = lily_vs_pos(emit->symtab->literals);
+    new_var->function_depth = 1;
+    new_var->flags |= VAR_IS_READONLY;
+
+    lily_function_val *f = new_native_function_val(NULL, new_var->name);
+
+    f->code = lily_malloc_readonly(code_len * sizeof(uint16_t));
+    memcpy(f->code, code, code_len * sizeof(uint16_t));
+    f->code_len = code_len;
+    f->reg_count = reg_count;
+    lily_store_function(emit->symtab, new_var, f);
+
+    return new_var;
+}
+
 /* This is used to create a var that goes into a particular scope, and which has
    a foreign function associated with it. */
 lily_var *lily_emit_new_tied_dyna_var(lily_emit_state *emit,
@@ -340,12 +365,21 @@ static lily_block *find_deepest_loop(lily_emit_state *);
 static void inject_patch_into_block(lily_emit_state *, lily_block *, uint16_t);
 
 /* This is called from parser to get emitter to write a function call targeting
-   a var. The var should always be an __import__ function. */
-void lily_emit_write_import_call(lily_emit_state *emit, lily_var *var)
+   a var. The var should always be an __import__ function, given here by the
+   readonly spot of it. */
+void lily_emit_write_import_call(lily_emit_state *emit, uint16_t import_spot)
 {
     uint16_t spot = lily_emit_get_storage_spot(emit, lily_unit_type);
     lily_u16_write_5(emit->code, o_native_call, *emit->lex_linenum,
-            var->reg_spot, 0, spot);
+            import_spot, 0, spot);
+}
+
+/* This is called from parser while preparing a template. The content of the
+   template has been interned as a ByteString at 'literal_spot'. */
+void lily_emit_write_render(lily_emit_state *emit, uint16_t literal_spot)
+{
+    lily_u16_write_3(emit->code, o_render_content, *emit->lex_linenum,
+            literal_spot);
 }
 
 /* This takes the stack of optional arguments and writes out the jumping
@@ -643,14 +677,35 @@ static void grow_storages(lily_storage_stack *stack)
     stack->size = new_size;
 }
 
-/* This attempts to grab a storage of the given type. It will first attempt to
-   get a used storage, then a new one. */
+/* Storages fall into one of two pools. The vm writes Integer, Double, Boolean,
+   and Byte values into a register without checking what was there before. Any
+   other kind of value is written through a deref. A storage can take on a new
+   type if that type is in the same pool, since neither kind of write will then
+   leak a value. */
+static int storage_pool_for(lily_type *type)
+{
+    int id = type->cls->id;
+
+    return (id == LILY_INTEGER_ID ||
+            id == LILY_DOUBLE_ID ||
+            id == LILY_BOOLEAN_ID ||
+            id == LILY_BYTE_ID);
+}
+
+/* This attempts to grab a storage of the given type. Storages only live as long
+   as the expression that claimed them, so any storage not used by the current
+   expression is free to be taken again. A storage with the same type is
+   preferred. If there isn't one, then an idle storage from the same pool is
+   given the new type. Only when both fail is a new register claimed.
+   This only shares registers between storages. Vars always keep their own
+   register, even after their last use. */
 static lily_storage *get_storage(lily_emit_state *emit, lily_type *type)
 {
     lily_storage_stack *stack = emit->storages;
     int expr_num = emit->expr_num;
+    int pool = storage_pool_for(type);
     int i;
-    lily_storage *s = NULL;
+    lily_storage *s = NULL, *idle = NULL;
 
     for (i = emit->function_block->storage_start;
          i < stack->size;
@@ -659,6 +714,12 @@ static lily_storage *get_storage(lily_emit_state *emit, lily_type *type)
 
         /* A storage with a type of NULL is not in use and can be claimed. */
         if (s->type == NULL) {
+            if (idle) {
+                s = idle;
+                s->type = type;
+                break;
+            }
+
             s->type = type;
 
             s->reg_spot = emit->function_block->next_reg_spot;
@@ -674,10 +735,13 @@ static lily_storage *get_storage(lily_emit_state *emit, lily_type *type)
 
             break;
         }
-        else if (s->type == type &&
-                 s->expr_num != expr_num) {
-            s->expr_num = expr_num;
-            break;
+        else if (s->expr_num != expr_num &&
+                 (s->flags & STORAGE_IS_LOCKED) == 0) {
+            if (s->type == type)
+                break;
+            else if (idle == NULL &&
+                     storage_pool_for(s->type) == pool)
+                idle = s;
         }
     }
 
@@ -853,6 +917,7 @@ static void finalize_function_block(lily_emit_state *emit,
     int i;
     for (i = function_block->storage_start;i < emit->storages->scope_end;i++) {
         emit->storages->data[i]->type = NULL;
+        emit->storages->data[i]->flags &= ~STORAGE_IS_LOCKED;
     }
 
     emit->storages->scope_end = function_block->storage_start;
@@ -906,11 +971,11 @@ static void leave_function(lily_emit_state *emit, lily_block *block)
     if (emit->block->block_type == block_class) {
         lily_class *cls = emit->block->class_entry;
 
-        emit->symtab->active_module->var_chain = block->function_var;
+        lily_rewind_var_chain(emit->symtab, block->function_var);
         lily_add_class_method(emit->symtab, cls, block->function_var);
     }
     else if (emit->block->block_type != block_file)
-        emit->symtab->active_module->var_chain = block->function_var;
+        lily_rewind_var_chain(emit->symtab, block->function_var);
     /* For file 'blocks', don't fix the var_chain or all of the toplevel
        functions in that block will vanish! */
 
@@ -955,8 +1020,11 @@ void lily_emit_leave_block(lily_emit_state *emit)
         int x = block->loop_start - lily_u16_pos(emit->code);
         lily_u16_write_2(emit->code, o_jump, (uint16_t)x);
     }
-    else if (block_type == block_match)
+    else if (block_type == block_match) {
         emit->match_case_pos = emit->block->match_case_start;
+        if (block->match_storage)
+            block->match_storage->flags &= ~STORAGE_IS_LOCKED;
+    }
     else if (block_type == block_try ||
              block_type == block_try_except ||
              block_type == block_try_except_all) {
@@ -1213,8 +1281,10 @@ static int find_closed_self_spot(lily_emit_state *emit)
     if (find_closed_sym_spot(emit, self) == -1)
         close_over_sym(emit, self);
 
-    if (emit->block->self == NULL)
+    if (emit->block->self == NULL) {
         emit->block->self = get_storage(emit, self->type);
+        emit->block->self->flags |= STORAGE_IS_LOCKED;
+    }
 
     emit->function_block->make_closure = 1;
 }
@@ -1247,18 +1317,28 @@ static void ensure_params_in_closure(lily_emit_state *emit)
     }
 }
 
+/* Entries of the transform table hold the spot of a var in the closure in the
+   lower 16 bits. The flags are kept above that, so that they can't be confused
+   with a spot. Vars that aren't in the closure have an entry of 0. */
+#define TRANSFORM_IN_CLOSURE 0x10000
+/* An inner function assigns to this var, so it's reloaded from the closure
+   before each read. Other closed over vars are only mirrored into the closure
+   when they're written. */
+#define TRANSFORM_RELOAD     0x20000
+#define TRANSFORM_SPOT(x)    ((uint16_t)((x) & 0xFFFF))
+
 /* This sets up the table used to map from a register spot to where that spot is
    in the closure. */
 static void setup_transform_table(lily_emit_state *emit)
 {
     if (emit->transform_size < emit->function_block->next_reg_spot) {
         emit->transform_table = lily_realloc(emit->transform_table,
-                emit->function_block->next_reg_spot * sizeof(uint16_t));
+                emit->function_block->next_reg_spot * sizeof(uint32_t));
         emit->transform_size = emit->function_block->next_reg_spot;
     }
 
-    memset(emit->transform_table, (uint16_t)-1,
-           sizeof(uint16_t) * emit->function_block->next_reg_spot);
+    memset(emit->transform_table, 0,
+           sizeof(uint32_t) * emit->function_block->next_reg_spot);
 
     int i;
     for (i = 0;i < emit->closed_pos;i++) {
@@ -1266,7 +1346,11 @@ static void setup_transform_table(lily_emit_state *emit)
         if (s && s->item_kind == ITEM_TYPE_VAR) {
             lily_var *v = (lily_var *)s;
             if (v->function_depth == emit->function_depth) {
-                emit->transform_table[v->reg_spot] = i;
+                uint32_t id = i | TRANSFORM_IN_CLOSURE;
+                if (v->flags & VAR_UPVALUE_ASSIGNED)
+                    id |= TRANSFORM_RELOAD;
+
+                emit->transform_table[v->reg_spot] = id;
                 /* Each var can only be transformed once, and within the scope
                    it was declared. This prevents two nested functions from
                    trying to transform the same (now-dead) vars. */
@@ -1342,13 +1426,17 @@ static int count_transforms(lily_emit_state *emit, int start)
     lily_ci_init(&ci, emit->code->data, start, lily_u16_pos(emit->code));
     lily_ci_next(&ci);
     uint16_t *buffer = ci.buffer;
-    uint16_t *transform_table = emit->transform_table;
+    uint32_t *transform_table = emit->transform_table;
     lily_opcode op = buffer[ci.offset];
     int pos = ci.offset + 1 + ci.line;
     int count = 0;
 
+/* Vars that are never assigned by an inner function are not reloaded, so there
+   is no o_get_upvalue to account for. */
+#define IS_RELOADED(x) (transform_table[x] & TRANSFORM_RELOAD)
+
     if ((op == o_function_call || op == o_match_dispatch) &&
-        transform_table[buffer[pos]] != (uint16_t)-1)
+        IS_RELOADED(buffer[pos]))
         count++;
 
     pos += ci.special_1 + ci.counter_2;
@@ -1356,7 +1444,7 @@ static int count_transforms(lily_emit_state *emit, int start)
     if (ci.inputs_3) {
         int i;
         for (i = 0;i < ci.inputs_3;i++) {
-            if (transform_table[buffer[pos + i]] != (uint16_t)-1)
+            if (IS_RELOADED(buffer[pos + i]))
                 count++;
         }
     }
@@ -1368,11 +1456,12 @@ static int count_transforms(lily_emit_state *emit, int start)
         op == o_function_call) {
         int i;
         for (i = 0;i < ci.special_6;i++) {
-            if (transform_table[buffer[pos + i]] != (uint16_t)-1)
+            if (IS_RELOADED(buffer[pos + i]))
                 count++;
         }
     }
 
+#undef IS_RELOADED
     return count;
 }
 
@@ -1495,7 +1584,7 @@ static void perform_closure_transform(lily_emit_state *emit,
 
     lily_code_iter ci;
     lily_ci_init(&ci, emit->code->data, iter_start, lily_u16_pos(emit->code));
-    uint16_t *transform_table = emit->transform_table;
+    uint32_t *transform_table = emit->transform_table;
     int jump_adjust = 0;
 
 /* If the input at the position given by 'x' is within the closure, then write
@@ -1504,14 +1593,25 @@ static void perform_closure_transform(lily_emit_state *emit,
    any assignment to it as an upvalue will be reflected. */
 #define MAYBE_TRANSFORM_INPUT(x, z) \
 { \
-    uint16_t id = transform_table[buffer[x]]; \
-    if (id != (uint16_t)-1) { \
-        lily_u16_write_4(emit->closure_aux_code, z, f->line_num, id, \
-                buffer[x]); \
+    uint32_t id = transform_table[buffer[x]]; \
+    if (id & TRANSFORM_RELOAD) { \
+        lily_u16_write_4(emit->closure_aux_code, z, f->line_num, \
+                TRANSFORM_SPOT(id), buffer[x]); \
         jump_adjust += 4; \
     } \
 }
 
+/* Outputs are always mirrored into the closure, even for vars that do not need
+   to be reloaded. Inner functions read from the closure, not the register. */
+#define MAYBE_TRANSFORM_OUTPUT(x, z) \
+{ \
+    uint32_t id = transform_table[buffer[x]]; \
+    if (id & TRANSFORM_IN_CLOSURE) { \
+        lily_u16_write_4(emit->closure_aux_code, z, f->line_num, \
+                TRANSFORM_SPOT(id), buffer[x]); \
+    } \
+}
+
     uint16_t *buffer = ci.buffer;
     uint16_t patch_start = lily_u16_pos(emit->patches);
     int i, pos;
@@ -1662,7 +1762,7 @@ static void perform_closure_transform(lily_emit_state *emit,
             int stop = output_start + ci.outputs_5;
 
             for (i = output_start;i < stop;i++) {
-                MAYBE_TRANSFORM_INPUT(i, o_set_upvalue)
+                MAYBE_TRANSFORM_OUTPUT(i, o_set_upvalue)
             }
         }
     }
@@ -1729,7 +1829,7 @@ static lily_function_val *create_code_block_for(lily_emit_state *emit,
         source = emit->closure_aux_code->data;
     }
 
-    code = lily_malloc((code_size + 1) * sizeof(uint16_t));
+    code = lily_malloc_readonly((code_size + 1) * sizeof(uint16_t));
     memcpy(code, source + code_start, sizeof(uint16_t) * code_size);
 
     f->code_len = code_size;
@@ -1896,6 +1996,15 @@ void lily_emit_eval_match_expr(lily_emit_state *emit, lily_expr_state *es)
 
     block->match_case_start = emit->match_case_pos;
 
+    /* Cases check against the type of the match storage, so make sure that it
+       is not reused (or retyped) before the match is done. */
+    if (ast->result->item_kind == ITEM_TYPE_STORAGE) {
+        block->match_storage = (lily_storage *)ast->result;
+        block->match_storage->flags |= STORAGE_IS_LOCKED;
+    }
+    else
+        block->match_storage = NULL;
+
     /* This is how the emitter knows that no cases have been given yet. */
     int i;
     for (i = 0;i < match_cases_needed;i++)
@@ -2765,8 +2874,9 @@ static void eval_assign(lily_emit_state *emit, lily_ast *ast)
     if (can_optimize && assign_optimize_check(ast)) {
         int pos;
         /* Most trees dump their result at the end, so that patching is easy.
-           Those that don't will write down where it should go. */
-        if (ast->right->maybe_result_pos == 0)
+           Those that don't will write down where it should go. A compound op
+           is written after the right side, so it's the one to patch. */
+        if (ast->right->maybe_result_pos == 0 || ast->op > expr_assign)
             pos = lily_u16_pos(emit->code) - 1;
         else
             pos = ast->right->maybe_result_pos;
@@ -2962,6 +3072,7 @@ static void eval_upvalue_assign(lily_emit_state *emit, lily_ast *ast)
     lily_u16_write_4(emit->code, o_set_upvalue, ast->line_num, spot,
             rhs->reg_spot);
 
+    left_sym->flags |= VAR_UPVALUE_ASSIGNED;
     ast->result = ast->right->result;
 }
 
@@ -4409,6 +4520,7 @@ void lily_emit_setup_call(lily_emit_state *emit, lily_type *self_type,
            Create the storage that will represent 'self' and write the
            instruction to actually make the class. */
         lily_storage *self = get_storage(emit, self_type);
+        self->flags |= STORAGE_IS_LOCKED;
         emit->block->self = self;
 
         /* If this ends up not being a basic instance, then it will be patched
@@ -76,6 +76,10 @@ typedef struct lily_block_ {
        use this to write dispatching information. */
     uint32_t match_code_start;
 
+    /* Match blocks: If the value being matched is in a storage, this is that
+       storage. It is locked until the match block is done. */
+    lily_storage *match_storage;
+
     /* Define/class blocks: Where the symtab's register allocation was before
        entry. */
     uint32_t next_reg_spot;
@@ -171,7 +175,7 @@ typedef struct {
 
     lily_sym **closed_syms;
 
-    uint16_t *transform_table;
+    uint32_t *transform_table;
 
     uint64_t transform_size;
 
@@ -251,7 +255,8 @@ lily_sym *lily_emit_eval_interp_expr(lily_emit_state *, lily_expr_state *);
 void lily_emit_finalize_for_in(lily_emit_state *, lily_var *, lily_var *,
         lily_var *, lily_sym *, int);
 void lily_emit_eval_lambda_body(lily_emit_state *, lily_expr_state *, lily_type *);
-void lily_emit_write_import_call(lily_emit_state *, lily_var *);
+void lily_emit_write_import_call(lily_emit_state *, uint16_t);
+void lily_emit_write_render(lily_emit_state *, uint16_t);
 
 void lily_emit_eval_match_expr(lily_emit_state *, lily_expr_state *);
 int lily_emit_add_match_case(lily_emit_state *, int);
@@ -291,6 +296,8 @@ lily_var *lily_emit_new_define_var(lily_emit_state *, lily_type *, lily_class *,
         const char *, char *);
 lily_var *lily_emit_new_tied_dyna_var(lily_emit_state *, lily_foreign_func,
         lily_item *, lily_type *, const char *);
+lily_var *lily_emit_new_cached_define_var(lily_emit_state *, lily_type *,
+        const char *, uint16_t *, uint32_t, uint16_t, uint32_t);
 lily_var *lily_emit_new_dyna_var(lily_emit_state *, lily_module_entry *,
         lily_type *, const char *);
 
@@ -179,6 +179,11 @@ typedef enum {
        statement where there are no breaks. */
     o_optarg_dispatch,
 
+    /* Send an interned ByteString (given as an index into the vm's readonly
+       table) to the render function. Prepared templates write their content
+       through this instead of having lexer send it. */
+    o_render_content,
+
     /* Exit the vm. This is written at the end of __main__ to make it leave the
        vm exec function. It is also spoofed when entering foreign functions, so
        that they leave the vm exec function properly. */
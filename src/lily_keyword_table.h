@@ -1,6 +1,9 @@
 #ifndef LILY_KEYWORD_TABLE_H
 # define LILY_KEYWORD_TABLE_H
 
+/* This file is made by keyword_table.py. Change the lists there, and run it
+   again instead of editing this by hand. */
+
 typedef struct {
     const char *name;
     uint64_t shorthash;
@@ -23,6 +26,18 @@ keyword_entry constants[] = {
 #define CONST__FUNCTION__ 5
 #define CONST_LAST_ID     5
 
+/* Keywords and constants are found through a perfect hash of the shorthash of
+   a name. Multiplying by the given number and keeping the top bits gives each
+   name a slot of its own, which holds the id of the name (or -1). A name that
+   lands on a slot still needs to be checked, because any word can be hashed. */
+
+#define CONST_HASH_MULT   14727398570297873639ULL
+#define CONST_HASH_SHIFT  61
+
+int8_t constant_slots[] = {
+     5,  4,  0,  1,  2, -1, -1,  3,
+};
+
 keyword_entry keywords[] = {
     {"if",           26217},
     {"do",           28516},
@@ -72,4 +87,12 @@ keyword_entry keywords[] = {
 # define KEY_CONTINUE     21
 # define KEY_LAST_ID      21
 
+#define KEY_HASH_MULT     16274765915815324545ULL
+#define KEY_HASH_SHIFT    59
+
+int8_t keyword_slots[] = {
+    18,  7, -1, 21,  0, -1, 20, 19, -1, -1,  5, 12,  8,  1, 13, 11,
+     6, -1, 15, 17, -1, 14,  3,  4,  9, 16,  2, -1, -1, -1, -1, 10,
+};
+
 #endif
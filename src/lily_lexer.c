@@ -10,6 +10,46 @@
 #include "lily_utf8.h"
 #include "lily_alloc.h"
 
+/* Scanning for the end of words, blanks, strings, and comments is done a block
+   of bytes at a time where possible. */
+#if defined(__AVX2__)
+# include <immintrin.h>
+# define LEX_VEC_SIZE 32
+# define LEX_VEC_FULL 0xFFFFFFFFU
+typedef __m256i lex_vec;
+# define vec_load(p)   _mm256_loadu_si256((const __m256i *)(p))
+# define vec_set(c)    _mm256_set1_epi8((char)(c))
+# define vec_eq(a, b)  _mm256_cmpeq_epi8(a, b)
+# define vec_gt(a, b)  _mm256_cmpgt_epi8(a, b)
+# define vec_or(a, b)  _mm256_or_si256(a, b)
+# define vec_add(a, b) _mm256_add_epi8(a, b)
+# define vec_mask(a)   ((unsigned int)_mm256_movemask_epi8(a))
+#elif defined(__SSE2__) || defined(_M_X64)
+# include <emmintrin.h>
+# define LEX_VEC_SIZE 16
+# define LEX_VEC_FULL 0xFFFFU
+typedef __m128i lex_vec;
+# define vec_load(p)   _mm_loadu_si128((const __m128i *)(p))
+# define vec_set(c)    _mm_set1_epi8((char)(c))
+# define vec_eq(a, b)  _mm_cmpeq_epi8(a, b)
+# define vec_gt(a, b)  _mm_cmpgt_epi8(a, b)
+# define vec_or(a, b)  _mm_or_si128(a, b)
+# define vec_add(a, b) _mm_add_epi8(a, b)
+# define vec_mask(a)   ((unsigned int)_mm_movemask_epi8(a))
+#endif
+
+#if defined(LEX_VEC_SIZE) && defined(_MSC_VER)
+# include <intrin.h>
+static int first_set_bit(unsigned int mask)
+{
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int)index;
+}
+#elif defined(LEX_VEC_SIZE)
+# define first_set_bit(mask) __builtin_ctz(mask)
+#endif
+
 /* Group 1: Increment pos, return a simple token. */
 #define CC_G_ONE_OFFSET  0
 /* CC_LEFT_PARENTH isn't here because (| opens a lambda. */
@@ -95,6 +135,115 @@ static const lily_token grp_two_eq_table[] =
     tk_bitwise_xor_eq, tk_not_eq, tk_modulo_eq, tk_multiply_eq, tk_divide_eq,
 };
 
+/** Block scanning helpers **/
+
+/* These find where a run of bytes ends, looking at a block of bytes at a time
+   until 'limit', then one at a time. Each of them needs the run to stop before
+   the end of the source. Source lines end with "\n\0", so that's true of the
+   lexer's input buffer. */
+
+#ifdef LEX_VEC_SIZE
+/* Keep going until 'match' (which can use 'block') has a byte set. */
+# define FIND_BY_BLOCK(match) \
+while (ch + LEX_VEC_SIZE <= limit) { \
+    lex_vec block = vec_load(ch); \
+    unsigned int mask = vec_mask(match); \
+ \
+    if (mask) \
+        return ch + first_set_bit(mask); \
+ \
+    ch += LEX_VEC_SIZE; \
+}
+
+/* Keep going while 'match' (which can use 'block') has every byte set. */
+# define SKIP_BY_BLOCK(match) \
+while (ch + LEX_VEC_SIZE <= limit) { \
+    lex_vec block = vec_load(ch); \
+    unsigned int mask = vec_mask(match) ^ LEX_VEC_FULL; \
+ \
+    if (mask) { \
+        ch += first_set_bit(mask); \
+        break; \
+    } \
+ \
+    ch += LEX_VEC_SIZE; \
+}
+
+/* Is each byte of 'v' within lo and hi? Bytes are shifted so that lo is the
+   lowest signed value, which makes the range check one compare. */
+# define vec_in_range(v, lo, hi) \
+vec_gt(vec_set(-128 + (hi) - (lo) + 1), vec_add(v, vec_set(128 - (lo))))
+#else
+# define FIND_BY_BLOCK(match) (void)limit;
+# define SKIP_BY_BLOCK(match) (void)limit;
+#endif
+
+/* Find the first 'a' or 'b'. */
+static const char *find_either(const char *ch, const char *limit, char a,
+        char b)
+{
+    FIND_BY_BLOCK(vec_or(vec_eq(block, vec_set(a)), vec_eq(block, vec_set(b))))
+
+    while (*ch != a && *ch != b)
+        ch++;
+
+    return ch;
+}
+
+/* Find the first byte that a quoted string has to stop at. This is the only
+   one that also stops at \0, since interpolation scans strings that aren't
+   the input buffer (and gives 'ch' as the limit). */
+static const char *find_quote_stop(const char *ch, const char *limit)
+{
+    FIND_BY_BLOCK(vec_or(vec_or(vec_eq(block, vec_set('"')),
+                                vec_eq(block, vec_set('\\'))),
+                         vec_or(vec_or(vec_eq(block, vec_set('\n')),
+                                       vec_eq(block, vec_set('^'))),
+                                vec_eq(block, vec_set('\0')))))
+
+    while (*ch != '"' && *ch != '\\' && *ch != '\n' && *ch != '^' &&
+           *ch != '\0')
+        ch++;
+
+    return ch;
+}
+
+/* Skip over spaces and tabs. */
+static const char *skip_blanks(const char *ch, const char *limit)
+{
+    /* Most tokens don't have blanks before them, or only one. */
+    if (*ch != ' ' && *ch != '\t')
+        return ch;
+
+    ch++;
+
+    if (*ch != ' ' && *ch != '\t')
+        return ch;
+
+    SKIP_BY_BLOCK(vec_or(vec_eq(block, vec_set(' ')),
+                         vec_eq(block, vec_set('\t'))))
+
+    while (*ch == ' ' || *ch == '\t')
+        ch++;
+
+    return ch;
+}
+
+/* Skip over the rest of a word. Blocks only take ascii word characters, so the
+   last part handles utf-8. */
+static const char *skip_word(const char *ch, const char *limit)
+{
+    SKIP_BY_BLOCK(vec_or(vec_or(vec_in_range(vec_or(block, vec_set(0x20)),
+                                             'a', 'z'),
+                                vec_in_range(block, '0', '9')),
+                         vec_eq(block, vec_set('_'))))
+
+    while (ident_table[(unsigned char)*ch])
+        ch++;
+
+    return ch;
+}
+
 
 /** Lexer init and deletion **/
 lily_lex_state *lily_new_lex_state(lily_options *options,
@@ -403,44 +552,6 @@ return i;
 
 /** file and str reading functions **/
 
-/* This reads a line from a file-backed entry. */
-static int read_file_line(lily_lex_entry *entry)
-{
-    READER_PREP
-    FILE *input_file = (FILE *)entry->source;
-    int ch;
-
-    while (1) {
-        ch = fgetc(input_file);
-
-        READER_GROW_CHECK
-        READER_EOF_CHECK(ch, EOF)
-
-        input_buffer[i] = ch;
-
-        if (ch == '\r' || ch == '\n') {
-            lexer->line_num++;
-
-            if (ch == '\r') {
-                input_buffer[i] = '\n';
-                ch = fgetc(input_file);
-                if (ch != '\n')
-                    ungetc(ch, input_file);
-            }
-
-            i++;
-            input_buffer[i] = '\0';
-            break;
-        }
-        else if ((unsigned char)ch > 127)
-            utf8_check = 1;
-
-        i++;
-    }
-
-    READER_END
-}
-
 /* This reads a line from a string-backed entry. */
 static int read_str_line(lily_lex_entry *entry)
 {
@@ -485,6 +596,79 @@ static int read_str_line(lily_lex_entry *entry)
 #undef READER_EOF_CHECK
 #undef READER_END
 
+/* The file has a '\r' inside of it, so lines can't be found by memchr. */
+#define FILE_HAS_CR     0x1
+/* The file isn't valid utf-8 (or has a \0), so each line is checked. */
+#define FILE_CHECK_UTF8 0x2
+
+/* This reads a line from a file-backed entry. The whole file was read in when
+   the entry was made, so this finds where the line ends and copies it over in
+   one go. */
+static int read_file_line(lily_lex_entry *entry)
+{
+    lily_lex_state *lexer = entry->lexer;
+    char *ch = (char *)entry->source;
+    char *end = entry->source_end;
+    char *line_end;
+
+    if ((entry->file_flags & FILE_HAS_CR) == 0)
+        line_end = memchr(ch, '\n', end - ch);
+    else {
+        line_end = ch;
+        while (line_end != end && *line_end != '\n' && *line_end != '\r')
+            line_end++;
+
+        if (line_end == end)
+            line_end = NULL;
+    }
+
+    int size;
+
+    if (line_end) {
+        size = (int)(line_end - ch);
+        entry->source = line_end + 1;
+
+        /* Treat \r\n as one newline. */
+        if (*line_end == '\r' && line_end + 1 != end && line_end[1] == '\n')
+            entry->source = line_end + 2;
+    }
+    else {
+        size = (int)(end - ch);
+        entry->source = end;
+    }
+
+    /* Leave room for the newline, the \0, and a byte after. */
+    while ((size + 3) > lexer->input_size) {
+        if (lexer->input_size > UINT16_MAX / 2) {
+            lexer->line_num++;
+            lily_raise_syn(lexer->raiser, "Line %d is too long.",
+                    lexer->line_num);
+        }
+
+        lily_grow_lexer_buffers(lexer);
+    }
+
+    char *input_buffer = lexer->input_buffer;
+
+    memcpy(input_buffer, ch, size);
+    input_buffer[size] = '\n';
+    input_buffer[size + 1] = '\0';
+
+    /* Only eof was seen. */
+    if (line_end == NULL && size == 0)
+        return 0;
+
+    lexer->line_num++;
+
+    if (entry->file_flags & FILE_CHECK_UTF8 &&
+        lily_is_valid_utf8(input_buffer) == 0) {
+        lily_raise_err(lexer->raiser, "Invalid utf-8 sequence on line %d.",
+                lexer->line_num);
+    }
+
+    return size + 1;
+}
+
 static int read_line(lily_lex_state *lex)
 {
     lily_lex_entry *entry = lex->entry;
@@ -496,9 +680,7 @@ static int read_line(lily_lex_state *lex)
 
 static void close_entry(lily_lex_entry *entry)
 {
-    if (entry->entry_type == et_file)
-        fclose((FILE *)entry->source);
-    else if (entry->entry_type != et_shallow_string)
+    if (entry->entry_type != et_shallow_string)
         /* entry->source moves, but entry->extra doesn't. Use this. */
         lily_free(entry->extra);
 }
@@ -834,6 +1016,9 @@ static void scan_multiline_comment(lily_lex_state *lexer, char **source_ch)
     char *new_ch = *source_ch + 2;
 
     while (1) {
+        new_ch = (char *)find_either(new_ch,
+                lexer->input_buffer + lexer->input_size, ']', '\n');
+
         if (*new_ch == ']' &&
             *(new_ch + 1) == '#') {
             new_ch += 2;
@@ -1133,9 +1318,19 @@ static void scan_quoted_raw(lily_lex_state *lexer, char **source_ch, int *start,
         else if (*new_ch == '\0')
             break;
         else {
-            label[label_pos] = *new_ch;
-            label_pos++;
-            new_ch++;
+            /* Copy everything up to the next byte of interest at once. */
+            char *input = lexer->input_buffer;
+            const char *limit = new_ch;
+
+            if ((uintptr_t)new_ch - (uintptr_t)input < lexer->input_size)
+                limit = input + lexer->input_size;
+
+            char *stop = (char *)find_quote_stop(new_ch + 1, limit);
+            int size = stop - new_ch;
+
+            memcpy(label + label_pos, new_ch, size);
+            label_pos += size;
+            new_ch = stop;
         }
     }
 
@@ -1351,11 +1546,81 @@ void lily_grow_lexer_buffers(lily_lex_state *lexer)
    Subsequent loads can only be in code mode. This prevents including something
    that accidentally sends data, and lots of other problems. */
 
+/* Read all of 'f' into a buffer with a \0 at the end. The buffer starts out
+   at the size of the file (when that can be found) so there's only one read. */
+static char *read_whole_file(FILE *f, size_t *out_size)
+{
+    size_t size = 0, capacity = 4096;
+
+    if (fseek(f, 0, SEEK_END) == 0) {
+        long pos = ftell(f);
+
+        if (pos > 0)
+            capacity = (size_t)pos + 1;
+
+        rewind(f);
+    }
+
+    char *text = lily_malloc(capacity * sizeof(char));
+
+    while (1) {
+        size += fread(text + size, 1, capacity - size - 1, f);
+
+        if (size != capacity - 1)
+            break;
+
+        /* The buffer is full. Make sure there's more before growing it. */
+        int ch = fgetc(f);
+
+        if (ch == EOF)
+            break;
+
+        capacity *= 2;
+        text = lily_realloc(text, capacity * sizeof(char));
+        text[size] = (char)ch;
+        size++;
+    }
+
+    text[size] = '\0';
+    *out_size = size;
+    return text;
+}
+
+/* Find out what reading lines from 'text' needs to check for. */
+static uint16_t get_file_flags(const char *text, size_t size)
+{
+    uint16_t flags = 0;
+    unsigned char high = 0;
+    size_t i;
+
+    if (memchr(text, '\r', size) != NULL)
+        flags |= FILE_HAS_CR;
+
+    for (i = 0;i < size;i++)
+        high |= (unsigned char)text[i];
+
+    /* Checking once here is cheaper than checking each line. This fails if
+       there's a \0 inside, which is fine since lines are checked then. */
+    if (high & 0x80 && lily_is_valid_sized_utf8(text, (int)size) == 0)
+        flags |= FILE_CHECK_UTF8;
+
+    return flags;
+}
+
 static void setup_opened_file(lily_lex_state *lexer, FILE *f)
 {
+    size_t size;
+    char *text = read_whole_file(f, &size);
+
+    /* Everything has been read, so the file isn't needed anymore. */
+    fclose(f);
+
     lily_lex_entry *new_entry = get_entry(lexer);
 
-    new_entry->source = f;
+    new_entry->source = text;
+    new_entry->extra = text;
+    new_entry->source_end = text + size;
+    new_entry->file_flags = get_file_flags(text, size);
     new_entry->entry_type = et_file;
     new_entry->final_token = tk_eof;
 
@@ -1443,16 +1708,13 @@ void lily_lexer(lily_lex_state *lexer)
     ch_class = lexer->ch_class;
 
     while (1) {
-        char *start_ch, *ch;
+        char *ch, *limit;
         int group;
 
-        ch = &lexer->input_buffer[input_pos];
-        start_ch = ch;
-
-        while (*ch == ' ' || *ch == '\t')
-            ch++;
+        limit = lexer->input_buffer + lexer->input_size;
+        ch = (char *)skip_blanks(&lexer->input_buffer[input_pos], limit);
+        input_pos = ch - lexer->input_buffer;
 
-        input_pos += ch - start_ch;
         group = ch_class[(unsigned char)*ch];
         if (group == CC_WORD) {
             label_handling: ;
@@ -1460,16 +1722,11 @@ void lily_lexer(lily_lex_state *lexer)
             /* The word and line buffers have the same size, plus \n is not a
                valid word character. So, there's no point in checking for
                overflow. */
-            int word_pos = 0;
-            char *label = lexer->label;
+            int word_pos = skip_word(ch + 1, limit) - ch;
 
-            do {
-                label[word_pos] = *ch;
-                word_pos++;
-                ch++;
-            } while (ident_table[(unsigned char)*ch]);
+            memcpy(lexer->label, ch, word_pos);
+            lexer->label[word_pos] = '\0';
             input_pos += word_pos;
-            label[word_pos] = '\0';
             token = tk_word;
         }
         else if (group <= CC_G_ONE_LAST) {
@@ -1756,56 +2013,83 @@ void lily_lexer(lily_lex_state *lexer)
     }
 }
 
+/* Copy a run of content into the label, sending the label off whenever it's
+   full. Returns the new label position. */
+static int add_content(lily_lex_state *lexer, const char *text, int size,
+        int htmlp)
+{
+    while (size) {
+        int room = lexer->input_size - 1 - htmlp;
+        int take = size < room ? size : room;
+
+        memcpy(lexer->label + htmlp, text, take);
+        htmlp += take;
+        text += take;
+        size -= take;
+
+        if (htmlp == (lexer->input_size - 1)) {
+            lexer->label[htmlp] = '\0';
+            lexer->render_func(lexer->label, lexer->data);
+            /* This isn't done, so fix htmlp. */
+            htmlp = 0;
+        }
+    }
+
+    return htmlp;
+}
+
 /* This handles what's outside of <?lily ... ?>. */
 void lily_lexer_handle_content(lily_lex_state *lexer)
 {
-    char c;
+    const char *buffer, *stop;
     int lbp, htmlp;
     void *data = lexer->data;
 
     /* htmlp and lbp are used so it's obvious they aren't globals. */
     lbp = lexer->input_pos;
-    c = lexer->input_buffer[lbp];
+    buffer = lexer->input_buffer;
     htmlp = 0;
 
     /* For `?>\n`, don't render the newline (it's annoying). */
-    if (c == '\n' &&
+    if (buffer[lbp] == '\n' &&
         lbp > 2 &&
-        lexer->input_buffer[lbp - 1] == '>' &&
-        lexer->input_buffer[lbp - 2] == '?') {
+        buffer[lbp - 1] == '>' &&
+        buffer[lbp - 2] == '?') {
 
         goto next_line;
     }
 
     /* Send html to the server either when unable to hold more or the lily tag
-       is found. */
+       is found. Everything up to the next '<' or newline is copied at once. */
     while (1) {
-        lbp++;
-        if (c == '<') {
-            if (strncmp(lexer->input_buffer + lbp, "?lily", 5) == 0) {
-                if (htmlp != 0) {
-                    /* Don't include the '<', because it goes with <?lily. */
-                    lexer->label[htmlp] = '\0';
-                    lexer->render_func(lexer->label, data);
-                }
-                lbp += 5;
-                /* Yield control to the lexer. */
-                break;
+        stop = find_either(buffer + lbp, buffer + lexer->input_size, '<',
+                '\n');
+
+        if (*stop == '<' && strncmp(stop + 1, "?lily", 5) == 0) {
+            /* Don't include the '<', because it goes with <?lily. */
+            htmlp = add_content(lexer, buffer + lbp, stop - (buffer + lbp),
+                    htmlp);
+
+            if (htmlp != 0) {
+                lexer->label[htmlp] = '\0';
+                lexer->render_func(lexer->label, data);
             }
+
+            lbp = (stop - buffer) + 6;
+            /* Yield control to the lexer. */
+            break;
         }
-        lexer->label[htmlp] = c;
-        htmlp++;
-        if (htmlp == (lexer->input_size - 1)) {
-            lexer->label[htmlp] = '\0';
-            lexer->render_func(lexer->label, data);
-            /* This isn't done, so fix htmlp. */
-            htmlp = 0;
-        }
 
-        if (c == '\n') {
+        htmlp = add_content(lexer, buffer + lbp, stop + 1 - (buffer + lbp),
+                htmlp);
+        lbp = (stop - buffer) + 1;
+
+        if (*stop == '\n') {
 next_line:
-            if (read_line(lexer))
+            if (read_line(lexer)) {
+                buffer = lexer->input_buffer;
                 lbp = 0;
+            }
             else {
                 if (htmlp != 0) {
                     lexer->label[htmlp] = '\0';
@@ -1821,8 +2105,6 @@ next_line:
                 break;
             }
         }
-
-        c = lexer->input_buffer[lbp];
     }
 
     lexer->input_pos = lbp;
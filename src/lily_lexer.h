@@ -93,11 +93,14 @@ typedef struct lily_lex_entry_ {
     lily_token final_token : 16;
     uint32_t saved_line_num;
     lily_lex_entry_type entry_type : 16;
-    uint16_t pad;
+    /* File entries: What needs to be checked for while reading lines. */
+    uint16_t file_flags;
     int64_t saved_last_integer;
 
     void *source;
     void *extra;
+    /* File entries: Where the text of the file ends. */
+    char *source_end;
 
     struct lily_lex_entry_ *prev;
     struct lily_lex_entry_ *next;
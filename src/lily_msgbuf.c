@@ -388,7 +388,7 @@ static void add_list_like(lily_vm_state *vm, lily_msgbuf *msgbuf, tag *t,
         lily_value *v, const char *prefix, const char *suffix)
 {
     int i;
-    lily_value **values = v->value.container->values;
+    lily_value *values = v->value.container->values;
     int count = v->value.container->num_values;
 
     lily_mb_add(msgbuf, prefix);
@@ -396,11 +396,11 @@ static void add_list_like(lily_vm_state *vm, lily_msgbuf *msgbuf, tag *t,
     /* This is necessary because num_values is unsigned. */
     if (count != 0) {
         for (i = 0;i < count - 1;i++) {
-            add_value_to_msgbuf(vm, msgbuf, t, values[i]);
+            add_value_to_msgbuf(vm, msgbuf, t, values + i);
             lily_mb_add(msgbuf, ", ");
         }
         if (i != count)
-            add_value_to_msgbuf(vm, msgbuf, t, values[i]);
+            add_value_to_msgbuf(vm, msgbuf, t, values + i);
     }
 
     lily_mb_add(msgbuf, suffix);
@@ -10,6 +10,10 @@ lily_options *lily_new_options(void)
     opt->argv = NULL;
     opt->data = stdout;
     opt->render_func = (lily_render_func) fputs;
+    opt->cache_dir = NULL;
+    opt->flush_func = NULL;
+    opt->flush_size = 65536;
+    opt->lazy_imports = 0;
 
     return opt;
 }
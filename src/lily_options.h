@@ -2,9 +2,20 @@
 # define LILY_OPTIONS_H
 
 # include <inttypes.h>
+# include <stddef.h>
 
 typedef void (*lily_render_func)(const char *, void *);
 
+# ifndef LILY_OUT_CHUNK
+#  define LILY_OUT_CHUNK
+typedef struct {
+    const char *data;
+    size_t size;
+} lily_out_chunk;
+
+typedef void (*lily_flush_func)(lily_out_chunk *, int, void *);
+# endif
+
 typedef struct {
     int argc;
     /* This is what `sys.argv` makes visible. */
@@ -13,6 +24,17 @@ typedef struct {
     void *data;
     /* This is called by lexer when content is seen in template mode. */
     lily_render_func render_func;
+    /* If not NULL, files are compiled into caches in this directory. An empty
+       string puts each cache next to the file it's for. */
+    const char *cache_dir;
+    /* If not NULL, output is collected into a sink and sent here in batches.
+       This also gets 'data' as the last argument. */
+    lily_flush_func flush_func;
+    /* How much output the sink holds before flushing. */
+    uint32_t flush_size;
+    /* If 1, imported modules run when one of their globals is first used,
+       instead of where they're imported. */
+    uint32_t lazy_imports;
 } lily_options;
 
 lily_options *lily_new_options(void);
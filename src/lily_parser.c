@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "lily_aot.h"
 #include "lily_config.h"
 #include "lily_library.h"
 #include "lily_options.h"
@@ -9,6 +10,7 @@
 #include "lily_parser_tok_table.h"
 #include "lily_keyword_table.h"
 #include "lily_string_pile.h"
+#include "lily_symbol_index.h"
 #include "lily_value_flags.h"
 #include "lily_alloc.h"
 
@@ -19,6 +21,10 @@
 #include "lily_pkg_random.h"
 #include "lily_pkg_time.h"
 
+#ifdef LILY_BUNDLE
+# include "lily_bundle.h"
+#endif
+
 #include "lily_api_value.h"
 
 #define NEED_NEXT_TOK(expected) \
@@ -79,6 +85,34 @@ typedef struct lily_rewind_state_
     uint32_t pending;
 } lily_rewind_state;
 
+/* This is what lily_reset_state brings a state back to. Modules loaded before
+   the mark are kept, but what was added to them after is not. The arrays are
+   indexed by module, in load order. */
+typedef struct lily_state_mark_
+{
+    lily_module_entry *last_module;
+    lily_class **class_starts;
+    lily_var **var_starts;
+    lily_module_link **link_starts;
+    uint16_t *module_flags;
+    /* The types of __main__'s storages. */
+    lily_type **storage_types;
+    lily_type *class_self_type;
+    lily_var *old_function_start;
+    lily_class *old_class_start;
+    lily_class *hidden_class_start;
+    uint32_t module_count;
+    uint32_t literal_count;
+    uint32_t next_class_id;
+    uint32_t line_num;
+    uint32_t import_memo_count;
+    uint32_t pad2;
+    uint16_t next_global_id;
+    uint16_t main_reg_count;
+    uint16_t storage_count;
+    uint16_t pad3;
+} lily_state_mark;
+
 /* This sets up the core of the interpreter. It's pretty rough around the edges,
    especially with how the parser is assigning into all sorts of various structs
    when it shouldn't. */
@@ -87,6 +121,8 @@ lily_state *lily_new_state(void)
     lily_parse_state *parser = lily_malloc(sizeof(lily_parse_state));
     parser->module_top = NULL;
     parser->module_start = NULL;
+    parser->import_memo = NULL;
+    parser->mark = NULL;
     parser->options = lily_new_options();
 
     lily_raiser *raiser = lily_new_raiser();
@@ -111,6 +147,8 @@ lily_state *lily_new_state(void)
     parser->lex = lily_new_lex_state(parser->options, raiser);
     parser->msgbuf = lily_new_msgbuf(64);
     parser->data_stack = lily_new_buffer_u16(4);
+    parser->template_module = NULL;
+    parser->template_imports = lily_new_buffer_u16(4);
     parser->expr = parser->first_expr;
     parser->foreign_values = lily_new_value_stack();
 
@@ -159,7 +197,15 @@ lily_state *lily_new_state(void)
     lily_pkg_random_init(parser->vm);
     lily_pkg_time_init(parser->vm);
 
+#ifdef LILY_BUNDLE
+    lily_register_bundle(parser->vm);
+#endif
+
     parser->executing = 0;
+    parser->compile_only = 0;
+    parser->cache = NULL;
+    parser->arena = NULL;
+    parser->readonly_arena = NULL;
 
     return parser->vm;
 }
@@ -177,6 +223,49 @@ static void free_links_until(lily_module_link *link_iter,
 
 #define free_links(iter) free_links_until(iter, NULL)
 
+static void free_module(lily_parse_state *parser, lily_module_entry *module)
+{
+    free_links(module->module_chain);
+
+    if (module->handle)
+        lily_library_free(module->handle);
+
+    lily_free_module_symbols(parser->symtab, module);
+    lily_free(module->path);
+    lily_free(module->dirname);
+    lily_free(module->loadname);
+    lily_free(module->cid_table);
+    lily_free(module);
+}
+
+static void truncate_import_memo(lily_parse_state *parser, uint32_t pos)
+{
+    lily_symbol_index *memo = parser->import_memo;
+
+    if (memo == NULL)
+        return;
+
+    uint32_t i;
+
+    for (i = pos;i < memo->pos;i++)
+        lily_free((char *)memo->entries[i].name);
+
+    lily_si_truncate(memo, pos);
+}
+
+static void free_mark(lily_state_mark *mark)
+{
+    if (mark == NULL)
+        return;
+
+    lily_free(mark->class_starts);
+    lily_free(mark->var_starts);
+    lily_free(mark->link_starts);
+    lily_free(mark->module_flags);
+    lily_free(mark->storage_types);
+    lily_free(mark);
+}
+
 void lily_free_state(lily_state *vm)
 {
     lily_parse_state *parser = vm->parser;
@@ -194,6 +283,7 @@ void lily_free_state(lily_state *vm)
     lily_free_emit_state(parser->emit);
 
     lily_free_buffer_u16(parser->data_stack);
+    lily_free_buffer_u16(parser->template_imports);
 
     /* The path for the first module is always a shallow copy of the loadname
        that was sent. Make sure that doesn't get free'd. */
@@ -203,23 +293,14 @@ void lily_free_state(lily_state *vm)
     lily_module_entry *module_next = NULL;
 
     while (module_iter) {
-        free_links(module_iter->module_chain);
-
         module_next = module_iter->root_next;
-
-        if (module_iter->handle)
-            lily_library_free(module_iter->handle);
-
-        lily_free_module_symbols(parser->symtab, module_iter);
-        lily_free(module_iter->path);
-        lily_free(module_iter->dirname);
-        lily_free(module_iter->loadname);
-        lily_free(module_iter->cid_table);
-        lily_free(module_iter);
-
+        free_module(parser, module_iter);
         module_iter = module_next;
     }
 
+    free_mark(parser->mark);
+    truncate_import_memo(parser, 0);
+    lily_free_symbol_index(parser->import_memo);
     lily_free_symtab(parser->symtab);
     lily_free_generic_pool(parser->generics);
     lily_free_value_stack(parser->foreign_values);
@@ -228,7 +309,16 @@ void lily_free_state(lily_state *vm)
     lily_free(parser->toplevel_func);
     lily_free_options(parser->options);
 
+    lily_arena *arena = parser->arena;
+    lily_arena *readonly_arena = parser->readonly_arena;
+
     lily_free(parser);
+
+    if (arena)
+        lily_free_arena(arena);
+
+    if (readonly_arena)
+        lily_free_arena(readonly_arena);
 }
 
 static void rewind_parser(lily_parse_state *parser, lily_rewind_state *rs)
@@ -269,7 +359,9 @@ static void rewind_parser(lily_parse_state *parser, lily_rewind_state *rs)
     emit->closed_pos = 0;
     emit->match_case_pos = 0;
     emit->top_var = emit->main_block->var_start;
-    emit->top_function_ret = NULL;
+    /* This is what __main__ returns. Imports inherit it, so they need it to
+       be right to end with a return. */
+    emit->top_function_ret = lily_unit_type;
 
     lily_block *block_stop = emit->block->next;
     lily_block *block_iter = emit->main_block->next;
@@ -347,6 +439,265 @@ static void handle_rewind(lily_parse_state *parser)
     rs->line_num = parser->lex->line_num;
 }
 
+static lily_state_mark *new_mark(lily_parse_state *parser)
+{
+    lily_state_mark *mark = lily_malloc(sizeof(lily_state_mark));
+    lily_symtab *symtab = parser->symtab;
+    lily_emit_state *emit = parser->emit;
+    lily_storage_stack *storages = emit->storages;
+    lily_module_entry *module_iter;
+    uint32_t count = 0, i;
+
+    for (module_iter = parser->module_start;
+         module_iter;
+         module_iter = module_iter->root_next)
+        count++;
+
+    mark->class_starts = lily_malloc(count * sizeof(*mark->class_starts));
+    mark->var_starts = lily_malloc(count * sizeof(*mark->var_starts));
+    mark->link_starts = lily_malloc(count * sizeof(*mark->link_starts));
+    mark->module_flags = lily_malloc(count * sizeof(*mark->module_flags));
+
+    for (i = 0, module_iter = parser->module_start;
+         module_iter;
+         i++, module_iter = module_iter->root_next) {
+        mark->class_starts[i] = module_iter->class_chain;
+        mark->var_starts[i] = module_iter->var_chain;
+        mark->link_starts[i] = module_iter->module_chain;
+        mark->module_flags[i] = module_iter->flags;
+    }
+
+    mark->storage_types = lily_malloc(
+            (storages->scope_end + 1) * sizeof(*mark->storage_types));
+
+    for (i = 0;i < storages->scope_end;i++)
+        mark->storage_types[i] = storages->data[i]->type;
+
+    mark->last_module = parser->module_top;
+    mark->class_self_type = parser->class_self_type;
+    mark->old_function_start = symtab->old_function_chain;
+    mark->old_class_start = symtab->old_class_chain;
+    mark->hidden_class_start = symtab->hidden_class_chain;
+    mark->module_count = count;
+    mark->literal_count = lily_vs_pos(symtab->literals);
+    mark->next_class_id = symtab->next_class_id;
+    mark->line_num = parser->lex->line_num;
+    mark->import_memo_count = parser->import_memo ? parser->import_memo->pos : 0;
+    mark->pad2 = 0;
+    mark->next_global_id = symtab->next_global_id;
+    mark->pad3 = 0;
+    mark->main_reg_count = emit->main_block->next_reg_spot;
+    mark->storage_count = storages->scope_end;
+    return mark;
+}
+
+static void make_mark(lily_parse_state *parser)
+{
+    lily_state_mark *mark = new_mark(parser);
+
+    lily_vm_mark(parser->vm, mark->next_global_id);
+    free_mark(parser->mark);
+    parser->mark = mark;
+}
+
+/* Classes made after the mark are flagged, so that types using them can be
+   found and dropped before the classes are destroyed. */
+static void flag_dead_classes(lily_parse_state *parser, lily_class *class_iter,
+        lily_class *stop)
+{
+    lily_vm_state *vm = parser->vm;
+
+    while (class_iter != stop) {
+        class_iter->flags |= CLS_VISITED;
+
+        if (class_iter->id < vm->class_count &&
+            vm->class_table[class_iter->id] == class_iter)
+            vm->class_table[class_iter->id] = NULL;
+
+        if (class_iter->item_kind != ITEM_TYPE_VARIANT &&
+            class_iter->flags & CLS_ENUM_IS_SCOPED) {
+            int i;
+            for (i = 0;i < class_iter->variant_size;i++)
+                class_iter->variant_members[i]->flags |= CLS_VISITED;
+        }
+
+        class_iter = class_iter->next;
+    }
+}
+
+static void flag_dead_symbols(lily_parse_state *parser, lily_state_mark *mark)
+{
+    lily_symtab *symtab = parser->symtab;
+    lily_module_entry *module_iter;
+    uint32_t i;
+
+    for (i = 0, module_iter = parser->module_start;
+         module_iter;
+         i++, module_iter = module_iter->root_next) {
+        lily_class *stop = NULL;
+        if (i < mark->module_count)
+            stop = mark->class_starts[i];
+
+        flag_dead_classes(parser, module_iter->class_chain, stop);
+    }
+
+    flag_dead_classes(parser, symtab->old_class_chain, mark->old_class_start);
+    flag_dead_classes(parser, symtab->hidden_class_chain,
+            mark->hidden_class_start);
+}
+
+static void rewind_classes_from(lily_class *class_iter,
+        lily_state_mark *mark)
+{
+    while (class_iter) {
+        lily_rewind_class(class_iter, mark->literal_count);
+        class_iter = class_iter->next;
+    }
+}
+
+/* Vars dynaloaded after the mark may have values waiting to be loaded. */
+static void drop_foreign_values(lily_parse_state *parser, uint16_t global_count)
+{
+    lily_value_stack *values = parser->foreign_values;
+    uint32_t i, keep = 0;
+
+    for (i = 0;i < lily_vs_pos(values);i++) {
+        lily_literal *l = (lily_literal *)lily_vs_nth(values, i);
+
+        if (l->reg_spot < global_count) {
+            lily_vs_nth(values, keep) = (lily_value *)l;
+            keep++;
+        }
+        else {
+            lily_deref((lily_value *)l);
+            lily_free(l);
+        }
+    }
+
+    values->pos = keep;
+}
+
+static void reset_cid_table(lily_parse_state *parser, lily_module_entry *m,
+        lily_state_mark *mark)
+{
+    lily_vm_state *vm = parser->vm;
+    uint16_t *cid_table = m->cid_table;
+    int stop = m->dynaload_table[0][0];
+    int i;
+
+    /* Entries that are dropped here will be found again if the class is
+       dynaloaded again. */
+    for (i = 0;i < stop;i++) {
+        uint16_t id = cid_table[i];
+
+        if (id >= mark->next_class_id ||
+            (id < vm->class_count && vm->class_table[id] == NULL)) {
+            cid_table[i] = 0;
+            m->flags &= ~MODULE_CID_TABLE_FULL;
+        }
+    }
+}
+
+/* This drops the symbols made after the mark. The classes among them must have
+   been flagged first. */
+static void rewind_symbols(lily_parse_state *parser, lily_state_mark *mark)
+{
+    lily_symtab *symtab = parser->symtab;
+    lily_module_entry *main_module = parser->main_module;
+    lily_module_entry *module_iter, *module_next;
+    uint32_t i;
+
+    drop_foreign_values(parser, mark->next_global_id);
+
+    /* Classes that are kept may have methods and types that go away. This has
+       to be done while the flagged classes are still around. */
+    for (i = 0, module_iter = parser->module_start;
+         i < mark->module_count;
+         i++, module_iter = module_iter->root_next) {
+        rewind_classes_from(mark->class_starts[i], mark);
+
+        if (module_iter->cid_table)
+            reset_cid_table(parser, module_iter, mark);
+    }
+
+    rewind_classes_from(mark->old_class_start, mark);
+    rewind_classes_from(mark->hidden_class_start, mark);
+
+    /* Imports resolved after the mark may be of modules about to go away. */
+    truncate_import_memo(parser, mark->import_memo_count);
+
+    module_iter = mark->last_module->root_next;
+    mark->last_module->root_next = NULL;
+    parser->module_top = mark->last_module;
+
+    while (module_iter) {
+        module_next = module_iter->root_next;
+        free_module(parser, module_iter);
+        module_iter = module_next;
+    }
+
+    for (i = 0, module_iter = parser->module_start;
+         module_iter;
+         i++, module_iter = module_iter->root_next) {
+        free_links_until(module_iter->module_chain, mark->link_starts[i]);
+        lily_rewind_module_links(module_iter, mark->link_starts[i]);
+        lily_rewind_module_symbols(module_iter, mark->class_starts[i],
+                mark->var_starts[i]);
+
+        /* Registered sources first imported after the mark have to run again
+           the next time they're imported. */
+        if (mark->module_flags[i] & MODULE_NOT_EXECUTED)
+            module_iter->flags |= MODULE_NOT_EXECUTED;
+    }
+
+    lily_rewind_old_symbols(symtab, mark->old_function_start,
+            mark->old_class_start, mark->hidden_class_start);
+    lily_rewind_literals(symtab, mark->literal_count);
+    symtab->next_class_id = mark->next_class_id;
+    symtab->next_global_id = mark->next_global_id;
+    symtab->active_module = main_module;
+    parser->class_self_type = mark->class_self_type;
+
+    /* __main__'s storages go back to the types they had, since those types
+       are sure to still exist. */
+    lily_emit_state *emit = parser->emit;
+    lily_storage_stack *storages = emit->storages;
+
+    for (i = 0;i < storages->scope_end;i++) {
+        lily_storage *s = storages->data[i];
+
+        if (i < mark->storage_count)
+            s->type = mark->storage_types[i];
+        else
+            s->type = NULL;
+
+        s->flags &= ~STORAGE_IS_LOCKED;
+    }
+
+    storages->scope_end = mark->storage_count;
+    emit->main_block->next_reg_spot = mark->main_reg_count;
+}
+
+static void reset_to_mark(lily_parse_state *parser, lily_state_mark *mark)
+{
+    lily_rewind_state *rs = parser->rs;
+    lily_module_entry *main_module = parser->main_module;
+
+    /* Start with what parsing and execution leave behind. Rewinding usually
+       drops the new symbols of the main module, but here the mark does that
+       instead, so have it stop where it is. */
+    rs->main_class_start = main_module->class_chain;
+    rs->main_var_start = main_module->var_chain;
+    rs->line_num = mark->line_num;
+    rs->pending = 0;
+    rewind_parser(parser, rs);
+    parser->executing = 0;
+
+    flag_dead_symbols(parser, mark);
+    lily_vm_reset(parser->vm, mark->next_global_id);
+    rewind_symbols(parser, mark);
+}
+
 /***
  *      ___                            _
  *     |_ _|_ __ ___  _ __   ___  _ __| |_
@@ -449,6 +800,7 @@ static lily_module_entry *new_module(lily_parse_state *parser, const char *path,
     }
 
     module->dynaload_table = dynaload_table;
+    module->flags = 0;
 
     if (dynaload_table && dynaload_table[0][0]) {
         unsigned char cid_count = dynaload_table[0][0];
@@ -459,14 +811,29 @@ static lily_module_entry *new_module(lily_parse_state *parser, const char *path,
     else
         module->cid_table = NULL;
 
+    if (dynaload_table) {
+        const char *header = dynaload_table[0] + 1;
+        int i;
+
+        for (i = 0;i < (unsigned char)dynaload_table[0][0];i++)
+            header += strlen(header) + 1;
+
+        if (header[0] == 'D')
+            module->flags |= MODULE_HAS_DESCRIPTORS;
+    }
+
     module->root_next = NULL;
     module->module_chain = NULL;
     module->class_chain = NULL;
     module->var_chain = NULL;
+    module->link_index = NULL;
+    module->class_index = NULL;
+    module->var_index = NULL;
+    module->dynaload_index = NULL;
     module->handle = NULL;
     module->loader = NULL;
+    module->source = NULL;
     module->item_kind = ITEM_TYPE_MODULE;
-    module->flags = 0;
 
     if (parser->module_start) {
         parser->module_top->root_next = module;
@@ -489,6 +856,27 @@ void lily_register_package(lily_state *s, const char *name,
     lily_module_entry *entry = new_module(parser, name, dynaload_table);
     entry->loader = (lily_loader)loader;
     entry->flags |= MODULE_IS_REGISTERED;
+
+    /* Imports of this name that were found elsewhere would now find this. */
+    truncate_import_memo(parser, 0);
+
+    if (parser->mark)
+        parser->mark->import_memo_count = 0;
+}
+
+/* This adds a module that runs the source given when it's first imported. The
+   source is not copied, and must outlive the state. */
+void lily_register_source(lily_state *s, const char *name, const char *source)
+{
+    lily_parse_state *parser = s->parser;
+    lily_module_entry *entry = new_module(parser, name, NULL);
+    entry->source = source;
+    entry->flags |= MODULE_IS_REGISTERED | MODULE_NOT_EXECUTED;
+
+    truncate_import_memo(parser, 0);
+
+    if (parser->mark)
+        parser->mark->import_memo_count = 0;
 }
 
 /* This adds 'to_link' as an entry within 'target' so that 'target' is able to
@@ -524,7 +912,7 @@ static lily_module_entry *load_file(lily_parse_state *parser, const char *path)
 }
 
 static lily_module_entry *load_library(lily_parse_state *parser,
-        const char *path, const char *name)
+        const char *path)
 {
     lily_module_entry *result = NULL;
     lily_library *library = lily_library_load(path);
@@ -533,7 +921,8 @@ static lily_module_entry *load_library(lily_parse_state *parser,
         result->handle = library->source;
 
         lily_msgbuf *msgbuf = parser->msgbuf;
-        const char *lib_name = lily_mb_sprintf(msgbuf, "lily_%s_loader", name);
+        const char *lib_name = lily_mb_sprintf(msgbuf, "lily_%s_loader",
+                result->loadname);
         /* This may be NULL, but that's okay because loaders are optional. */
         result->loader = lily_library_get(library->source, lib_name);
 
@@ -581,6 +970,46 @@ static const char *parse_path(lily_parse_state *parser, const char *fmt,
     return lily_mb_get(msgbuf);
 }
 
+/* The same import from the same directory always resolves to the same module,
+   so that's remembered instead of searching again. Import names can't have a
+   newline, so the key can't be ambiguous. */
+static const char *import_memo_key(lily_parse_state *parser, const char *name)
+{
+    char *current = parser->symtab->active_module->dirname;
+
+    if (current[0] == '\0')
+        current = ".";
+
+    return lily_mb_sprintf(parser->msgbuf, "%s\n%s", current, name);
+}
+
+static lily_module_entry *find_import_memo(lily_parse_state *parser,
+        const char *name)
+{
+    if (parser->import_memo == NULL)
+        return NULL;
+
+    const char *key = import_memo_key(parser, name);
+
+    return lily_si_find(parser->import_memo, key, lily_hash_name(key), 0);
+}
+
+static void add_import_memo(lily_parse_state *parser, const char *name,
+        lily_module_entry *module)
+{
+    if (parser->import_memo == NULL)
+        parser->import_memo = lily_new_symbol_index();
+
+    const char *key = import_memo_key(parser, name);
+    char *key_copy = lily_malloc(strlen(key) + 1);
+    lily_index_entry *entry = lily_si_reserve(parser->import_memo, 1);
+
+    strcpy(key_copy, key);
+    entry->item = module;
+    entry->name = key_copy;
+    lily_si_commit(parser->import_memo, 1);
+}
+
 static const char *import_paths[] =
 {
     "$/?.lily",
@@ -614,7 +1043,6 @@ static lily_module_entry *load_module(lily_parse_state *parser,
     int i;
 
     for (i = 0;import_paths[i] != NULL;i++) {
-        /* todo: Use string pile to cache paths. */
         lily_mb_flush(msgbuf);
         const char *path = parse_path(parser, import_paths[i], root, current,
                 name);
@@ -645,7 +1073,7 @@ static lily_module_entry *load_module(lily_parse_state *parser,
                 if (strcmp(suffix, ".lily") == 0)
                     module = load_file(parser, path);
                 else if (strcmp(suffix, LILY_LIB_SUFFIX) == 0)
-                    module = load_library(parser, path, name);
+                    module = load_library(parser, path);
 
                 if (module)
                     break;
@@ -673,6 +1101,7 @@ static lily_module_entry *load_module(lily_parse_state *parser,
         lily_raise_syn(parser->raiser, lily_mb_get(msgbuf));
     }
 
+    add_import_memo(parser, name, module);
     return module;
 }
 
@@ -1191,6 +1620,8 @@ static void update_cid_table(lily_parse_state *parser, lily_module_entry *m)
     lily_symtab *symtab = parser->symtab;
     lily_module_entry *builtin = parser->module_start;
 
+    int missing = 0;
+
     while (counter < stop) {
         if (cid_table[counter] == 0) {
             lily_class *cls = lily_find_class(symtab, m, cid_entry);
@@ -1199,17 +1630,24 @@ static void update_cid_table(lily_parse_state *parser, lily_module_entry *m)
 
             if (cls)
                 cid_table[counter] = cls->id;
+            else
+                missing = 1;
         }
         cid_entry += strlen(cid_entry) + 1;
         counter++;
     }
+
+    if (missing == 0)
+        m->flags |= MODULE_CID_TABLE_FULL;
 }
 
+/* This is run before each pass, so tables that are full are skipped. */
 static void update_all_cid_tables(lily_parse_state *parser)
 {
     lily_module_entry *entry_iter = parser->module_start;
     while (entry_iter) {
-        if (entry_iter->cid_table)
+        if (entry_iter->cid_table &&
+            (entry_iter->flags & MODULE_CID_TABLE_FULL) == 0)
             update_cid_table(parser, entry_iter);
 
         entry_iter = entry_iter->root_next;
@@ -1238,85 +1676,54 @@ static lily_module_entry *resolve_module(lily_parse_state *parser)
     return result;
 }
 
-/* This is used to collect class names. Trying to just get a class name isn't
-   possible because there could be a module before the class name (`a.b.c`).
-   To make things more complicated, there could be a dynaload of a class. */
-static lily_class *resolve_class_name(lily_parse_state *parser)
+/* This finds a class within 'search_module' (or the usual places if that's
+   NULL), dynaloading it if it hasn't been loaded yet. */
+static lily_class *find_or_dl_class(lily_parse_state *parser,
+        lily_module_entry *search_module, const char *name)
 {
     lily_symtab *symtab = parser->symtab;
-    lily_lex_state *lex = parser->lex;
-
-    NEED_CURRENT_TOK(tk_word)
-
-    lily_module_entry *search_module = resolve_module(parser);
-    lily_class *result = lily_find_class(symtab, search_module, lex->label);
+    lily_class *result = lily_find_class(symtab, search_module, name);
     if (result == NULL) {
         if (search_module == NULL)
             search_module = symtab->builtin_module;
 
         if (search_module->dynaload_table)
-            result = find_run_class_dynaload(parser, search_module, lex->label);
+            result = find_run_class_dynaload(parser, search_module, name);
 
         if (result == NULL && symtab->active_module->dynaload_table)
             result = find_run_class_dynaload(parser, symtab->active_module,
-                    lex->label);
+                    name);
 
         if (result == NULL)
             lily_raise_syn(parser->raiser, "Class '%s' does not exist.",
-                    lex->label);
+                    name);
     }
 
     return result;
 }
 
-
-static lily_var *dynaload_function(lily_parse_state *parser,
-        lily_module_entry *m, lily_class *cls, int dyna_index)
+/* This is used to collect class names. Trying to just get a class name isn't
+   possible because there could be a module before the class name (`a.b.c`).
+   To make things more complicated, there could be a dynaload of a class. */
+static lily_class *resolve_class_name(lily_parse_state *parser)
 {
     lily_lex_state *lex = parser->lex;
-    lily_var *call_var;
 
-    const char *entry = m->dynaload_table[dyna_index];
-    const char *name = entry + DYNA_NAME_OFFSET;
-    const char *body = name + strlen(name) + 1;
+    NEED_CURRENT_TOK(tk_word)
 
-    lily_module_entry *save_active = parser->symtab->active_module;
+    lily_module_entry *search_module = resolve_module(parser);
+    return find_or_dl_class(parser, search_module, lex->label);
+}
+
+/* This gets the type of a function from the prototype of a dynaload entry
+   that doesn't have a descriptor. */
+static lily_type *function_type_from_proto(lily_parse_state *parser,
+        const char *body)
+{
+    lily_lex_state *lex = parser->lex;
 
     lily_load_source(lex, et_shallow_string, body);
     lily_lexer(lex);
-
-    lily_item *source;
-    if (cls == NULL)
-        source = (lily_item *)m;
-    else
-        source = (lily_item *)cls;
-
-    lily_foreign_func func;
-
-    if (m->loader)
-        func = (lily_foreign_func)m->loader(parser->vm, dyna_index);
-    else {
-        lily_msgbuf *msgbuf = parser->msgbuf;
-        lily_mb_flush(msgbuf);
-
-        char *cls_name = "";
-        const char *search_name = name;
-
-        /* Constructors use <new> as their name to hide it. */
-        if (search_name[0] == '<')
-            search_name = "new";
-
-        if (cls)
-            cls_name = cls->name;
-
-        func = (lily_foreign_func)lily_library_get(m->handle,
-                lily_mb_sprintf(msgbuf, "lily_%s_%s_%s", m->loadname, cls_name,
-                search_name));
-    }
-
-    parser->symtab->active_module = m;
-    int save_generic_start;
-    lily_gp_save_and_hide(parser->generics, &save_generic_start);
     collect_generics(parser);
 
     int result_pos = parser->tm->pos;
@@ -1355,40 +1762,208 @@ static lily_var *dynaload_function(lily_parse_state *parser,
     lily_type *type = lily_tm_make(parser->tm, flags,
             parser->symtab->function_class, i);
 
-    call_var = lily_emit_new_tied_dyna_var(parser->emit, func, source, type,
-            name);
+    lily_pop_lex_entry(lex);
+    return type;
+}
 
-    lily_gp_restore_and_unhide(parser->generics, save_generic_start);
+/* Tables written by dyna_tools.py have a descriptor after the prototype of
+   each function, var, and property. Descriptors hold the same type as the
+   prototype, but in prefix order so that the type can be built without lexing
+   (dyna_tools.py has the details). Tables that have them mark it with a 'D'
+   after their cid entries. */
+static lily_type *type_from_desc(lily_parse_state *, const char **);
 
-    lily_pop_lex_entry(lex);
+static lily_type *arg_from_desc(lily_parse_state *parser, const char **desc,
+        int *flags)
+{
+    char ch = **desc;
+    lily_type *type;
 
-    parser->symtab->active_module = save_active;
+    if (ch == '*') {
+        *desc += 1;
+        type = type_from_desc(parser, desc);
+        type = make_type_of_class(parser, parser->symtab->optarg_class, type);
+        *flags |= TYPE_HAS_OPTARGS;
+    }
+    else if (ch == '.') {
+        *desc += 1;
+        type = type_from_desc(parser, desc);
+        type = make_type_of_class(parser, parser->symtab->list_class, type);
+        *flags |= TYPE_IS_VARARGS;
+    }
+    else {
+        type = type_from_desc(parser, desc);
+        if (type->flags & TYPE_HAS_SCOOP)
+            *flags |= TYPE_HAS_SCOOP;
+    }
 
-    return call_var;
+    return type;
 }
 
-/* This dynaloads an enum that is represented by 'seed' with 'import' as the
-   context. The result of this is the enum class that was dynaloaded. */
-static lily_class *dynaload_enum(lily_parse_state *parser, lily_module_entry *m,
-        int dyna_index)
+static lily_type *type_from_desc(lily_parse_state *parser, const char **desc)
 {
-    const char **table = m->dynaload_table;
-    const char *entry = table[dyna_index];
-    const char *name = entry + DYNA_NAME_OFFSET;
-    int entry_index = dyna_index;
-
-    lily_msgbuf *msgbuf = parser->msgbuf;
-    lily_mb_flush(msgbuf);
-    lily_mb_add(msgbuf, name);
-    lily_mb_add(msgbuf, name + strlen(name) + 1);
-    lily_mb_add_char(msgbuf, '{');
+    const char *d = *desc;
+    lily_type *result;
+    int count, i;
 
-    do {
-        entry_index++;
-        entry = table[entry_index];
-    } while (entry[0] != 'V');
+    if (d[0] == '(') {
+        int flags = 0;
 
-    int is_scoped = entry[0] != 'V';
+        count = (unsigned char)d[1];
+        *desc = d + 2;
+
+        if (**desc == '-') {
+            *desc += 1;
+            result = lily_unit_type;
+        }
+        else
+            result = type_from_desc(parser, desc);
+
+        lily_tm_add(parser->tm, result);
+
+        for (i = 0;i < count;i++)
+            lily_tm_add(parser->tm, arg_from_desc(parser, desc, &flags));
+
+        result = lily_tm_make(parser->tm, flags,
+                parser->symtab->function_class, count + 1);
+    }
+    else if (d[0] == '[') {
+        const char *name = d + 2;
+        lily_class *cls = find_or_dl_class(parser, NULL, name);
+
+        count = (unsigned char)d[1];
+        *desc = name + strlen(name) + 1;
+
+        for (i = 0;i < count;i++)
+            lily_tm_add(parser->tm, type_from_desc(parser, desc));
+
+        result = lily_tm_make(parser->tm, 0, cls, count);
+        ensure_valid_type(parser, result);
+    }
+    else if (d[0] == '$') {
+        *desc = d + 2;
+        result = get_scoop_class(parser, d[1])->self_type;
+    }
+    else {
+        *desc = d + strlen(d) + 1;
+        result = find_or_dl_class(parser, NULL, d)->self_type;
+    }
+
+    return result;
+}
+
+/* This gets the type of a dynaload entry's body. Functions are given their
+   generics here, so the caller must have hidden the generics in scope. */
+static lily_type *type_from_dyna_body(lily_parse_state *parser,
+        lily_module_entry *m, const char *body, int is_function)
+{
+    if ((m->flags & MODULE_HAS_DESCRIPTORS) == 0) {
+        if (is_function)
+            return function_type_from_proto(parser, body);
+        else
+            return type_by_name(parser, body);
+    }
+
+    const char *desc = body + strlen(body) + 1;
+
+    if (is_function) {
+        int count = (unsigned char)desc[0];
+        char name[] = {'A', '\0'};
+        int i;
+
+        for (i = 0;i < count;i++) {
+            lily_gp_push(parser->generics, name, i);
+            name[0]++;
+        }
+
+        if (count)
+            lily_ts_generics_seen(parser->emit->ts, count);
+
+        desc++;
+    }
+
+    return type_from_desc(parser, &desc);
+}
+
+
+static lily_var *dynaload_function(lily_parse_state *parser,
+        lily_module_entry *m, lily_class *cls, int dyna_index)
+{
+    lily_var *call_var;
+
+    const char *entry = m->dynaload_table[dyna_index];
+    const char *name = entry + DYNA_NAME_OFFSET;
+    const char *body = name + strlen(name) + 1;
+
+    lily_module_entry *save_active = parser->symtab->active_module;
+
+    lily_item *source;
+    if (cls == NULL)
+        source = (lily_item *)m;
+    else
+        source = (lily_item *)cls;
+
+    lily_foreign_func func;
+
+    if (m->loader)
+        func = (lily_foreign_func)m->loader(parser->vm, dyna_index);
+    else {
+        lily_msgbuf *msgbuf = parser->msgbuf;
+        lily_mb_flush(msgbuf);
+
+        char *cls_name = "";
+        const char *search_name = name;
+
+        /* Constructors use <new> as their name to hide it. */
+        if (search_name[0] == '<')
+            search_name = "new";
+
+        if (cls)
+            cls_name = cls->name;
+
+        func = (lily_foreign_func)lily_library_get(m->handle,
+                lily_mb_sprintf(msgbuf, "lily_%s_%s_%s", m->loadname, cls_name,
+                search_name));
+    }
+
+    parser->symtab->active_module = m;
+    int save_generic_start;
+    lily_gp_save_and_hide(parser->generics, &save_generic_start);
+
+    lily_type *type = type_from_dyna_body(parser, m, body, 1);
+
+    call_var = lily_emit_new_tied_dyna_var(parser->emit, func, source, type,
+            name);
+
+    lily_gp_restore_and_unhide(parser->generics, save_generic_start);
+
+    parser->symtab->active_module = save_active;
+
+    return call_var;
+}
+
+/* This dynaloads an enum that is represented by 'seed' with 'import' as the
+   context. The result of this is the enum class that was dynaloaded. */
+static lily_class *dynaload_enum(lily_parse_state *parser, lily_module_entry *m,
+        int dyna_index)
+{
+    const char **table = m->dynaload_table;
+    const char *entry = table[dyna_index];
+    const char *name = entry + DYNA_NAME_OFFSET;
+    int entry_index = dyna_index;
+
+    lily_msgbuf *msgbuf = parser->msgbuf;
+    lily_mb_flush(msgbuf);
+    lily_mb_add(msgbuf, name);
+    lily_mb_add(msgbuf, name + strlen(name) + 1);
+    lily_mb_add_char(msgbuf, '{');
+
+    do {
+        entry_index++;
+        entry = table[entry_index];
+    } while (entry[0] != 'V');
+
+    int is_scoped = entry[0] != 'V';
 
     while (entry[0] == 'V') {
         name = entry + DYNA_NAME_OFFSET;
@@ -1576,11 +2151,9 @@ static lily_class *dynaload_native(lily_parse_state *parser,
         const char *prop_name = entry + DYNA_NAME_OFFSET;
         const char *prop_body = prop_name + strlen(prop_name) + 1;
 
-        lily_load_source(lex, et_shallow_string, prop_body);
-        lily_lexer(lex);
-        lily_add_class_property(parser->symtab, cls, get_type(parser),
-                prop_name, flags);
-        lily_pop_lex_entry(lex);
+        lily_add_class_property(parser->symtab, cls,
+                type_from_dyna_body(parser, m, prop_body, 0), prop_name,
+                flags);
 
         entry_index++;
         entry = table[entry_index];
@@ -1612,7 +2185,8 @@ static lily_item *run_dynaload(lily_parse_state *parser, lily_module_entry *m,
            create vars of a type not found in the interpreter's core. However,
            if that changes, this must change as well. */
         const char *name = entry + DYNA_NAME_OFFSET;
-        lily_type *var_type = type_by_name(parser, name + strlen(name) + 1);
+        lily_type *var_type = type_from_dyna_body(parser, m,
+                name + strlen(name) + 1, 0);
         lily_var *new_var = lily_emit_new_dyna_var(parser->emit, m, var_type,
                 name);
 
@@ -1667,23 +2241,48 @@ static lily_item *run_dynaload(lily_parse_state *parser, lily_module_entry *m,
     return result;
 }
 
-static lily_item *try_toplevel_dynaload(lily_parse_state *parser,
-        lily_module_entry *m, const char *name)
+/* The toplevel entries of a dynaload table are indexed by name the first time
+   the table is searched. Each item is the spot in the table of that entry.
+   Entries go in last to first, so that the first one wins any tie. */
+static lily_symbol_index *build_dynaload_index(const char **table)
 {
+    lily_symbol_index *si = lily_new_symbol_index();
+    uint32_t count = 0;
     int i = 1;
-    const char **table = m->dynaload_table;
-    const char *entry = table[i];
-    lily_item *result = NULL;
 
     do {
-        if (strcmp(entry + DYNA_NAME_OFFSET, name) == 0) {
-            result = run_dynaload(parser, m, i);
-            break;
-        }
+        count++;
+        i += (unsigned char)table[i][1] + 1;
+    } while (table[i][0] != 'Z');
+
+    lily_index_entry *entries = lily_si_reserve(si, count);
+    uint32_t j = count;
+
+    i = 1;
+
+    do {
+        j--;
+        entries[j].item = (void *)&table[i];
+        entries[j].name = table[i] + DYNA_NAME_OFFSET;
+        i += (unsigned char)table[i][1] + 1;
+    } while (table[i][0] != 'Z');
+
+    lily_si_commit(si, count);
+    return si;
+}
+
+static lily_item *try_toplevel_dynaload(lily_parse_state *parser,
+        lily_module_entry *m, const char *name)
+{
+    if (m->dynaload_index == NULL)
+        m->dynaload_index = build_dynaload_index(m->dynaload_table);
+
+    const char **spot = lily_si_find(m->dynaload_index, name,
+            lily_hash_name(name), 0);
+    lily_item *result = NULL;
 
-        i += (unsigned char)entry[1] + 1;
-        entry = table[i];
-    } while (entry[0] != 'Z');
+    if (spot)
+        result = run_dynaload(parser, m, (int)(spot - m->dynaload_table));
 
     return result;
 }
@@ -1749,32 +2348,26 @@ static uint64_t shorthash_for_name(const char *name)
 
 static int constant_by_name(const char *name)
 {
-    int i;
     uint64_t shorthash = shorthash_for_name(name);
+    int id = constant_slots[(shorthash * CONST_HASH_MULT) >> CONST_HASH_SHIFT];
 
-    for (i = 0;i <= CONST_LAST_ID;i++) {
-        if (constants[i].shorthash == shorthash &&
-            strcmp(constants[i].name, name) == 0)
-            return i;
-        else if (constants[i].shorthash > shorthash)
-            break;
-    }
+    if (id != -1 &&
+        constants[id].shorthash == shorthash &&
+        strcmp(constants[id].name, name) == 0)
+        return id;
 
     return -1;
 }
 
 static int keyword_by_name(const char *name)
 {
-    int i;
     uint64_t shorthash = shorthash_for_name(name);
+    int id = keyword_slots[(shorthash * KEY_HASH_MULT) >> KEY_HASH_SHIFT];
 
-    for (i = 0;i <= KEY_LAST_ID;i++) {
-        if (keywords[i].shorthash == shorthash &&
-            strcmp(keywords[i].name, name) == 0)
-            return i;
-        else if (keywords[i].shorthash > shorthash)
-            break;
-    }
+    if (id != -1 &&
+        keywords[id].shorthash == shorthash &&
+        strcmp(keywords[id].name, name) == 0)
+        return id;
 
     return -1;
 }
@@ -3527,7 +4120,30 @@ static void run_loaded_module(lily_parse_state *parser,
     lily_emit_leave_block(parser->emit);
     lily_pop_lex_entry(parser->lex);
 
-    lily_emit_write_import_call(parser->emit, import_var);
+    /* Templates run their imports once, instead of every time they render. */
+    if (save_active == parser->template_module)
+        lily_u16_write_1(parser->template_imports, import_var->reg_spot);
+    /* A code cache replays the code of __main__, so the import call has to be
+       there for it. */
+    else if (parser->vm->options->lazy_imports &&
+             parser->cache == NULL &&
+             parser->compile_only == 0) {
+        /* Lazy imports run when one of their globals is first used. Vars
+           inside of blocks aren't in the chain, but only the module's own code
+           can reach those. */
+        lily_var *var_iter = module->var_chain;
+
+        lily_vm_add_lazy_import(parser->vm, import_var->reg_spot);
+
+        while (var_iter) {
+            if (var_iter->flags & VAR_IS_GLOBAL)
+                lily_vm_claim_global(parser->vm, var_iter->reg_spot);
+
+            var_iter = var_iter->next;
+        }
+    }
+    else
+        lily_emit_write_import_call(parser->emit, import_var->reg_spot);
 
     parser->symtab->active_module = save_active;
 }
@@ -3567,17 +4183,27 @@ static void import_handler(lily_parse_state *parser, int multi)
                     "A module named '%s' has already been imported here.",
                     search_start);
 
-        if (path_tail == NULL)
+        module = find_import_memo(parser, lex->label);
+
+        if (module == NULL && path_tail == NULL) {
             module = lily_find_registered_module(symtab, lex->label);
+            if (module)
+                add_import_memo(parser, lex->label, module);
+        }
 
-        /* Is there a cached version that was loaded somewhere else? */
-        if (module == NULL) {
+        /* Is there a cached version that was loaded somewhere else? After
+           this, module is never NULL: load_module raises on error. */
+        if (module == NULL)
             module = load_module(parser, lex->label);
-            /* module is never NULL: load_module raises on error. */
-            if (module->flags & MODULE_NOT_EXECUTED) {
-                module->flags &= ~MODULE_NOT_EXECUTED;
-                run_loaded_module(parser, module);
-            }
+
+        if (module->flags & MODULE_NOT_EXECUTED) {
+            module->flags &= ~MODULE_NOT_EXECUTED;
+
+            /* Registered sources haven't been given to the lexer yet. */
+            if (module->source)
+                lily_load_source(lex, et_shallow_string, module->source);
+
+            run_loaded_module(parser, module);
         }
 
         lily_lexer(parser->lex);
@@ -4422,11 +5048,21 @@ static void protected_handler(lily_parse_state *parser, int multi)
     parse_modifier(parser, "protected", SYM_SCOPE_PROTECTED);
 }
 
+/* This runs before each pass (for templates, each ?>). Each step only looks at
+   what's new since the last pass: Classes not yet registered, cid tables that
+   aren't full, and dynaloaded values not yet loaded. */
 static void setup_and_exec_vm(lily_parse_state *parser)
 {
-    /* todo: Find a way to do some of this as-needed, instead of always. */
     lily_register_classes(parser->symtab, parser->vm);
     lily_prepare_main(parser->emit);
+
+    if (parser->cache) {
+        lily_function_val *f = parser->symtab->main_function;
+        /* Leave off o_return_from_vm, since replay will prepare main too. */
+        lily_cache_add_code(parser->cache, f->code, f->code_len - 1,
+                f->reg_count);
+    }
+
     lily_vm_prep(parser->vm, parser->symtab,
             parser->symtab->literals->data, parser->foreign_values);
 
@@ -4465,6 +5101,9 @@ static void parser_loop(lily_parse_state *parser, const char *filename)
                            "Unterminated block(s) at end of parsing.");
             }
 
+            if (parser->compile_only)
+                break;
+
             setup_and_exec_vm(parser);
 
             if (lex->token == tk_end_tag) {
@@ -4499,12 +5138,39 @@ static void parser_loop(lily_parse_state *parser, const char *filename)
     }
 }
 
+static void sink_render(const char *text, void *data)
+{
+    lily_sink_add((lily_sink *)data, text, strlen(text));
+}
+
+/* Options can't change after the first pass, so this is where lexer is told
+   where content goes. */
+static void setup_output(lily_parse_state *parser)
+{
+    lily_options *options = parser->options;
+    lily_lex_state *lex = parser->lex;
+
+    if (options->flush_func) {
+        lily_sink *sink = lily_new_sink(options->flush_func, options->data,
+                options->flush_size);
+
+        parser->vm->sink = sink;
+        lex->render_func = sink_render;
+        lex->data = sink;
+    }
+    else {
+        lex->render_func = options->render_func;
+        lex->data = options->data;
+    }
+}
+
 static void fix_first_file_name(lily_parse_state *parser,
         const char *filename)
 {
     parser->main_module->const_path = filename;
     set_module_names_by_path(parser->main_module, filename);
     parser->first_pass = 0;
+    setup_output(parser);
 }
 
 /* This is called when the interpreter encounters an error. This builds an
@@ -4579,100 +5245,1383 @@ static void build_error(lily_parse_state *parser)
     }
 }
 
-static int parse_file(lily_parse_state *parser, const char *filename)
-{
-    if (parser->first_pass)
-        fix_first_file_name(parser, filename);
+/***
+ *       ____           _
+ *      / ___|__ _  ___| |__   ___
+ *     | |   / _` |/ __| '_ \ / _ \
+ *     | |__| (_| | (__| | | |  __/
+ *      \____\__,_|\___|_| |_|\___|
+ *
+ */
 
-    handle_rewind(parser);
+/** A code cache lets a file skip lexing, parsing, and emitting when it's run
+    again. The cache is made from the first file a state processes, once it has
+    run through without error. It holds the readonly table (literals and
+    functions), the code that __main__ ran on each pass, and content that was
+    rendered between those passes.
 
-    /* It is safe to do this, because the parser will always occupy the first
-       jump. All others should use lily_jump_setup instead. */
-    if (setjmp(parser->raiser->all_jumps->jump) == 0) {
-        char *suffix = strrchr(filename, '.');
-        if (suffix == NULL || strcmp(suffix, ".lily") != 0)
-            lily_raise_err(parser->raiser, "File name must end with '.lily'.");
+    Readonly functions from libraries can't be written out, so the cache holds
+    their names instead. Replaying a cache dynaloads those again in the same
+    order. Since the state is fresh each time, that puts everything into the
+    same readonly spot, class id, and global register as before. Replay checks
+    that this happens. If it doesn't, what the cache loaded is dropped and the
+    file is parsed instead.
 
-        lily_load_source(parser->lex, et_file, filename);
-        parser_loop(parser, filename);
-        lily_pop_lex_entry(parser->lex);
-        lily_mb_flush(parser->msgbuf);
+    Libraries are loaded again by path, and checked for changes like sources
+    are. Classes, enums, and variants declared in Lily code are written out with
+    their members and the types those members have. They're made again in order
+    of their ids, each one when the next class id is theirs. That lets the
+    dynaloads between them take the ids that they had before. **/
 
-        return 1;
-    }
-    else
-        parser->rs->pending = 1;
+static void cache_render(const char *text, void *data)
+{
+    lily_parse_state *parser = (lily_parse_state *)data;
 
-    return 0;
+    lily_cache_add_text(parser->cache, text);
+    parser->cache_render_func(text, parser->cache_render_data);
 }
 
-static int parse_string(lily_parse_state *parser, const char *name, char *str)
+static void start_cache_record(lily_parse_state *parser)
 {
-    if (parser->first_pass)
-        fix_first_file_name(parser, name);
+    lily_lex_state *lex = parser->lex;
 
-    handle_rewind(parser);
+    parser->cache = lily_new_code_cache();
+    parser->cache->literal_start = lily_vs_pos(parser->symtab->literals);
+    parser->cache_render_func = lex->render_func;
+    parser->cache_render_data = lex->data;
 
-    if (setjmp(parser->raiser->all_jumps->jump) == 0) {
-        lily_load_source(parser->lex, et_shallow_string, str);
-        parser_loop(parser, name);
-        lily_pop_lex_entry(parser->lex);
-        lily_mb_flush(parser->msgbuf);
-        return 1;
+    lex->render_func = cache_render;
+    lex->data = parser;
+}
+
+static void stop_cache_record(lily_parse_state *parser)
+{
+    lily_lex_state *lex = parser->lex;
+
+    lex->render_func = parser->cache_render_func;
+    lex->data = parser->cache_render_data;
+
+    lily_free_code_cache(parser->cache);
+    parser->cache = NULL;
+}
+
+static uint16_t module_index(lily_parse_state *parser, lily_module_entry *m)
+{
+    lily_module_entry *module_iter = parser->module_start;
+    uint16_t result = 0;
+
+    while (module_iter != m) {
+        module_iter = module_iter->root_next;
+        result++;
     }
-    else
-        parser->rs->pending = 1;
 
-    return 0;
+    return result;
 }
 
-int lily_parse_file(lily_state *s, const char *name)
+static int class_is_from_source(lily_class *class_iter)
 {
-    lily_set_in_template(s->parser->lex, 0);
-    return parse_file(s->parser, name);
+    while (class_iter) {
+        if (class_iter->module &&
+            class_iter->module->dynaload_table == NULL)
+            return 1;
+
+        class_iter = class_iter->next;
+    }
+
+    return 0;
 }
 
-int lily_parse_string(lily_state *s, const char *name, const char *str)
+static int compare_symbols(const void *a, const void *b)
 {
-    lily_set_in_template(s->parser->lex, 0);
-    return parse_string(s->parser, name, (char *)str);
+    const lily_cache_symbol *left = (const lily_cache_symbol *)a;
+    const lily_cache_symbol *right = (const lily_cache_symbol *)b;
+
+    /* Classes go first (vars may need them), then both sorted by id. */
+    if (left->flags != right->flags)
+        return (int)left->flags - (int)right->flags;
+
+    return (int)left->id - (int)right->id;
 }
 
-int lily_parse_expr(lily_state *s, const char *name, char *str,
-        const char **text)
+static int capture_modules(lily_parse_state *parser)
 {
-    if (text)
-        *text = NULL;
+    lily_code_cache *cache = parser->cache;
+    lily_module_entry *module_iter;
+    int count = 0;
 
-    lily_set_in_template(s->parser->lex, 0);
+    for (module_iter = parser->module_start;
+         module_iter;
+         module_iter = module_iter->root_next) {
+        count++;
+    }
 
-    lily_parse_state *parser = s->parser;
-    if (parser->first_pass)
-        fix_first_file_name(parser, name);
+    cache->modules = lily_malloc(count * sizeof(lily_cache_module));
+    cache->module_count = count;
 
-    handle_rewind(parser);
+    for (count = 0, module_iter = parser->module_start;
+         module_iter;
+         count++, module_iter = module_iter->root_next) {
+        lily_cache_module *m = &cache->modules[count];
 
-    if (setjmp(parser->raiser->all_jumps->jump) == 0) {
-        lily_lex_state *lex = parser->lex;
-        lily_load_source(lex, et_shallow_string, str);
-        lily_lexer(lex);
+        m->path = module_iter->path;
+        m->has_source = (module_iter->dynaload_table == NULL);
+        m->is_library = (module_iter->handle != NULL);
+        if ((m->has_source || m->is_library) &&
+            lily_cache_stamp(m->path, &m->mtime, &m->size) == 0)
+            return 0;
+    }
 
-        expression(parser);
-        lily_emit_eval_expr(parser->emit, parser->expr);
-        NEED_CURRENT_TOK(tk_eof);
+    return 1;
+}
 
-        lily_sym *sym = parser->expr->root->result;
+static int capture_literals(lily_parse_state *parser)
+{
+    lily_code_cache *cache = parser->cache;
+    lily_value_stack *literals = parser->symtab->literals;
+    uint32_t start = cache->literal_start;
+    uint32_t i, count = lily_vs_pos(literals) - start;
 
-        setup_and_exec_vm(parser);
-        lily_pop_lex_entry(parser->lex);
+    cache->literals = lily_malloc((count + 1) * sizeof(lily_cache_literal));
+    cache->literal_count = count;
 
-        if (sym && text) {
-            /* This grabs the symbol from __main__. */
-            lily_value *reg = s->call_chain->next->locals[sym->reg_spot];
-            lily_msgbuf *msgbuf = parser->msgbuf;
+    for (i = 0;i < count;i++) {
+        lily_value *v = lily_vs_nth(literals, start + i);
+        lily_cache_literal *lit = &cache->literals[i];
 
-            lily_mb_flush(msgbuf);
-            lily_mb_add_fmt(msgbuf, "(^T): ", sym->type);
+        lit->flags = 0;
+        lit->module = 0;
+        lit->reg_count = 0;
+        lit->size = 0;
+        lit->line_num = 0;
+        lit->class_name = NULL;
+        lit->name = NULL;
+
+        switch (v->class_id) {
+            case LILY_INTEGER_ID:
+                lit->kind = cache_integer;
+                lit->integer = v->value.integer;
+                break;
+            case LILY_DOUBLE_ID:
+                lit->kind = cache_double;
+                lit->doubleval = v->value.doubleval;
+                break;
+            case LILY_STRING_ID:
+                lit->kind = cache_string;
+                lit->text = v->value.string->string;
+                lit->size = v->value.string->size;
+                break;
+            case LILY_BYTESTRING_ID:
+                lit->kind = cache_bytestring;
+                lit->text = v->value.string->string;
+                lit->size = v->value.string->size;
+                break;
+            case LILY_FUNCTION_ID: {
+                lily_function_val *f = v->value.function;
+
+                lit->module = module_index(parser, f->module);
+                lit->name = f->trace_name;
+
+                if (f->foreign_func) {
+                    lit->kind = cache_foreign;
+                    lit->class_name = f->class_name;
+                }
+                else {
+                    lit->kind = cache_native;
+                    lit->code = f->code;
+                    lit->size = f->code_len;
+                    lit->reg_count = f->reg_count;
+                    lit->line_num = f->line_num;
+                }
+                break;
+            }
+            default:
+                return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* Types are shared, so each one is written once. 'seen' holds the types that
+   have been written, in the order of their indexes. */
+typedef struct {
+    lily_type **seen;
+    uint32_t type_size;
+    uint32_t arg_size;
+    uint32_t class_size;
+    uint32_t member_size;
+    int ok;
+} lily_cache_builder;
+
+static uint16_t capture_type(lily_parse_state *parser, lily_cache_builder *b,
+        lily_type *type)
+{
+    lily_code_cache *cache = parser->cache;
+    uint32_t i;
+
+    if (type == NULL)
+        return CACHE_NO_TYPE;
+
+    for (i = 0;i < cache->type_count;i++) {
+        if (b->seen[i] == type)
+            return (uint16_t)i;
+    }
+
+    lily_class *cls = type->cls;
+    uint32_t cache_flags = 0;
+    uint16_t count = type->subtype_count;
+    uint16_t *args = NULL;
+
+    if (type == (lily_type *)cls)
+        cache_flags = CACHE_TYPE_IS_CLASS;
+    else if (cls->id == LILY_GENERIC_ID) {
+        if (type != cls->self_type || type->generic_pos >= 26)
+            b->ok = 0;
+    }
+    else if (count == 0)
+        /* Nothing else can be made again from a class and flags. */
+        b->ok = 0;
+
+    if (cls->id != LILY_GENERIC_ID && count) {
+        args = lily_malloc(count * sizeof(uint16_t));
+
+        for (i = 0;i < count;i++)
+            args[i] = capture_type(parser, b, type->subtypes[i]);
+    }
+
+    if (cache->type_count == CACHE_NO_TYPE)
+        b->ok = 0;
+
+    if (b->ok == 0) {
+        lily_free(args);
+        return CACHE_NO_TYPE;
+    }
+
+    if (cache->type_count == b->type_size) {
+        b->type_size *= 2;
+        b->seen = lily_realloc(b->seen, b->type_size * sizeof(lily_type *));
+        cache->types = lily_realloc(cache->types,
+                b->type_size * sizeof(lily_cache_type));
+    }
+
+    if (cache->type_arg_count + count > b->arg_size) {
+        while (cache->type_arg_count + count > b->arg_size)
+            b->arg_size *= 2;
+
+        cache->type_args = lily_realloc(cache->type_args,
+                b->arg_size * sizeof(uint16_t));
+    }
+
+    lily_cache_type *t = &cache->types[cache->type_count];
+
+    t->class_id = cls->id;
+    t->flags = type->flags & ~(TYPE_IS_UNRESOLVED | TYPE_IS_INCOMPLETE |
+            TYPE_HAS_SCOOP);
+    t->generic_pos = type->generic_pos;
+    t->subtype_count = 0;
+    t->subtype_start = cache->type_arg_count;
+    t->cache_flags = cache_flags;
+
+    if (args) {
+        memcpy(cache->type_args + cache->type_arg_count, args,
+                count * sizeof(uint16_t));
+        cache->type_arg_count += count;
+        t->subtype_count = count;
+        lily_free(args);
+    }
+
+    b->seen[cache->type_count] = type;
+    cache->type_count++;
+    return (uint16_t)(cache->type_count - 1);
+}
+
+static void capture_member(lily_parse_state *parser, lily_cache_builder *b,
+        lily_named_sym *sym)
+{
+    lily_code_cache *cache = parser->cache;
+    uint32_t start = cache->literal_start;
+
+    if (cache->member_count == b->member_size) {
+        b->member_size *= 2;
+        cache->members = lily_realloc(cache->members,
+                b->member_size * sizeof(lily_cache_member));
+    }
+
+    lily_cache_member *m = &cache->members[cache->member_count];
+
+    m->name = sym->name;
+    m->item_kind = sym->item_kind;
+    m->flags = sym->flags;
+    m->type = capture_type(parser, b, sym->type);
+    m->pad = 0;
+    cache->member_count++;
+
+    if (sym->item_kind == ITEM_TYPE_PROPERTY)
+        m->spot = ((lily_prop_entry *)sym)->id;
+    else {
+        m->spot = sym->reg_spot;
+
+        /* Methods have to be native functions made by this file. */
+        if (m->spot < start ||
+            m->spot - start >= cache->literal_count ||
+            cache->literals[m->spot - start].kind != cache_native)
+            b->ok = 0;
+        else
+            cache->literals[m->spot - start].flags |= CACHE_IS_METHOD;
+    }
+}
+
+/* Variants don't know their module, so it's kept alongside. */
+typedef struct {
+    lily_class *cls;
+    uint16_t module;
+} lily_cache_class_entry;
+
+static void capture_class(lily_parse_state *parser, lily_cache_builder *b,
+        lily_cache_class_entry *entry)
+{
+    lily_class *cls = entry->cls;
+    lily_code_cache *cache = parser->cache;
+
+    if (cache->class_count == b->class_size) {
+        b->class_size *= 2;
+        cache->classes = lily_realloc(cache->classes,
+                b->class_size * sizeof(lily_cache_class));
+    }
+
+    lily_cache_class *c = &cache->classes[cache->class_count];
+
+    cache->class_count++;
+    c->name = cls->name;
+    c->module = entry->module;
+    c->id = cls->id;
+    c->item_kind = cls->item_kind;
+    c->flags = cls->flags & ~CLS_VISITED;
+    c->parent_id = cls->parent ? cls->parent->id : 0;
+    c->member_count = 0;
+    c->member_start = cache->member_count;
+
+    if (cls->item_kind == ITEM_TYPE_VARIANT) {
+        lily_variant_class *variant = (lily_variant_class *)cls;
+
+        c->inherit_depth = 0;
+        c->generic_count = 0;
+        c->prop_count = 0;
+        c->type = capture_type(parser, b, variant->build_type);
+        return;
+    }
+
+    lily_named_sym *member_iter;
+
+    c->inherit_depth = cls->inherit_depth;
+    c->generic_count = cls->generic_count;
+    c->prop_count = cls->prop_count;
+    c->type = capture_type(parser, b, cls->self_type);
+
+    for (member_iter = cls->members;
+         member_iter;
+         member_iter = member_iter->next) {
+        capture_member(parser, b, member_iter);
+        c->member_count++;
+    }
+}
+
+static int compare_class_ids(const void *a, const void *b)
+{
+    /* Variants keep their id where classes do. */
+    const lily_cache_class_entry *left = (const lily_cache_class_entry *)a;
+    const lily_cache_class_entry *right = (const lily_cache_class_entry *)b;
+
+    return (int)left->cls->id - (int)right->cls->id;
+}
+
+/* This writes out the classes that files declared, sorted by their ids. The
+   result is 0 if any of them can't be described. */
+static int capture_classes(lily_parse_state *parser)
+{
+    lily_code_cache *cache = parser->cache;
+    lily_module_entry *module_iter;
+    lily_cache_builder b;
+    lily_cache_class_entry *classes;
+    uint16_t index;
+    uint32_t count = 0, i;
+
+    for (module_iter = parser->module_start;
+         module_iter;
+         module_iter = module_iter->root_next) {
+        if (module_iter->dynaload_table)
+            continue;
+
+        lily_class *class_iter = module_iter->class_chain;
+
+        for (;class_iter;class_iter = class_iter->next) {
+            count++;
+            if (class_iter->item_kind != ITEM_TYPE_VARIANT &&
+                class_iter->flags & CLS_ENUM_IS_SCOPED)
+                count += class_iter->variant_size;
+        }
+    }
+
+    classes = lily_malloc((count + 1) * sizeof(lily_cache_class_entry));
+    count = 0;
+
+    for (index = 0, module_iter = parser->module_start;
+         module_iter;
+         index++, module_iter = module_iter->root_next) {
+        if (module_iter->dynaload_table)
+            continue;
+
+        lily_class *class_iter = module_iter->class_chain;
+
+        for (;class_iter;class_iter = class_iter->next) {
+            classes[count].cls = class_iter;
+            classes[count].module = index;
+            count++;
+
+            if (class_iter->item_kind != ITEM_TYPE_VARIANT &&
+                class_iter->flags & CLS_ENUM_IS_SCOPED) {
+                for (i = 0;i < class_iter->variant_size;i++) {
+                    classes[count].cls =
+                            (lily_class *)class_iter->variant_members[i];
+                    classes[count].module = index;
+                    count++;
+                }
+            }
+        }
+    }
+
+    qsort(classes, count, sizeof(lily_cache_class_entry), compare_class_ids);
+
+    b.type_size = 8;
+    b.arg_size = 8;
+    b.class_size = 4;
+    b.member_size = 8;
+    b.ok = 1;
+    b.seen = lily_malloc(b.type_size * sizeof(lily_type *));
+    cache->types = lily_malloc(b.type_size * sizeof(lily_cache_type));
+    cache->type_args = lily_malloc(b.arg_size * sizeof(uint16_t));
+    cache->classes = lily_malloc(b.class_size * sizeof(lily_cache_class));
+    cache->members = lily_malloc(b.member_size * sizeof(lily_cache_member));
+
+    for (i = 0;i < count && b.ok;i++)
+        capture_class(parser, &b, &classes[i]);
+
+    cache->next_class_id = parser->symtab->next_class_id;
+    lily_free(b.seen);
+    lily_free(classes);
+    return b.ok;
+}
+
+static void capture_names(lily_parse_state *parser)
+{
+    lily_code_cache *cache = parser->cache;
+    lily_module_entry *module_iter;
+    uint32_t start = cache->literal_start;
+    uint16_t index;
+    int count = 0;
+
+    for (module_iter = parser->module_start;
+         module_iter;
+         module_iter = module_iter->root_next) {
+        lily_class *class_iter = module_iter->class_chain;
+        lily_var *var_iter = module_iter->var_chain;
+
+        if (module_iter->dynaload_table == NULL) {
+            /* Toplevel defines must be found again for lily_get_func. */
+            for (;var_iter;var_iter = var_iter->next) {
+                if (var_iter->flags & VAR_IS_READONLY &&
+                    var_iter->reg_spot >= start)
+                    cache->literals[var_iter->reg_spot - start].flags |=
+                            CACHE_IS_VISIBLE;
+            }
+            continue;
+        }
+
+        for (;class_iter;class_iter = class_iter->next)
+            count++;
+
+        for (;var_iter;var_iter = var_iter->next) {
+            if (var_iter->flags & VAR_IS_GLOBAL)
+                count++;
+        }
+    }
+
+    cache->symbols = lily_malloc((count + 1) * sizeof(lily_cache_symbol));
+    cache->symbol_count = count;
+    count = 0;
+
+    for (index = 0, module_iter = parser->module_start;
+         module_iter;
+         index++, module_iter = module_iter->root_next) {
+        if (module_iter->dynaload_table == NULL)
+            continue;
+
+        lily_class *class_iter = module_iter->class_chain;
+        lily_var *var_iter = module_iter->var_chain;
+
+        for (;class_iter;class_iter = class_iter->next) {
+            lily_cache_symbol *sym = &cache->symbols[count];
+
+            sym->name = class_iter->name;
+            sym->module = index;
+            sym->id = class_iter->id;
+            sym->flags = 0;
+            count++;
+        }
+
+        for (;var_iter;var_iter = var_iter->next) {
+            if ((var_iter->flags & VAR_IS_GLOBAL) == 0)
+                continue;
+
+            lily_cache_symbol *sym = &cache->symbols[count];
+
+            sym->name = var_iter->name;
+            sym->module = index;
+            sym->id = var_iter->reg_spot;
+            sym->flags = CACHE_IS_VAR;
+            count++;
+        }
+    }
+
+    qsort(cache->symbols, count, sizeof(lily_cache_symbol), compare_symbols);
+}
+
+/* This is called after the first file has been processed without error. If
+   everything that was loaded can be described, it's written as a cache. */
+static void save_code_cache(lily_parse_state *parser, const char *filename)
+{
+    lily_symtab *symtab = parser->symtab;
+
+    if (capture_modules(parser) &&
+        class_is_from_source(symtab->old_class_chain) == 0 &&
+        class_is_from_source(symtab->hidden_class_chain) == 0 &&
+        capture_literals(parser) &&
+        capture_classes(parser)) {
+        char *path = lily_code_cache_path(parser->options->cache_dir,
+                filename);
+
+        capture_names(parser);
+        parser->cache->global_count = symtab->next_global_id;
+
+        /* A cache that can't be written is not an error: The file is simply
+           parsed again next time. */
+        lily_write_code_cache(parser->cache, path);
+        lily_free(path);
+    }
+
+    stop_cache_record(parser);
+}
+
+/* Before a cache changes anything, make sure that the modules it was made with
+   are present in the same order. Modules from source that aren't here yet will
+   be made. */
+static int cache_modules_match(lily_parse_state *parser,
+        lily_code_cache *cache)
+{
+    lily_module_entry *module_iter = parser->module_start;
+    int i;
+
+    if (cache->literal_start != lily_vs_pos(parser->symtab->literals))
+        return 0;
+
+    for (i = 0;i < cache->module_count;i++) {
+        lily_cache_module *m = &cache->modules[i];
+
+        if (module_iter == NULL) {
+            if (m->has_source == 0 && m->is_library == 0)
+                return 0;
+
+            continue;
+        }
+
+        const char *path = module_iter->path ? module_iter->path : "";
+
+        if (m->has_source != (module_iter->dynaload_table == NULL) ||
+            m->is_library != (module_iter->handle != NULL) ||
+            strcmp(m->path, path) != 0)
+            return 0;
+
+        module_iter = module_iter->root_next;
+    }
+
+    return module_iter == NULL;
+}
+
+static lily_var *load_cached_foreign(lily_parse_state *parser,
+        lily_module_entry *m, lily_cache_literal *lit)
+{
+    lily_item *result;
+
+    if (lit->class_name) {
+        lily_class *cls = lily_find_class(parser->symtab, m, lit->class_name);
+
+        if (cls == NULL)
+            cls = find_run_class_dynaload(parser, m, lit->class_name);
+
+        if (cls == NULL)
+            return NULL;
+
+        result = (lily_item *)lily_find_member(cls, lit->name);
+        if (result == NULL)
+            result = try_method_dynaload(parser, cls, lit->name);
+    }
+    else {
+        result = (lily_item *)lily_find_var(parser->symtab, m, lit->name);
+        if (result == NULL)
+            result = try_toplevel_dynaload(parser, m, lit->name);
+    }
+
+    if (result && result->item_kind != ITEM_TYPE_VAR)
+        result = NULL;
+
+    return (lily_var *)result;
+}
+
+/* This is what a cache needs while it's being loaded. */
+typedef struct {
+    lily_code_cache *cache;
+    /* The modules of the cache, in the order of the cache. */
+    lily_module_entry **modules;
+    /* Classes made from the cache, in the order of the cache. */
+    lily_class **made;
+    /* Methods are made before their class may exist. They're held here (by
+       their spot, less literal_start) until they can be put into it. */
+    lily_var **methods;
+    /* The next class in the cache to make. */
+    uint32_t next_class;
+    uint32_t pad;
+} lily_cache_loader;
+
+static lily_class *made_class_by_id(lily_cache_loader *ld, uint16_t id)
+{
+    uint32_t i;
+
+    for (i = 0;i < ld->next_class;i++) {
+        if (ld->cache->classes[i].id == id)
+            return ld->made[i];
+    }
+
+    return NULL;
+}
+
+/* Flat variants are left with their enum's module, but scoped variants go
+   into their enum. Either way, the enum is finished once every variant is
+   there. The result is 0 if something else got between the variants. */
+static int finish_cached_variant(lily_parse_state *parser,
+        lily_cache_loader *ld, lily_class *enum_cls)
+{
+    lily_symtab *symtab = parser->symtab;
+    lily_class *class_iter = symtab->active_module->class_chain;
+    lily_cache_class *enum_rec = NULL;
+    uint16_t count = 0;
+    uint32_t i;
+
+    for (i = 0;i < ld->next_class;i++) {
+        if (ld->made[i] == enum_cls)
+            enum_rec = &ld->cache->classes[i];
+    }
+
+    while (class_iter != enum_cls) {
+        if (class_iter->item_kind != ITEM_TYPE_VARIANT ||
+            class_iter->parent != enum_cls)
+            return 0;
+
+        count++;
+        class_iter = class_iter->next;
+    }
+
+    if (count == enum_rec->prop_count)
+        lily_finish_enum(symtab, enum_cls,
+                !!(enum_rec->flags & CLS_ENUM_IS_SCOPED), NULL);
+
+    return 1;
+}
+
+static int make_cached_class(lily_parse_state *parser, lily_cache_loader *ld)
+{
+    lily_symtab *symtab = parser->symtab;
+    lily_cache_class *c = &ld->cache->classes[ld->next_class];
+    lily_class *cls;
+    int ok = 1;
+
+    symtab->active_module = ld->modules[c->module];
+
+    if (c->item_kind == ITEM_TYPE_VARIANT) {
+        lily_class *enum_cls = made_class_by_id(ld, c->parent_id);
+
+        if (enum_cls == NULL || (enum_cls->flags & CLS_IS_ENUM) == 0) {
+            symtab->active_module = parser->main_module;
+            return 0;
+        }
+
+        cls = (lily_class *)lily_new_variant_class(symtab, enum_cls, c->name);
+        ld->made[ld->next_class] = cls;
+        ld->next_class++;
+        ok = finish_cached_variant(parser, ld, enum_cls);
+    }
+    else {
+        if (c->flags & CLS_IS_ENUM)
+            cls = lily_new_enum_class(symtab, c->name);
+        else
+            cls = lily_new_class(symtab, c->name);
+
+        ld->made[ld->next_class] = cls;
+        ld->next_class++;
+    }
+
+    symtab->active_module = parser->main_module;
+    return ok;
+}
+
+/* Classes from the cache are made when the next class id is theirs. Anything
+   dynaloaded in between gets the id that it had when the cache was made. */
+static int make_cached_classes(lily_parse_state *parser, lily_cache_loader *ld)
+{
+    lily_code_cache *cache = ld->cache;
+    lily_symtab *symtab = parser->symtab;
+
+    while (ld->next_class < cache->class_count &&
+           cache->classes[ld->next_class].id == symtab->next_class_id) {
+        if (make_cached_class(parser, ld) == 0)
+            return 0;
+    }
+
+    return 1;
+}
+
+static int load_cached_literal(lily_parse_state *parser, lily_cache_loader *ld,
+        lily_cache_literal *lit, uint32_t spot)
+{
+    lily_symtab *symtab = parser->symtab;
+    lily_module_entry *m = ld->modules[lit->module];
+    lily_var *var;
+
+    if (make_cached_classes(parser, ld) == 0)
+        return 0;
+
+    switch (lit->kind) {
+        case cache_integer:
+            lily_get_integer_literal(symtab, lit->integer);
+            break;
+        case cache_double:
+            lily_get_double_literal(symtab, lit->doubleval);
+            break;
+        case cache_string:
+            lily_get_string_literal(symtab, lit->text);
+            break;
+        case cache_bytestring:
+            lily_get_bytestring_literal(symtab, lit->text, lit->size);
+            break;
+        case cache_native:
+            symtab->active_module = m;
+            var = lily_emit_new_cached_define_var(parser->emit,
+                    parser->default_call_type, lit->name, lit->code, lit->size,
+                    lit->reg_count, lit->line_num);
+
+            if (lit->flags & CACHE_IS_VISIBLE) {
+                var->next = m->var_chain;
+                m->var_chain = var;
+            }
+            else {
+                /* Methods wait here until their class is finished. */
+                var->next = symtab->old_function_chain;
+                symtab->old_function_chain = var;
+
+                if (lit->flags & CACHE_IS_METHOD)
+                    ld->methods[spot - ld->cache->literal_start] = var;
+            }
+
+            symtab->active_module = parser->main_module;
+            break;
+        case cache_foreign:
+            var = load_cached_foreign(parser, m, lit);
+            if (var == NULL || var->reg_spot != spot)
+                return 0;
+            break;
+    }
+
+    return lily_vs_pos(symtab->literals) == spot + 1;
+}
+
+static int load_cached_symbol(lily_parse_state *parser, lily_cache_loader *ld,
+        lily_cache_symbol *sym)
+{
+    lily_symtab *symtab = parser->symtab;
+    lily_module_entry *m = ld->modules[sym->module];
+
+    if (make_cached_classes(parser, ld) == 0)
+        return 0;
+
+    if (sym->flags & CACHE_IS_VAR) {
+        lily_var *var = lily_find_var(symtab, m, sym->name);
+
+        if (var == NULL) {
+            /* Dynaloaded vars take the next global, so fix that first. */
+            symtab->next_global_id = sym->id;
+            var = (lily_var *)try_toplevel_dynaload(parser, m, sym->name);
+        }
+
+        return var && var->item_kind == ITEM_TYPE_VAR &&
+               var->reg_spot == sym->id;
+    }
+    else {
+        lily_class *cls = lily_find_class(symtab, m, sym->name);
+
+        if (cls == NULL)
+            cls = find_run_class_dynaload(parser, m, sym->name);
+
+        return cls && cls->id == sym->id;
+    }
+}
+
+/* Types can use any class that exists, so this makes a table of them by id.
+   Classes with special ids are found by cached_type_class. */
+static lily_class **cached_class_table(lily_parse_state *parser)
+{
+    uint32_t count = parser->symtab->next_class_id;
+    lily_class **table = lily_malloc((count + 1) * sizeof(lily_class *));
+    lily_module_entry *module_iter;
+
+    memset(table, 0, (count + 1) * sizeof(lily_class *));
+
+    for (module_iter = parser->module_start;
+         module_iter;
+         module_iter = module_iter->root_next) {
+        lily_class *class_iter = module_iter->class_chain;
+
+        /* Variants aren't types, so they're left out. */
+        for (;class_iter;class_iter = class_iter->next) {
+            if (class_iter->id < count &&
+                class_iter->item_kind != ITEM_TYPE_VARIANT)
+                table[class_iter->id] = class_iter;
+        }
+    }
+
+    return table;
+}
+
+static lily_class *cached_type_class(lily_parse_state *parser,
+        lily_class **table, uint16_t id)
+{
+    lily_symtab *symtab = parser->symtab;
+
+    if (id < symtab->next_class_id && id != LILY_UNIT_ID)
+        return table[id];
+
+    switch (id) {
+        case LILY_UNIT_ID:
+            return (lily_class *)lily_unit_type;
+        case LILY_SELF_ID:
+            return (lily_class *)lily_self_class;
+        case LILY_QUESTION_ID:
+            return symtab->question_class;
+        case LILY_OPTARG_ID:
+            return symtab->optarg_class;
+        case LILY_SCOOP_1_ID:
+            return get_scoop_class(parser, 1);
+        case LILY_SCOOP_2_ID:
+            return get_scoop_class(parser, 2);
+        default:
+            return NULL;
+    }
+}
+
+static lily_type *cached_generic_type(lily_parse_state *parser,
+        uint16_t generic_pos)
+{
+    lily_generic_pool *gp = parser->generics;
+    char name[2];
+    int save_end;
+
+    name[0] = (char)('A' + generic_pos);
+    name[1] = '\0';
+
+    /* Pushing the generic makes sure that it exists, and restoring the scope
+       after takes it back out. The class is kept by the pool. */
+    lily_gp_save(gp, &save_end);
+    lily_gp_push(gp, name, generic_pos);
+    lily_class *cls = lily_gp_find(gp, name);
+    lily_gp_restore(gp, save_end);
+
+    return cls->self_type;
+}
+
+/* This makes the types of the cache again. The result is NULL if one of them
+   uses a class that isn't here. */
+static lily_type **make_cached_types(lily_parse_state *parser,
+        lily_code_cache *cache, lily_class **table)
+{
+    lily_type **types = lily_malloc((cache->type_count + 1) *
+            sizeof(lily_type *));
+    lily_type_maker *tm = parser->tm;
+    uint32_t i, j;
+
+    for (i = 0;i < cache->type_count;i++) {
+        lily_cache_type *t = &cache->types[i];
+        lily_type *result;
+
+        if (t->class_id == LILY_GENERIC_ID) {
+            if (t->generic_pos >= 26)
+                break;
+
+            types[i] = cached_generic_type(parser, t->generic_pos);
+            continue;
+        }
+
+        lily_class *cls = cached_type_class(parser, table, t->class_id);
+
+        if (cls == NULL)
+            break;
+
+        if (t->cache_flags & CACHE_TYPE_IS_CLASS)
+            result = (lily_type *)cls;
+        else if (t->subtype_count == 0)
+            break;
+        else {
+            for (j = 0;j < t->subtype_count;j++) {
+                uint16_t index = cache->type_args[t->subtype_start + j];
+                lily_type *subtype = NULL;
+
+                if (index != CACHE_NO_TYPE)
+                    subtype = types[index];
+
+                lily_tm_add(tm, subtype);
+            }
+
+            result = lily_tm_make(tm, t->flags, cls, t->subtype_count);
+        }
+
+        types[i] = result;
+    }
+
+    if (i != cache->type_count) {
+        lily_free(types);
+        types = NULL;
+    }
+
+    return types;
+}
+
+static lily_type *cached_type(lily_type **types, uint16_t index)
+{
+    if (index == CACHE_NO_TYPE)
+        return NULL;
+
+    return types[index];
+}
+
+/* Methods have been waiting in the old functions until now. */
+static void take_cached_methods(lily_parse_state *parser,
+        lily_cache_loader *ld)
+{
+    lily_symtab *symtab = parser->symtab;
+    lily_var **var_iter = &symtab->old_function_chain;
+    uint32_t start = ld->cache->literal_start;
+    uint32_t count = ld->cache->literal_count;
+
+    while (*var_iter) {
+        lily_var *var = *var_iter;
+        uint32_t spot = var->reg_spot;
+
+        if (spot >= start && spot - start < count &&
+            ld->methods[spot - start] == var)
+            *var_iter = var->next;
+        else
+            var_iter = &var->next;
+    }
+}
+
+static void finish_cached_class(lily_parse_state *parser,
+        lily_cache_loader *ld, lily_type **types, lily_class **table,
+        uint32_t index)
+{
+    lily_code_cache *cache = ld->cache;
+    lily_cache_class *c = &cache->classes[index];
+    lily_class *cls = ld->made[index];
+    uint32_t i;
+
+    if (c->item_kind == ITEM_TYPE_VARIANT) {
+        lily_variant_class *variant = (lily_variant_class *)cls;
+
+        variant->flags = c->flags;
+        variant->build_type = cached_type(types, c->type);
+        return;
+    }
+
+    cls->item_kind = c->item_kind;
+    cls->flags = c->flags;
+    cls->inherit_depth = c->inherit_depth;
+    cls->generic_count = c->generic_count;
+    cls->self_type = cached_type(types, c->type);
+
+    if (c->parent_id)
+        cls->parent = cached_type_class(parser, table, c->parent_id);
+
+    /* Members are prepended, so go backward to keep their order. */
+    for (i = c->member_count;i > 0;i--) {
+        lily_cache_member *m = &cache->members[c->member_start + i - 1];
+        lily_type *type = cached_type(types, m->type);
+
+        if (m->item_kind == ITEM_TYPE_PROPERTY) {
+            cls->prop_count = (uint16_t)m->spot;
+            lily_add_class_property(parser->symtab, cls, type, m->name,
+                    m->flags);
+        }
+        else {
+            lily_var *var = ld->methods[m->spot - cache->literal_start];
+            lily_value *v = lily_vs_nth(parser->symtab->literals, m->spot);
+
+            var->type = type;
+            var->flags = m->flags;
+            var->parent = cls;
+            var->next = (lily_var *)cls->members;
+            cls->members = (lily_named_sym *)var;
+            v->value.function->class_name = cls->name;
+        }
+    }
+
+    cls->prop_count = c->prop_count;
+}
+
+/* Check everything that can go wrong before the classes are touched, so that
+   finishing them can't fail halfway. */
+static int cached_classes_fit(lily_parse_state *parser, lily_cache_loader *ld,
+        lily_class **table)
+{
+    lily_code_cache *cache = ld->cache;
+    uint32_t i, j;
+
+    for (i = 0;i < cache->class_count;i++) {
+        lily_cache_class *c = &cache->classes[i];
+
+        if (c->item_kind != ITEM_TYPE_VARIANT &&
+            c->parent_id &&
+            cached_type_class(parser, table, c->parent_id) == NULL)
+            return 0;
+
+        for (j = 0;j < c->member_count;j++) {
+            lily_cache_member *m = &cache->members[c->member_start + j];
+
+            if (m->item_kind == ITEM_TYPE_PROPERTY)
+                continue;
+
+            if (m->spot < cache->literal_start ||
+                m->spot - cache->literal_start >= cache->literal_count ||
+                ld->methods[m->spot - cache->literal_start] == NULL)
+                return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int finish_cached_classes(lily_parse_state *parser,
+        lily_cache_loader *ld)
+{
+    lily_code_cache *cache = ld->cache;
+    lily_class **table = cached_class_table(parser);
+    lily_type **types = NULL;
+    uint32_t i;
+    int ok = cached_classes_fit(parser, ld, table);
+
+    if (ok)
+        types = make_cached_types(parser, cache, table);
+
+    if (types) {
+        take_cached_methods(parser, ld);
+
+        for (i = 0;i < cache->class_count;i++)
+            finish_cached_class(parser, ld, types, table, i);
+    }
+    else
+        ok = 0;
+
+    lily_free(types);
+    lily_free(table);
+    return ok;
+}
+
+/* This brings everything in the cache into the symtab. The result is 0 if
+   something didn't land where it did when the cache was made. */
+static int load_cache_symbols(lily_parse_state *parser,
+        lily_code_cache *cache)
+{
+    lily_cache_loader ld;
+    lily_module_entry *module_iter = parser->module_start;
+    uint32_t i;
+    int ok = 1;
+
+    ld.cache = cache;
+    ld.modules = lily_malloc((cache->module_count + 1) *
+            sizeof(lily_module_entry *));
+    ld.made = lily_malloc((cache->class_count + 1) * sizeof(lily_class *));
+    ld.methods = lily_malloc((cache->literal_count + 1) * sizeof(lily_var *));
+    ld.next_class = 0;
+    ld.pad = 0;
+    memset(ld.methods, 0, (cache->literal_count + 1) * sizeof(lily_var *));
+
+    for (i = 0;i < cache->module_count;i++) {
+        lily_cache_module *m = &cache->modules[i];
+
+        if (module_iter) {
+            ld.modules[i] = module_iter;
+            module_iter = module_iter->root_next;
+            continue;
+        }
+
+        if (m->is_library) {
+            ld.modules[i] = load_library(parser, m->path);
+            if (ld.modules[i] == NULL) {
+                ok = 0;
+                break;
+            }
+        }
+        else
+            ld.modules[i] = new_module(parser, m->path, NULL);
+    }
+
+    for (i = 0;i < cache->literal_count && ok;i++)
+        ok = load_cached_literal(parser, &ld, &cache->literals[i],
+                cache->literal_start + i);
+
+    for (i = 0;i < cache->symbol_count && ok;i++)
+        ok = load_cached_symbol(parser, &ld, &cache->symbols[i]);
+
+    if (ok)
+        ok = make_cached_classes(parser, &ld);
+
+    if (ld.next_class != cache->class_count ||
+        parser->symtab->next_class_id != cache->next_class_id ||
+        lily_vs_pos(parser->symtab->literals) !=
+        cache->literal_start + cache->literal_count)
+        ok = 0;
+
+    if (ok)
+        ok = finish_cached_classes(parser, &ld);
+
+    parser->symtab->next_global_id = cache->global_count;
+    lily_free(ld.modules);
+    lily_free(ld.made);
+    lily_free(ld.methods);
+    return ok;
+}
+
+static void run_cache_segments(lily_parse_state *parser,
+        lily_code_cache *cache)
+{
+    lily_buffer_u16 *code = parser->emit->code;
+    lily_lex_state *lex = parser->lex;
+    uint32_t i;
+
+    for (i = 0;i < cache->segment_count;i++) {
+        lily_cache_segment *seg = &cache->segments[i];
+
+        if (seg->code == NULL) {
+            lex->render_func(seg->text, lex->data);
+            continue;
+        }
+
+        /* The o_return_from_vm at the end is written by lily_prepare_main. */
+        lily_u16_set_pos(code, 0);
+        lily_u16_write_prep(code, seg->size + 1);
+        memcpy(code->data, seg->code, seg->size * sizeof(uint16_t));
+        lily_u16_set_pos(code, seg->size);
+        parser->emit->main_block->next_reg_spot = seg->reg_count;
+
+        setup_and_exec_vm(parser);
+    }
+}
+
+/* A cache that doesn't match isn't an error, since the file can still be
+   parsed. This drops what was loaded from the cache before finding that out. */
+static void undo_cache_load(lily_parse_state *parser, lily_state_mark *mark)
+{
+    lily_rewind_state *rs = parser->rs;
+    lily_module_entry *main_module = parser->main_module;
+
+    /* This also drops any error that was raised. The mark will drop the new
+       symbols of the main module. */
+    rs->main_class_start = main_module->class_chain;
+    rs->main_var_start = main_module->var_chain;
+    rewind_parser(parser, rs);
+
+    flag_dead_symbols(parser, mark);
+    rewind_symbols(parser, mark);
+    rs->main_class_start = main_module->class_chain;
+    rs->main_var_start = main_module->var_chain;
+}
+
+/* This tries to run 'filename' through a cache of it. The result is 0 if there
+   is no usable cache, in which case nothing has been changed. */
+static int run_code_cache(lily_parse_state *parser, const char *filename)
+{
+    char *path = lily_code_cache_path(parser->options->cache_dir, filename);
+    lily_code_cache *cache = lily_read_code_cache(path);
+
+    lily_free(path);
+
+    if (cache == NULL || cache_modules_match(parser, cache) == 0) {
+        if (cache)
+            lily_free_code_cache(cache);
+
+        return 0;
+    }
+
+    lily_state_mark *mark = new_mark(parser);
+    int in_template = parser->lex->in_template;
+    int ok = 0;
+
+    /* Dynaloads go through the lexer. Without a file under them, template mode
+       would want them to start with a tag. */
+    lily_set_in_template(parser->lex, 0);
+
+    lily_jump_link *link = lily_jump_setup(parser->raiser);
+    if (setjmp(link->jump) == 0) {
+        ok = load_cache_symbols(parser, cache);
+        lily_release_jump(parser->raiser);
+    }
+    else
+        lily_release_jump(parser->raiser);
+
+    if (ok == 0) {
+        /* The cache will be written again once the file is parsed. */
+        undo_cache_load(parser, mark);
+        free_mark(mark);
+        lily_free_code_cache(cache);
+        lily_set_in_template(parser->lex, in_template);
+        return 0;
+    }
+
+    free_mark(mark);
+
+    link = lily_jump_setup(parser->raiser);
+    if (setjmp(link->jump) == 0) {
+        run_cache_segments(parser, cache);
+        lily_free_code_cache(cache);
+        lily_release_jump(parser->raiser);
+    }
+    else {
+        lily_free_code_cache(cache);
+        lily_jump_back(parser->raiser);
+    }
+
+    return 1;
+}
+
+static int parse_file(lily_parse_state *parser, const char *filename)
+{
+    /* Only the first file can be cached, since the cache is replayed against
+       a fresh state. */
+    int use_cache = (parser->first_pass && parser->options->cache_dir);
+
+    if (parser->first_pass)
+        fix_first_file_name(parser, filename);
+
+    handle_rewind(parser);
+
+    /* It is safe to do this, because the parser will always occupy the first
+       jump. All others should use lily_jump_setup instead. */
+    if (setjmp(parser->raiser->all_jumps->jump) == 0) {
+        char *suffix = strrchr(filename, '.');
+        if (suffix == NULL || strcmp(suffix, ".lily") != 0)
+            lily_raise_err(parser->raiser, "File name must end with '.lily'.");
+
+        if (use_cache) {
+            if (run_code_cache(parser, filename)) {
+                lily_mb_flush(parser->msgbuf);
+                return 1;
+            }
+
+            start_cache_record(parser);
+        }
+
+        lily_load_source(parser->lex, et_file, filename);
+        parser_loop(parser, filename);
+        lily_pop_lex_entry(parser->lex);
+        lily_mb_flush(parser->msgbuf);
+
+        if (parser->cache)
+            save_code_cache(parser, filename);
+
+        return 1;
+    }
+    else {
+        parser->rs->pending = 1;
+
+        if (parser->cache)
+            stop_cache_record(parser);
+    }
+
+    return 0;
+}
+
+static int parse_string(lily_parse_state *parser, const char *name, char *str)
+{
+    if (parser->first_pass)
+        fix_first_file_name(parser, name);
+
+    handle_rewind(parser);
+
+    if (setjmp(parser->raiser->all_jumps->jump) == 0) {
+        lily_load_source(parser->lex, et_shallow_string, str);
+        parser_loop(parser, name);
+        lily_pop_lex_entry(parser->lex);
+        lily_mb_flush(parser->msgbuf);
+        return 1;
+    }
+    else
+        parser->rs->pending = 1;
+
+    return 0;
+}
+
+int lily_parse_file(lily_state *s, const char *name)
+{
+    lily_set_in_template(s->parser->lex, 0);
+    return parse_file(s->parser, name);
+}
+
+int lily_parse_string(lily_state *s, const char *name, const char *str)
+{
+    lily_set_in_template(s->parser->lex, 0);
+    return parse_string(s->parser, name, (char *)str);
+}
+
+int lily_parse_expr(lily_state *s, const char *name, char *str,
+        const char **text)
+{
+    if (text)
+        *text = NULL;
+
+    lily_set_in_template(s->parser->lex, 0);
+
+    lily_parse_state *parser = s->parser;
+    if (parser->first_pass)
+        fix_first_file_name(parser, name);
+
+    handle_rewind(parser);
+
+    if (setjmp(parser->raiser->all_jumps->jump) == 0) {
+        lily_lex_state *lex = parser->lex;
+        lily_load_source(lex, et_shallow_string, str);
+        lily_lexer(lex);
+
+        expression(parser);
+        lily_emit_eval_expr(parser->emit, parser->expr);
+        NEED_CURRENT_TOK(tk_eof);
+
+        lily_sym *sym = parser->expr->root->result;
+
+        setup_and_exec_vm(parser);
+        lily_pop_lex_entry(parser->lex);
+
+        if (sym && text) {
+            /* This grabs the symbol from __main__. */
+            lily_value *reg = s->call_chain->next->locals[sym->reg_spot];
+            lily_msgbuf *msgbuf = parser->msgbuf;
+
+            lily_mb_flush(msgbuf);
+            lily_mb_add_fmt(msgbuf, "(^T): ", sym->type);
 
             /* Add value doesn't quote String values, because most callers do
                not want that. This one does, so bypass that. */
@@ -4704,6 +6653,201 @@ int lily_render_file(lily_state *s, const char *filename)
     return parse_file(s->parser, filename);
 }
 
+/** A prepared template is compiled once into a function that renders it. The
+    template gets a module of its own, and the function (__template__) is the
+    toplevel of that module. While preparing, lexer sends content to parser
+    instead of the render function. Each piece of content is interned as a
+    ByteString, and the function writes it out through o_render_content. That
+    sends the content to the render function that the state has when the
+    template is rendered. Rendering is then a call of that function, without
+    any lexing, parsing, or emitting.
+
+    Since the function is run for each render, imports that the template does
+    are held back and run once, after the template is compiled. **/
+
+static void prepare_render(const char *text, void *data)
+{
+    lily_parse_state *parser = (lily_parse_state *)data;
+    lily_literal *lit = lily_get_bytestring_literal(parser->symtab, text,
+            strlen(text));
+
+    lily_emit_write_render(parser->emit, lit->reg_spot);
+}
+
+static void compile_template(lily_parse_state *parser)
+{
+    lily_lex_state *lex = parser->lex;
+
+    lily_lexer(lex);
+
+    while (1) {
+        statement(parser, 1);
+
+        if (lex->token == tk_right_curly)
+            lily_raise_syn(parser->raiser, "'}' outside of a block.");
+
+        if (parser->emit->block->block_type != block_file)
+            lily_raise_syn(parser->raiser,
+                    "Unterminated block(s) at end of parsing.");
+
+        if (lex->token == tk_end_tag) {
+            lily_lexer_handle_content(lex);
+            if (lex->token == tk_eof)
+                break;
+            else
+                lily_lexer(lex);
+        }
+        else
+            break;
+    }
+}
+
+static lily_function_val *prepare_template(lily_parse_state *parser,
+        const char *name, lily_lex_entry_type mode, const char *source)
+{
+    lily_lex_state *lex = parser->lex;
+    lily_render_func save_func = lex->render_func;
+    void *save_data = lex->data;
+
+    if (parser->first_pass)
+        fix_first_file_name(parser, name);
+
+    handle_rewind(parser);
+    lily_set_in_template(lex, 1);
+    lily_u16_set_pos(parser->template_imports, 0);
+
+    if (setjmp(parser->raiser->all_jumps->jump) == 0) {
+        lily_module_entry *module = new_module(parser, name, NULL);
+        lily_emit_state *emit = parser->emit;
+
+        parser->template_module = module;
+        parser->symtab->active_module = module;
+        lex->render_func = prepare_render;
+        lex->data = parser;
+
+        lily_var *template_var = lily_emit_new_define_var(emit,
+                parser->default_call_type, NULL, "__template__", NULL);
+
+        lily_emit_enter_block(emit, block_file);
+        lily_load_source(lex, mode, source);
+        compile_template(parser);
+        lily_emit_leave_block(emit);
+        lily_pop_lex_entry(lex);
+
+        /* Dynaloading done past here (or while rendering) loads code through
+           lexer, which must not be seen as a template. */
+        lily_set_in_template(lex, 0);
+        lex->render_func = save_func;
+        lex->data = save_data;
+        parser->template_module = NULL;
+        parser->symtab->active_module = parser->main_module;
+
+        uint16_t *imports = parser->template_imports->data;
+        uint16_t i, count = lily_u16_pos(parser->template_imports);
+
+        for (i = 0;i < count;i++)
+            lily_emit_write_import_call(emit, imports[i]);
+
+        setup_and_exec_vm(parser);
+        lily_mb_flush(parser->msgbuf);
+
+        return parser->vm->readonly_table[template_var->reg_spot]->
+                value.function;
+    }
+    else {
+        lex->render_func = save_func;
+        lex->data = save_data;
+        parser->template_module = NULL;
+        parser->rs->pending = 1;
+    }
+
+    return NULL;
+}
+
+lily_function_val *lily_prepare_template(lily_state *s, const char *name,
+        const char *text)
+{
+    return prepare_template(s->parser, name, et_shallow_string, text);
+}
+
+lily_function_val *lily_prepare_template_file(lily_state *s,
+        const char *filename)
+{
+    return prepare_template(s->parser, filename, et_file, filename);
+}
+
+int lily_render_prepared(lily_state *s, lily_function_val *template_func)
+{
+    lily_parse_state *parser = s->parser;
+
+    lily_set_in_template(parser->lex, 0);
+    handle_rewind(parser);
+
+    if (setjmp(parser->raiser->all_jumps->jump) == 0) {
+        /* A parse that failed may have moved literals since the last prep. */
+        parser->vm->readonly_table = parser->symtab->literals->data;
+        parser->executing = 1;
+        lily_vm_call_toplevel(parser->vm, template_func);
+        parser->executing = 0;
+        return 1;
+    }
+    else
+        parser->rs->pending = 1;
+
+    return 0;
+}
+
+/* This compiles the given file without running it, then translates the
+   functions in it to C. On success, 'text' is set to the C source, which is
+   valid until the next parse. The state is not usable for running code after
+   this, and should be freed. */
+int lily_aot_file(lily_state *s, const char *filename, const char **text)
+{
+    lily_parse_state *parser = s->parser;
+
+    *text = NULL;
+    lily_set_in_template(parser->lex, 0);
+
+    if (parser->first_pass)
+        fix_first_file_name(parser, filename);
+
+    handle_rewind(parser);
+
+    if (setjmp(parser->raiser->all_jumps->jump) == 0) {
+        char *suffix = strrchr(filename, '.');
+        if (suffix == NULL || strcmp(suffix, ".lily") != 0)
+            lily_raise_err(parser->raiser, "File name must end with '.lily'.");
+
+        parser->compile_only = 1;
+        lily_load_source(parser->lex, et_file, filename);
+        parser_loop(parser, filename);
+
+        /* Defines don't leave code behind in __main__, but anything else at
+           toplevel does. There's nowhere in a library to run that from. */
+        if (lily_u16_pos(parser->emit->code) !=
+            parser->emit->main_block->code_start)
+            lily_raise_syn(parser->raiser,
+                    "Cannot compile module '%s': Toplevel code is not supported.",
+                    parser->main_module->loadname);
+
+        lily_mb_flush(parser->msgbuf);
+        lily_aot_write_module(parser->symtab, parser->raiser,
+                parser->main_module, parser->main_module->loadname,
+                parser->msgbuf);
+
+        lily_pop_lex_entry(parser->lex);
+        parser->compile_only = 0;
+        *text = lily_mb_get(parser->msgbuf);
+        return 1;
+    }
+    else {
+        parser->compile_only = 0;
+        parser->rs->pending = 1;
+    }
+
+    return 0;
+}
+
 lily_function_val *lily_get_func(lily_vm_state *vm, const char *name)
 {
     /* todo: Handle scope access, class methods, and so forth. Ideally, it can
@@ -4740,6 +6884,28 @@ const char *lily_get_error(lily_state *s)
     return lily_mb_get(s->parser->msgbuf);
 }
 
+void lily_mark_state(lily_state *s)
+{
+    lily_parse_state *parser = s->parser;
+
+    /* A failed parse leaves symbols that should not be part of the mark. */
+    handle_rewind(parser);
+    make_mark(parser);
+}
+
+void lily_reset_state(lily_state *s)
+{
+    lily_parse_state *parser = s->parser;
+
+    if (parser->mark) {
+        /* The sink may point to literals that are about to be dropped. */
+        if (s->sink)
+            lily_sink_flush(s->sink);
+
+        reset_to_mark(parser, parser->mark);
+    }
+}
+
 void lily_op_argv(lily_state *s, int argc, char **argv)
 {
     if (s->parser->first_pass) {
@@ -4748,16 +6914,64 @@ void lily_op_argv(lily_state *s, int argc, char **argv)
     }
 }
 
-void lily_op_data(lily_state *s, void *data)
+void lily_op_code_cache(lily_state *s, const char *dir)
 {
     if (s->parser->first_pass)
-        s->options->data = data;
+        s->options->cache_dir = dir;
 }
 
-void lily_op_render_func(lily_state *s, lily_render_func render_func)
+void lily_op_flush_func(lily_state *s, lily_flush_func flush_func)
 {
     if (s->parser->first_pass)
-        s->options->render_func = render_func;
+        s->options->flush_func = flush_func;
+}
+
+void lily_op_lazy_imports(lily_state *s, int lazy)
+{
+    if (s->parser->first_pass)
+        s->options->lazy_imports = (lazy != 0);
+}
+
+void lily_op_flush_size(lily_state *s, int size)
+{
+    if (s->parser->first_pass && size > 0)
+        s->options->flush_size = size;
+}
+
+void lily_flush_output(lily_state *s)
+{
+    if (s->sink)
+        lily_sink_flush(s->sink);
+}
+
+/* A prepared template is rendered through whatever render function and data
+   the state has at the time, so these two can be changed after the first pass.
+   Output collected for the old data is flushed to it first. */
+void lily_op_data(lily_state *s, void *data)
+{
+    lily_parse_state *parser = s->parser;
+
+    s->options->data = data;
+
+    if (parser->first_pass)
+        return;
+
+    if (s->sink) {
+        lily_sink_flush(s->sink);
+        s->sink->data = data;
+    }
+    else
+        parser->lex->data = data;
+}
+
+void lily_op_render_func(lily_state *s, lily_render_func render_func)
+{
+    lily_parse_state *parser = s->parser;
+
+    s->options->render_func = render_func;
+
+    if (parser->first_pass == 0 && s->sink == NULL)
+        parser->lex->render_func = render_func;
 }
 
 void lily_op_gc_start(lily_state *s, int start)
@@ -4778,6 +6992,11 @@ char **lily_op_get_argv(lily_state *s, int *argc)
     return s->options->argv;
 }
 
+const char *lily_op_get_code_cache(lily_state *s)
+{
+    return s->options->cache_dir;
+}
+
 void *lily_op_get_data(lily_state *s)
 {
     return s->options->data;
@@ -1,6 +1,7 @@
 #ifndef LILY_PARSER_H
 # define LILY_PARSER_H
 
+# include "lily_alloc.h"
 # include "lily_raiser.h"
 # include "lily_expr.h"
 # include "lily_lexer.h"
@@ -11,6 +12,7 @@
 # include "lily_buffer_u16.h"
 # include "lily_value_stack.h"
 # include "lily_generic_pool.h"
+# include "lily_code_cache.h"
 
 # include "lily_api_msgbuf.h"
 
@@ -26,7 +28,9 @@ typedef struct lily_parse_state_ {
 
     uint16_t executing;
     uint16_t first_pass;
-    uint32_t pad;
+    /* If 1, code is compiled but not run (for ahead-of-time compilation). */
+    uint16_t compile_only;
+    uint16_t pad;
 
     /* The current expression state. */
     lily_expr_state *expr;
@@ -59,6 +63,32 @@ typedef struct lily_parse_state_ {
     lily_raiser *raiser;
     lily_options *options;
     struct lily_rewind_state_ *rs;
+
+    /* While a file is parsed to be cached, this records what happened. The
+       lexer renders through parser then, so the real render target is here. */
+    lily_code_cache *cache;
+    lily_render_func cache_render_func;
+    void *cache_render_data;
+
+    /* States cloned from a snapshot live in this arena, and release it when
+       they're freed. NULL otherwise. */
+    lily_arena *arena;
+    /* Clones also hold the arena that the snapshot's function code is in. */
+    lily_arena *readonly_arena;
+
+    /* Imports that load_module has already resolved, keyed by the directory
+       of the importing module and the name imported. The names are owned here.
+       NULL until the first import. */
+    struct lily_symbol_index_ *import_memo;
+
+    /* Where lily_reset_state goes back to, or NULL if there isn't a mark. */
+    struct lily_state_mark_ *mark;
+
+    /* While a template is prepared, this is the module it's compiled into.
+       Imports done by the template are run once when preparing is done, so
+       their __import__ spots are held here until then. */
+    lily_module_entry *template_module;
+    lily_buffer_u16 *template_imports;
 } lily_parse_state;
 
 lily_var *lily_parser_lambda_eval(lily_parse_state *, int, const char *,
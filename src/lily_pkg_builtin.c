@@ -285,10 +285,9 @@ static const char follower_table[256] =
 
 static lily_string_val *make_sv(lily_state *s, int size)
 {
-    lily_string_val *new_sv = lily_malloc(sizeof(lily_string_val));
-    char *new_string = lily_malloc(sizeof(char) * size);
+    lily_string_val *new_sv = lily_malloc(sizeof(lily_string_val) + size);
 
-    new_sv->string = new_string;
+    new_sv->string = (char *)(new_sv + 1);
     new_sv->size = size - 1;
     new_sv->refcount = 0;
 
@@ -604,17 +603,15 @@ with a newline at the end.
 void lily_builtin_File_print(lily_state *s)
 {
     lily_builtin_File_write(s);
-    fputc('\n', lily_file_for_write(s, lily_arg_file(s, 0)));
-    lily_return_unit(s);
-}
 
-static lily_bytestring_val *new_sv_take(char *buffer)
-{
-    lily_bytestring_val *sv = lily_malloc(sizeof(lily_string_val));
-    sv->refcount = 0;
-    sv->string = buffer;
-    sv->size = strlen(buffer);
-    return sv;
+    FILE *inner_file = lily_file_for_write(s, lily_arg_file(s, 0));
+
+    if (inner_file == stdout && s->sink)
+        lily_sink_add(s->sink, "\n", 1);
+    else
+        fputc('\n', inner_file);
+
+    lily_return_unit(s);
 }
 
 /**
@@ -640,8 +637,12 @@ void lily_builtin_File_read(lily_state *s)
     if (need < -1)
         need = -1;
 
+    /* The contents are read into the text of the ByteString. Since that's in
+       the same block as the ByteString, the whole block is grown. */
     size_t bufsize = 64;
-    char *buffer = lily_malloc(bufsize);
+    lily_bytestring_val *sv = lily_malloc(sizeof(lily_bytestring_val) +
+            bufsize);
+    char *buffer = (char *)(sv + 1);
     int pos = 0, nread;
     int nbuf = bufsize/2;
 
@@ -659,7 +660,8 @@ void lily_builtin_File_read(lily_state *s)
         if (pos >= bufsize) {
             nbuf = bufsize;
             bufsize *= 2;
-            buffer = lily_realloc(buffer, bufsize);
+            sv = lily_realloc(sv, sizeof(lily_bytestring_val) + bufsize);
+            buffer = (char *)(sv + 1);
         }
 
         /* Done if EOF hit (first), or got what was wanted (second). */
@@ -671,7 +673,10 @@ void lily_builtin_File_read(lily_state *s)
             to_read -= nread;
     }
 
-    lily_return_bytestring(s, new_sv_take(buffer));
+    sv->refcount = 0;
+    sv->string = buffer;
+    sv->size = pos;
+    lily_return_bytestring(s, sv);
 }
 
 /**
@@ -741,14 +746,25 @@ void lily_builtin_File_write(lily_state *s)
     lily_value *to_write = lily_arg_value(s, 1);
 
     FILE *inner_file = lily_file_for_write(s, filev);
+    lily_sink *sink = (inner_file == stdout ? s->sink : NULL);
 
-    if (to_write->class_id == LILY_STRING_ID)
-        fputs(to_write->value.string->string, inner_file);
+    if (to_write->class_id == LILY_STRING_ID) {
+        if (sink)
+            lily_sink_add_string(sink, to_write);
+        else
+            fputs(to_write->value.string->string, inner_file);
+    }
     else {
         lily_msgbuf *msgbuf = s->vm_buffer;
         lily_mb_flush(msgbuf);
         lily_mb_add_value(msgbuf, s, to_write);
-        fputs(lily_mb_get(msgbuf), inner_file);
+
+        const char *text = lily_mb_get(msgbuf);
+
+        if (sink)
+            lily_sink_add(sink, text, strlen(text));
+        else
+            fputs(text, inner_file);
     }
 
     lily_return_unit(s);
@@ -980,7 +996,7 @@ void lily_builtin_Hash_keys(lily_state *s)
     for (i = 0, list_i = 0;i < hash_val->num_bins;i++) {
         lily_hash_entry *entry = hash_val->bins[i];
         while (entry) {
-            lily_value_assign(result_lv->values[list_i], entry->boxed_key);
+            lily_value_assign(result_lv->values + list_i, entry->boxed_key);
             list_i++;
             entry = entry->next;
         }
@@ -1077,7 +1093,7 @@ void lily_builtin_Hash_merge(lily_state *s)
 
     lily_container_val *to_merge = lily_arg_container(s, 1);
     for (i = 0;i < to_merge->num_values;i++) {
-        lily_hash_val *merging_hash = to_merge->values[i]->value.hash;
+        lily_hash_val *merging_hash = to_merge->values[i].value.hash;
         for (j = 0;j < merging_hash->num_bins;j++) {
             lily_hash_entry *entry = merging_hash->bins[j];
             while (entry) {
@@ -1292,10 +1308,8 @@ void lily_builtin_List_clear(lily_state *s)
     lily_container_val *list_val = lily_arg_container(s, 0);
     int i;
 
-    for (i = 0;i < list_val->num_values;i++) {
-        lily_deref(list_val->values[i]);
-        lily_free(list_val->values[i]);
-    }
+    for (i = 0;i < list_val->num_values;i++)
+        lily_deref(list_val->values + i);
 
     list_val->extra_space += list_val->num_values;
     list_val->num_values = 0;
@@ -1317,7 +1331,7 @@ void lily_builtin_List_count(lily_state *s)
 
     int i;
     for (i = 0;i < list_val->num_values;i++) {
-        lily_push_value(s, list_val->values[i]);
+        lily_push_value(s, list_val->values + i);
         lily_call_exec_prepared(s, 1);
 
         if (lily_result_boolean(s) == 1)
@@ -1334,10 +1348,18 @@ static void make_extra_space_in_list(lily_container_val *lv)
     /* There's probably room for improvement here, later on. */
     int extra = (lv->num_values + 8) >> 2;
     lv->values = lily_realloc(lv->values,
-            (lv->num_values + extra) * sizeof(lily_value *));
+            (lv->num_values + extra) * sizeof(lily_value));
     lv->extra_space = extra;
 }
 
+/* This puts a copy of 'v' into a slot that was just opened up in a List. The
+   slot may still have the bits of a value that was moved out of it. */
+static void list_slot_set(lily_value *slot, lily_value *v)
+{
+    slot->flags = 0;
+    lily_value_assign(slot, v);
+}
+
 static int64_t get_relative_index(lily_state *s, lily_container_val *list_val,
         int64_t pos)
 {
@@ -1376,17 +1398,17 @@ void lily_builtin_List_delete_at(lily_state *s)
 
     pos = get_relative_index(s, list_val, pos);
 
-    if (list_val->extra_space == 0)
-        make_extra_space_in_list(list_val);
+    /* Unlike insertion, the end of the List isn't a valid spot. */
+    if (pos == list_val->num_values)
+        lily_IndexError(s, "Index %d is too large for list (maximum: %d)", pos,
+                list_val->num_values - 1);
 
-    lily_value *to_delete = list_val->values[pos];
-    lily_deref(to_delete);
-    lily_free(to_delete);
+    lily_deref(list_val->values + pos);
 
     /* Shove everything leftward hide the hole from erasing the value. */
-    if (pos != list_val->num_values)
+    if (pos != list_val->num_values - 1)
         memmove(list_val->values + pos, list_val->values + pos + 1,
-                (list_val->num_values - pos) * sizeof(lily_value *));
+                (list_val->num_values - pos - 1) * sizeof(lily_value));
 
     list_val->num_values--;
     list_val->extra_space++;
@@ -1405,7 +1427,7 @@ void lily_builtin_List_each(lily_state *s)
     int i;
 
     for (i = 0;i < list_val->num_values;i++) {
-        lily_push_value(s, list_val->values[i]);
+        lily_push_value(s, list_val->values + i);
         lily_call_exec_prepared(s, 1);
     }
 
@@ -1456,7 +1478,7 @@ void lily_builtin_List_fold(lily_state *s)
         lily_push_value(s, start);
         int i = 0;
         while (1) {
-            lily_push_value(s, list_val->values[i]);
+            lily_push_value(s, list_val->values + i);
             lily_call_exec_prepared(s, 2);
             v = lily_result_value(s);
 
@@ -1496,9 +1518,9 @@ void lily_builtin_List_insert(lily_state *s)
     /* Shove everything rightward to make space for the new value. */
     if (insert_pos != list_val->num_values)
         memmove(list_val->values + insert_pos + 1, list_val->values + insert_pos,
-                (list_val->num_values - insert_pos) * sizeof(lily_value *));
+                (list_val->num_values - insert_pos) * sizeof(lily_value));
 
-    list_val->values[insert_pos] = lily_value_copy(insert_value);
+    list_slot_set(list_val->values + insert_pos, insert_value);
     list_val->num_values++;
     list_val->extra_space--;
 
@@ -1524,13 +1546,13 @@ void lily_builtin_List_join(lily_state *s)
 
     if (lv->num_values) {
         int i, stop = lv->num_values - 1;
-        lily_value **values = lv->values;
+        lily_value *values = lv->values;
         for (i = 0;i < stop;i++) {
-            lily_mb_add_value(vm_buffer, s, values[i]);
+            lily_mb_add_value(vm_buffer, s, values + i);
             lily_mb_add(vm_buffer, delim);
         }
         if (stop != -1)
-            lily_mb_add_value(vm_buffer, s, values[i]);
+            lily_mb_add_value(vm_buffer, s, values + i);
     }
 
     lily_return_string(s, lily_new_string(lily_mb_get(vm_buffer)));
@@ -1550,7 +1572,7 @@ void lily_builtin_List_map(lily_state *s)
 
     int i;
     for (i = 0;i < list_val->num_values;i++) {
-        lily_value *e = list_val->values[i];
+        lily_value *e = list_val->values + i;
         lily_push_value(s, e);
         lily_call_exec_prepared(s, 1);
         lily_push_value(s, lily_result_value(s));
@@ -1560,7 +1582,7 @@ void lily_builtin_List_map(lily_state *s)
 
     i--;
     for (;i >= 0;i--)
-        lily_value_assign(result_list->values[i], lily_take_value(s));
+        lily_value_assign(result_list->values + i, lily_take_value(s));
 
     lily_return_list(s, result_list);
 }
@@ -1581,15 +1603,12 @@ void lily_builtin_List_pop(lily_state *s)
     if (list_val->num_values == 0)
         lily_IndexError(s, "Pop from an empty list.");
 
-    lily_value *source = list_val->values[list_val->num_values - 1];
+    lily_value *source = list_val->values + list_val->num_values - 1;
 
     /* This is a special case because the value is moving out of the list, so
        don't let it get a ref increase. */
     lily_return_value_noref(s, source);
 
-    /* For now, free extra values instead of trying to keep reserves around.
-       Not the best course of action, perhaps, but certainly the simplest. */
-    lily_free(list_val->values[list_val->num_values - 1]);
     list_val->num_values--;
     list_val->extra_space++;
 }
@@ -1609,7 +1628,7 @@ void lily_builtin_List_push(lily_state *s)
 
     int value_count = list_val->num_values;
 
-    list_val->values[value_count] = lily_value_copy(insert_value);
+    list_slot_set(list_val->values + value_count, insert_value);
     list_val->num_values++;
     list_val->extra_space--;
 
@@ -1624,13 +1643,13 @@ static void list_select_reject_common(lily_state *s, int expect)
     int n = 0;
     int i;
     for (i = 0;i < list_val->num_values;i++) {
-        lily_push_value(s, list_val->values[i]);
+        lily_push_value(s, list_val->values + i);
         lily_call_exec_prepared(s, 1);
 
         int ok = lily_result_boolean(s) == expect;
 
         if (ok) {
-            lily_push_value(s, list_val->values[i]);
+            lily_push_value(s, list_val->values + i);
             n++;
         }
     }
@@ -1639,7 +1658,7 @@ static void list_select_reject_common(lily_state *s, int expect)
 
     n--;
     for (;n >= 0;n--)
-        lily_value_assign(result_list->values[n], lily_take_value(s));
+        lily_value_assign(result_list->values + n, lily_take_value(s));
 
     lily_return_list(s, result_list);
 }
@@ -1675,7 +1694,7 @@ void lily_builtin_List_repeat(lily_state *s)
 
     int i;
     for (i = 0;i < n;i++)
-        lily_value_assign(lv->values[i], to_repeat);
+        lily_value_assign(lv->values + i, to_repeat);
 
     lily_return_list(s, lv);
 }
@@ -1719,20 +1738,16 @@ void lily_builtin_List_shift(lily_state *s)
     if (list_val->num_values == 0)
         lily_IndexError(s, "Shift on an empty list.");
 
-    lily_value *source = list_val->values[0];
+    lily_value *source = list_val->values;
 
     /* Similar to List.pop, the value is being taken out so use this custom
        assign to keep the refcount the same. */
     lily_return_value_noref(s, source);
 
-    /* For now, free extra values instead of trying to keep reserves around.
-       Not the best course of action, perhaps, but certainly the simplest. */
-    lily_free(list_val->values[0]);
-
     if (list_val->num_values != 1)
         memmove(list_val->values, list_val->values + 1,
                 (list_val->num_values - 1) *
-                sizeof(lily_value *));
+                sizeof(lily_value));
 
     list_val->num_values--;
     list_val->extra_space++;
@@ -1801,9 +1816,9 @@ void lily_builtin_List_unshift(lily_state *s)
 
     if (list_val->num_values != 0)
         memmove(list_val->values + 1, list_val->values,
-                list_val->num_values * sizeof(lily_value *));
+                list_val->num_values * sizeof(lily_value));
 
-    list_val->values[0] = lily_value_copy(input_reg);
+    list_slot_set(list_val->values, input_reg);
 
     list_val->num_values++;
     list_val->extra_space--;
@@ -3172,10 +3187,10 @@ void lily_builtin_Tuple_merge(lily_state *s)
 
     int i, j;
     for (i = 0, j = 0;i < left_tuple->num_values;i++, j++)
-        lily_value_assign(lv->values[j], left_tuple->values[i]);
+        lily_value_assign(lv->values + j, left_tuple->values + i);
 
     for (i = 0;i < right_tuple->num_values;i++, j++)
-        lily_value_assign(lv->values[j], right_tuple->values[i]);
+        lily_value_assign(lv->values + j, right_tuple->values + i);
 
     lily_return_tuple(s, lv);
 }
@@ -3193,9 +3208,9 @@ void lily_builtin_Tuple_push(lily_state *s)
 
     int i, j;
     for (i = 0, j = 0;i < left_tuple->num_values;i++, j++)
-        lily_value_assign(lv->values[j], left_tuple->values[i]);
+        lily_value_assign(lv->values + j, left_tuple->values + i);
 
-    lily_value_assign(lv->values[j], right);
+    lily_value_assign(lv->values + j, right);
 
     lily_return_tuple(s, lv);
 }
@@ -3277,7 +3292,7 @@ static lily_class *build_special(lily_symtab *symtab, const char *name,
     result->generic_count = generic_count;
     result->flags |= CLS_IS_BUILTIN;
 
-    symtab->active_module->class_chain = result->next;
+    lily_rewind_class_chain(symtab, result->next);
     symtab->next_class_id--;
 
     result->next = symtab->old_class_chain;
@@ -0,0 +1,157 @@
+#include <string.h>
+
+#include "lily_alloc.h"
+#include "lily_sink.h"
+
+#include "lily_api_value.h"
+
+/* This is how many chunks a sink can have before it must flush. It's well
+   under the IOV_MAX of systems that have one. */
+#define SINK_CHUNK_COUNT 256
+
+/* Pieces of output at or below this size are copied instead of being given a
+   chunk of their own. A copy that joins the chunk before it is cheaper than
+   another entry for the flush function to walk. */
+#define SINK_COPY_LIMIT 64
+
+lily_sink *lily_new_sink(lily_flush_func flush_func, void *data,
+        uint32_t size)
+{
+    lily_sink *sink = lily_malloc(sizeof(lily_sink));
+
+    /* The buffer has to be able to take any copy. */
+    if (size < SINK_COPY_LIMIT)
+        size = SINK_COPY_LIMIT;
+
+    sink->buffer = lily_malloc(size * sizeof(char));
+    sink->chunks = lily_malloc(SINK_CHUNK_COUNT * sizeof(lily_out_chunk));
+    sink->held = lily_malloc(SINK_CHUNK_COUNT * sizeof(lily_value));
+    sink->buffer_pos = 0;
+    sink->buffer_size = size;
+    sink->chunk_pos = 0;
+    sink->held_pos = 0;
+    sink->pending = 0;
+    sink->flush_func = flush_func;
+    sink->data = data;
+
+    return sink;
+}
+
+void lily_free_sink(lily_sink *sink)
+{
+    lily_sink_flush(sink);
+    lily_free(sink->held);
+    lily_free(sink->chunks);
+    lily_free(sink->buffer);
+    lily_free(sink);
+}
+
+void lily_sink_flush(lily_sink *sink)
+{
+    if (sink->chunk_pos == 0)
+        return;
+
+    sink->flush_func(sink->chunks, sink->chunk_pos, sink->data);
+
+    uint16_t i;
+
+    for (i = 0;i < sink->held_pos;i++)
+        lily_deref(sink->held + i);
+
+    sink->buffer_pos = 0;
+    sink->chunk_pos = 0;
+    sink->held_pos = 0;
+    sink->pending = 0;
+}
+
+static void add_chunk(lily_sink *sink, const char *text, uint32_t size)
+{
+    lily_out_chunk *chunk = &sink->chunks[sink->chunk_pos];
+
+    chunk->data = text;
+    chunk->size = size;
+    sink->chunk_pos++;
+    sink->pending += size;
+
+    if (sink->pending >= sink->buffer_size)
+        lily_sink_flush(sink);
+}
+
+void lily_sink_add(lily_sink *sink, const char *text, uint32_t size)
+{
+    if (size == 0)
+        return;
+
+    if (sink->buffer_size - sink->buffer_pos < size) {
+        lily_sink_flush(sink);
+
+        /* Too large to ever fit, so send it through as-is. */
+        if (size > sink->buffer_size) {
+            lily_out_chunk chunk = {text, size};
+
+            sink->flush_func(&chunk, 1, sink->data);
+            return;
+        }
+    }
+
+    char *dest = sink->buffer + sink->buffer_pos;
+    lily_out_chunk *last = NULL;
+
+    if (sink->chunk_pos) {
+        last = &sink->chunks[sink->chunk_pos - 1];
+        if (last->data + last->size != dest)
+            last = NULL;
+    }
+
+    if (last == NULL && sink->chunk_pos == SINK_CHUNK_COUNT) {
+        lily_sink_flush(sink);
+        dest = sink->buffer;
+    }
+
+    memcpy(dest, text, size);
+    sink->buffer_pos += size;
+
+    if (last) {
+        last->size += size;
+        sink->pending += size;
+
+        if (sink->pending >= sink->buffer_size)
+            lily_sink_flush(sink);
+    }
+    else
+        add_chunk(sink, dest, size);
+}
+
+void lily_sink_add_static(lily_sink *sink, const char *text, uint32_t size)
+{
+    if (size <= SINK_COPY_LIMIT) {
+        lily_sink_add(sink, text, size);
+        return;
+    }
+
+    if (sink->chunk_pos == SINK_CHUNK_COUNT)
+        lily_sink_flush(sink);
+
+    add_chunk(sink, text, size);
+}
+
+void lily_sink_add_string(lily_sink *sink, lily_value *v)
+{
+    lily_string_val *sv = v->value.string;
+
+    if (sv->size <= SINK_COPY_LIMIT) {
+        lily_sink_add(sink, sv->string, sv->size);
+        return;
+    }
+
+    if (sink->chunk_pos == SINK_CHUNK_COUNT)
+        lily_sink_flush(sink);
+
+    lily_value *held = sink->held + sink->held_pos;
+
+    held->flags = 0;
+    lily_value_assign(held, v);
+    sink->held_pos++;
+
+    add_chunk(sink, sv->string, sv->size);
+}
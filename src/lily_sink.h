@@ -0,0 +1,57 @@
+#ifndef LILY_SINK_H
+# define LILY_SINK_H
+
+# include <stdint.h>
+
+# include "lily_options.h"
+# include "lily_value_structs.h"
+
+/* lily_sink collects output (template content, and what is printed to stdout)
+   so that it can be handed to the embedder in batches. Each piece of output is
+   a chunk, and the chunks are given to the flush function all at once (which
+   can pass them to writev or similar).
+   Small pieces are copied into the sink's buffer, and merged together when
+   they're next to each other. Larger String values are held by a ref, and
+   content that lives as long as the interpreter (such as literals) is only
+   pointed to. Neither of those are copied. The buffer never grows, so the
+   chunks that point into it stay valid until the next flush. */
+
+typedef struct lily_sink_ {
+    char *buffer;
+    lily_out_chunk *chunks;
+    /* String values that chunks point into. Each has a ref that is dropped
+       (the same way as any other value) after the chunks have been flushed. */
+    lily_value *held;
+
+    uint32_t buffer_pos;
+    uint32_t buffer_size;
+
+    uint16_t chunk_pos;
+    uint16_t held_pos;
+    uint32_t pad;
+
+    /* The total size of all chunks. Once this reaches the buffer size, the
+       sink flushes itself. */
+    uint64_t pending;
+
+    lily_flush_func flush_func;
+    void *data;
+} lily_sink;
+
+lily_sink *lily_new_sink(lily_flush_func, void *, uint32_t);
+
+/* This flushes the sink before freeing it. */
+void lily_free_sink(lily_sink *);
+
+/* Copy 'size' bytes of text into the sink. */
+void lily_sink_add(lily_sink *, const char *, uint32_t);
+
+/* Add text that will outlive the next flush. */
+void lily_sink_add_static(lily_sink *, const char *, uint32_t);
+
+/* Add a String (or ByteString) value. */
+void lily_sink_add_string(lily_sink *, lily_value *);
+
+void lily_sink_flush(lily_sink *);
+
+#endif
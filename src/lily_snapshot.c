@@ -0,0 +1,305 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "lily_alloc.h"
+#include "lily_library.h"
+#include "lily_parser.h"
+
+#include "lily_api_embed.h"
+
+/* A snapshot is a state that was set up inside of an arena. Cloning copies the
+   arena and moves every pointer inside of it that points back into it.
+
+   Nothing says which words in the arena are pointers, so the setup is done
+   twice, in two different arenas. Since setup does the same work both times,
+   the arenas match, except that pointers within each arena differ by how far
+   apart the arenas are. Anything else that differs (such as the time) is data
+   that is copied as-is.
+
+   Setup throws away a lot of memory (source text, old copies of buffers that
+   grew, and so on), and it's spread all through the arena. Since every
+   pointer into the arena is known, the blocks still in use are packed into a
+   smaller image, and that's what clones copy.
+
+   Function code is made in a second (readonly) arena. Pointers to it aren't
+   pointers into the first arena, so clones are left pointing at the code of
+   the snapshot, instead of each having a copy. Clones hold a reference to the
+   readonly arena, so it lives until the snapshot and every clone is gone. */
+
+/* How big the first arena is. If setup runs out, it's tried again with an
+   arena twice as big. */
+#define SNAPSHOT_START_SIZE (1 << 18)
+
+struct lily_snapshot_ {
+    /* The packed copy of the setup arena that clones are made from. */
+    lily_arena *image;
+    /* Setup's own arena and state. The state is kept until the snapshot is
+       freed so that the libraries it loaded stay where they are. */
+    lily_arena *setup;
+    lily_arena *readonly;
+    lily_state *state;
+    size_t state_offset;
+    /* Start and end offsets of the runs of the setup arena still in use. */
+    size_t *ranges;
+    uint32_t range_count;
+    /* Indexes (in words) of the pointers in the image. */
+    uint32_t reloc_count;
+    uint32_t *relocs;
+};
+
+static lily_state *setup_in(lily_arena *arena, lily_arena *readonly,
+        lily_setup_func func, void *data, int *ok)
+{
+    lily_arena *old = lily_arena_swap(arena);
+    lily_arena *old_readonly = lily_readonly_arena_swap(readonly);
+    lily_state *s = lily_new_state();
+
+    *ok = func(s, data);
+    lily_arena_swap(old);
+    lily_readonly_arena_swap(old_readonly);
+
+    if (arena->overflowed || readonly->overflowed)
+        *ok = 0;
+
+    return s;
+}
+
+static void add_reloc(lily_snapshot *snap, uint32_t *space, size_t index)
+{
+    if (snap->reloc_count == *space) {
+        *space *= 2;
+        snap->relocs = lily_realloc(snap->relocs,
+                *space * sizeof(*snap->relocs));
+    }
+
+    snap->relocs[snap->reloc_count] = (uint32_t)index;
+    snap->reloc_count++;
+}
+
+static int find_relocs(lily_snapshot *snap, lily_arena *a, lily_arena *b)
+{
+    uintptr_t *a_words = (uintptr_t *)a->base;
+    uintptr_t *b_words = (uintptr_t *)b->base;
+    uintptr_t a_start = (uintptr_t)a->base;
+    uintptr_t a_end = a_start + a->size;
+    uintptr_t delta = (uintptr_t)b->base - a_start;
+    uint32_t r, space = 64;
+
+    snap->relocs = lily_malloc(space * sizeof(*snap->relocs));
+    snap->reloc_count = 0;
+
+    /* Freed blocks aren't packed, so pointers in them don't matter. */
+    for (r = 0;r < snap->range_count;r++) {
+        size_t i = snap->ranges[r * 2] / sizeof(uintptr_t);
+        size_t end = snap->ranges[r * 2 + 1] / sizeof(uintptr_t);
+
+        for (;i < end;i++) {
+            uintptr_t w = a_words[i];
+
+            if (w == b_words[i])
+                continue;
+
+            if (w < a_start || w > a_end)
+                continue;
+
+            /* This looks like a pointer into the arena, but setup didn't put
+               it at the same spot both times. The arenas can't be trusted. */
+            if (b_words[i] - w != delta)
+                return 0;
+
+            add_reloc(snap, &space, i);
+        }
+    }
+
+    return 1;
+}
+
+/* Where an offset in the setup arena is in the image. Freed memory isn't in the
+   image, but pointers to it are never followed, so they're sent to the end of
+   the run before them. */
+static size_t packed_offset(lily_snapshot *snap, size_t *shifts, size_t off)
+{
+    uint32_t lo = 0, hi = snap->range_count;
+
+    /* Find the last run that starts at or before the offset. */
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+
+        if (snap->ranges[mid * 2] <= off)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo == 0)
+        return 0;
+
+    lo--;
+
+    if (off > snap->ranges[lo * 2 + 1])
+        off = snap->ranges[lo * 2 + 1];
+
+    return off - shifts[lo];
+}
+
+static void pack_image(lily_snapshot *snap, lily_arena *a)
+{
+    size_t *shifts = lily_malloc((snap->range_count + 1) * sizeof(size_t));
+    size_t live = 0;
+    uint32_t i, r;
+
+    for (i = 0;i < snap->range_count;i++) {
+        shifts[i] = snap->ranges[i * 2] - live;
+        live += snap->ranges[i * 2 + 1] - snap->ranges[i * 2];
+    }
+
+    lily_arena *image = lily_new_arena(live);
+    uintptr_t *words = (uintptr_t *)image->base;
+    uintptr_t *a_words = (uintptr_t *)a->base;
+
+    for (i = 0;i < snap->range_count;i++) {
+        size_t start = snap->ranges[i * 2];
+
+        memcpy(image->base + start - shifts[i], a->base + start,
+                snap->ranges[i * 2 + 1] - start);
+    }
+
+    image->pos = live;
+
+    /* Relocs are in order, and all of them are inside of a run. Runs start on
+       a block, so moving them keeps words aligned. */
+    for (i = 0, r = 0;i < snap->reloc_count;i++) {
+        size_t at = (size_t)snap->relocs[i] * sizeof(uintptr_t);
+
+        while (at >= snap->ranges[r * 2 + 1])
+            r++;
+
+        size_t target = a_words[snap->relocs[i]] - (uintptr_t)a->base;
+        uint32_t index = (uint32_t)((at - shifts[r]) / sizeof(uintptr_t));
+
+        words[index] = (uintptr_t)image->base +
+                packed_offset(snap, shifts, target);
+        snap->relocs[i] = index;
+    }
+
+    snap->state_offset = packed_offset(snap, shifts,
+            (size_t)((char *)snap->state - a->base));
+    snap->image = image;
+    lily_free(shifts);
+}
+
+lily_snapshot *lily_new_snapshot(lily_setup_func func, void *data)
+{
+    lily_snapshot *snap = lily_malloc(sizeof(*snap));
+    size_t size = SNAPSHOT_START_SIZE;
+    lily_arena *a, *b, *a_readonly, *b_readonly;
+    lily_state *a_state, *b_state;
+    int ok;
+
+    while (1) {
+        a = lily_new_arena(size);
+        a_readonly = lily_new_arena(size);
+        a_state = setup_in(a, a_readonly, func, data, &ok);
+
+        if (ok || (a->overflowed == 0 && a_readonly->overflowed == 0))
+            break;
+
+        lily_free_state(a_state);
+        lily_free_arena(a);
+        lily_free_arena(a_readonly);
+        size *= 2;
+    }
+
+    if (ok == 0) {
+        lily_free_state(a_state);
+        lily_free_arena(a);
+        lily_free_arena(a_readonly);
+        lily_free(snap);
+        return NULL;
+    }
+
+    b = lily_new_arena(size);
+    b_readonly = lily_new_arena(size);
+    b_state = setup_in(b, b_readonly, func, data, &ok);
+    snap->relocs = NULL;
+    snap->range_count = lily_arena_live_ranges(a, &snap->ranges);
+
+    if (ok && a->pos == b->pos && a_readonly->pos == b_readonly->pos)
+        ok = find_relocs(snap, a, b);
+    else
+        ok = 0;
+
+    lily_free_state(b_state);
+    lily_free_arena(b);
+    lily_free_arena(b_readonly);
+
+    if (ok == 0) {
+        lily_free_state(a_state);
+        lily_free_arena(a);
+        lily_free_arena(a_readonly);
+        lily_free(snap->relocs);
+        lily_free(snap->ranges);
+        lily_free(snap);
+        return NULL;
+    }
+
+    snap->setup = a;
+    snap->readonly = a_readonly;
+    snap->state = a_state;
+    pack_image(snap, a);
+    return snap;
+}
+
+lily_state *lily_clone_state(lily_snapshot *snap)
+{
+    lily_arena *image = snap->image;
+    lily_arena *arena = lily_new_arena(image->pos);
+    uintptr_t *words = (uintptr_t *)arena->base;
+    uintptr_t delta = (uintptr_t)arena->base - (uintptr_t)image->base;
+    uint32_t i;
+
+    memcpy(arena->base, image->base, image->pos);
+
+    /* The clone is never allocated from: New memory comes from the heap. */
+    arena->pos = arena->size;
+
+    for (i = 0;i < snap->reloc_count;i++)
+        words[snap->relocs[i]] += delta;
+
+    lily_state *s = (lily_state *)(arena->base + snap->state_offset);
+    lily_parse_state *parser = s->parser;
+    lily_module_entry *module_iter = parser->module_start;
+
+    parser->arena = arena;
+    parser->readonly_arena = lily_arena_ref(snap->readonly);
+
+    /* Each state closes the libraries it has, so each clone needs to open
+       them again. */
+    while (module_iter) {
+        if (module_iter->handle) {
+            lily_library *library = lily_library_load(module_iter->path);
+
+            if (library) {
+                module_iter->handle = library->source;
+                lily_free(library);
+            }
+            else
+                module_iter->handle = NULL;
+        }
+
+        module_iter = module_iter->root_next;
+    }
+
+    return s;
+}
+
+void lily_free_snapshot(lily_snapshot *snap)
+{
+    lily_free_state(snap->state);
+    lily_free_arena(snap->setup);
+    lily_free_arena(snap->image);
+    lily_free_arena(snap->readonly);
+    lily_free(snap->relocs);
+    lily_free(snap->ranges);
+    lily_free(snap);
+}
@@ -0,0 +1,184 @@
+#include <string.h>
+
+#include "lily_alloc.h"
+#include "lily_core_types.h"
+#include "lily_symbol_index.h"
+
+/* Slots are kept at least twice as many as the entries, so that runs of used
+   slots stay short. */
+#define INITIAL_SLOT_COUNT 32
+
+lily_symbol_index *lily_new_symbol_index(void)
+{
+    lily_symbol_index *si = lily_malloc(sizeof(lily_symbol_index));
+
+    si->entries = lily_malloc((INITIAL_SLOT_COUNT / 2) *
+            sizeof(lily_index_entry));
+    si->slots = lily_malloc(INITIAL_SLOT_COUNT * sizeof(uint32_t));
+    memset(si->slots, 0, INITIAL_SLOT_COUNT * sizeof(uint32_t));
+    si->pos = 0;
+    si->size = INITIAL_SLOT_COUNT / 2;
+    si->slot_mask = INITIAL_SLOT_COUNT - 1;
+    si->pad = 0;
+
+    return si;
+}
+
+void lily_free_symbol_index(lily_symbol_index *si)
+{
+    if (si == NULL)
+        return;
+
+    lily_free(si->slots);
+    lily_free(si->entries);
+    lily_free(si);
+}
+
+/* This is FNV-1a. Symbol names are short, and often share a long prefix (such
+   as generated names), so every byte is used. */
+uint32_t lily_hash_name(const char *name)
+{
+    const unsigned char *ch = (const unsigned char *)name;
+    uint32_t hash = 2166136261U;
+
+    while (*ch) {
+        hash ^= *ch;
+        hash *= 16777619U;
+        ch++;
+    }
+
+    return hash;
+}
+
+static void insert_slot(lily_symbol_index *si, uint32_t entry_pos)
+{
+    uint32_t mask = si->slot_mask;
+    uint32_t i = si->entries[entry_pos].hash & mask;
+
+    while (si->slots[i])
+        i = (i + 1) & mask;
+
+    si->slots[i] = entry_pos + 1;
+}
+
+/* Entries are put back in order, so that newer entries with the same hash
+   still come after older ones. */
+static void grow_slots(lily_symbol_index *si, uint32_t slot_count)
+{
+    uint32_t i;
+
+    lily_free(si->slots);
+    si->slots = lily_malloc(slot_count * sizeof(uint32_t));
+    memset(si->slots, 0, slot_count * sizeof(uint32_t));
+    si->slot_mask = slot_count - 1;
+
+    for (i = 0;i < si->pos;i++)
+        insert_slot(si, i);
+}
+
+lily_index_entry *lily_si_reserve(lily_symbol_index *si, uint32_t count)
+{
+    if (si->pos + count > si->size) {
+        uint32_t new_size = si->size;
+
+        while (si->pos + count > new_size)
+            new_size *= 2;
+
+        si->entries = lily_realloc(si->entries,
+                new_size * sizeof(lily_index_entry));
+        si->size = new_size;
+        grow_slots(si, new_size * 2);
+    }
+
+    return si->entries + si->pos;
+}
+
+void lily_si_commit(lily_symbol_index *si, uint32_t count)
+{
+    uint32_t i;
+
+    for (i = si->pos;i < si->pos + count;i++) {
+        lily_index_entry *e = &si->entries[i];
+
+        e->hash = lily_hash_name(e->name);
+        e->pad = 0;
+        insert_slot(si, i);
+    }
+
+    si->pos += count;
+}
+
+/* The entry dropped is always the newest. Nothing after it in a run of slots
+   could have been placed there because of it, so the slot is just emptied. */
+static void drop_top(lily_symbol_index *si)
+{
+    uint32_t mask = si->slot_mask;
+    uint32_t i = si->entries[si->pos - 1].hash & mask;
+
+    while (si->slots[i] != si->pos)
+        i = (i + 1) & mask;
+
+    si->slots[i] = 0;
+    si->pos--;
+}
+
+void lily_si_rewind(lily_symbol_index *si, void *stop, const char *stop_name)
+{
+    if (stop == NULL) {
+        memset(si->slots, 0, (si->slot_mask + 1) * sizeof(uint32_t));
+        si->pos = 0;
+        return;
+    }
+
+    uint32_t mask = si->slot_mask;
+    uint32_t i = lily_hash_name(stop_name) & mask;
+    uint32_t stop_pos = 0;
+
+    while (si->slots[i]) {
+        if (si->entries[si->slots[i] - 1].item == stop) {
+            stop_pos = si->slots[i];
+            break;
+        }
+
+        i = (i + 1) & mask;
+    }
+
+    if (stop_pos == 0)
+        return;
+
+    while (si->pos > stop_pos)
+        drop_top(si);
+}
+
+void lily_si_truncate(lily_symbol_index *si, uint32_t pos)
+{
+    while (si->pos > pos)
+        drop_top(si);
+}
+
+void *lily_si_find(lily_symbol_index *si, const char *name, uint32_t hash,
+        uint16_t hide_flags)
+{
+    uint32_t mask = si->slot_mask;
+    uint32_t i = hash & mask;
+    uint32_t best = 0;
+
+    while (si->slots[i]) {
+        uint32_t at = si->slots[i];
+        lily_index_entry *e = &si->entries[at - 1];
+
+        if (e->hash == hash &&
+            at > best &&
+            strcmp(e->name, name) == 0 &&
+            (hide_flags == 0 ||
+             (((lily_item *)e->item)->flags & hide_flags) == 0))
+            best = at;
+
+        i = (i + 1) & mask;
+    }
+
+    if (best == 0)
+        return NULL;
+
+    return si->entries[best - 1].item;
+}
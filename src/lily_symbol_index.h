@@ -0,0 +1,57 @@
+#ifndef LILY_SYMBOL_INDEX_H
+# define LILY_SYMBOL_INDEX_H
+
+# include <stdint.h>
+
+/* lily_symbol_index is a hash index over a chain of named symbols (the vars,
+   classes, or module links of a module, or the members of a class). The
+   chains are still the owners of the symbols, and new symbols are still put at
+   the front of them. An index catches up to its chain when it's searched, so
+   only a chain that shrinks needs to tell the index about it.
+   Entries are kept in chain order, oldest first. Chains only ever lose their
+   newest symbols, so entries are only ever dropped from the end. That lets the
+   hash slots be undone in order instead of needing tombstones. */
+
+typedef struct {
+    void *item;
+    const char *name;
+    uint32_t hash;
+    uint32_t pad;
+} lily_index_entry;
+
+typedef struct lily_symbol_index_ {
+    lily_index_entry *entries;
+    /* Each slot is an entry's position plus one, or 0 if empty. */
+    uint32_t *slots;
+    uint32_t pos;
+    uint32_t size;
+    uint32_t slot_mask;
+    uint32_t pad;
+} lily_symbol_index;
+
+lily_symbol_index *lily_new_symbol_index(void);
+void lily_free_symbol_index(lily_symbol_index *);
+
+uint32_t lily_hash_name(const char *);
+
+/* The newest item in the index, or NULL if it's empty. */
+#define lily_si_top(si) (si->pos ? si->entries[si->pos - 1].item : NULL)
+
+/* Make room for 'count' new entries, and return where the first one goes. The
+   caller fills in the item and name of each (oldest first), then commits. */
+lily_index_entry *lily_si_reserve(lily_symbol_index *, uint32_t);
+void lily_si_commit(lily_symbol_index *, uint32_t);
+
+/* Drop every entry newer than the item given. If the item isn't in the index,
+   then it's newer than everything in it and nothing is dropped. NULL drops
+   everything. The name is that of the item. */
+void lily_si_rewind(lily_symbol_index *, void *, const char *);
+
+/* Drop the newest entries, until there are only 'pos' left. */
+void lily_si_truncate(lily_symbol_index *, uint32_t);
+
+/* Find the newest item with the name given. Items that have any of the flags
+   given are skipped over. If the flags are 0, then items aren't looked at. */
+void *lily_si_find(lily_symbol_index *, const char *, uint32_t, uint16_t);
+
+#endif
@@ -2,6 +2,8 @@
 #include <string.h>
 
 #include "lily_symtab.h"
+#include "lily_symbol_index.h"
+#include "lily_type_maker.h"
 #include "lily_vm.h"
 #include "lily_value_flags.h"
 #include "lily_alloc.h"
@@ -28,6 +30,10 @@ lily_symtab *lily_new_symtab(lily_generic_pool *gp)
     symtab->old_class_chain = NULL;
     symtab->hidden_class_chain = NULL;
     symtab->literals = lily_new_value_stack();
+    symtab->literal_slots = lily_malloc(64 * sizeof(uint32_t));
+    memset(symtab->literal_slots, 0, 64 * sizeof(uint32_t));
+    symtab->literal_mask = 63;
+    symtab->literal_count = 0;
     symtab->generics = gp;
     symtab->next_global_id = 1;
 
@@ -85,6 +91,8 @@ static void free_classes_until(lily_class *class_iter, lily_class *stop)
         if (class_iter->members != NULL)
             free_properties(class_iter);
 
+        lily_free_symbol_index(class_iter->member_index);
+
         lily_type *type_iter = class_iter->all_subtypes;
         lily_type *type_next;
         while (type_iter) {
@@ -94,6 +102,8 @@ static void free_classes_until(lily_class *class_iter, lily_class *stop)
             type_iter = type_next;
         }
 
+        lily_free_type_table(class_iter->type_table);
+
         if (class_iter->flags & CLS_ENUM_IS_SCOPED) {
             /* Scoped enums pull their variants from the symtab's class chain so
                that parser won't find them. */
@@ -131,6 +141,117 @@ static void hide_classes(lily_symtab *symtab, lily_class *class_iter,
     symtab->hidden_class_chain = hidden_top;
 }
 
+/* Literals are found through a hash index, keyed on their class and value.
+   Literals are only ever pushed and popped, so the index uses open addressing
+   and a popped literal's slot is simply emptied. Functions share the literal
+   stack, but aren't put into the index. */
+
+static uint32_t hash_integer(int64_t i)
+{
+    uint64_t h = (uint64_t)i * 11400714819323198485ULL;
+    return (uint32_t)(h >> 32);
+}
+
+static uint32_t hash_double(double d)
+{
+    uint64_t bits;
+
+    /* 0.0 and -0.0 are equal, so they need the same hash. */
+    if (d == 0.0)
+        d = 0.0;
+
+    memcpy(&bits, &d, sizeof(bits));
+    return hash_integer((int64_t)bits);
+}
+
+/* This is FNV-1a, started from a different spot for each class. */
+static uint32_t hash_bytes(const char *bytes, uint32_t size, uint16_t class_id)
+{
+    const unsigned char *ch = (const unsigned char *)bytes;
+    uint32_t h = 2166136261U ^ class_id;
+    uint32_t i;
+
+    for (i = 0;i < size;i++) {
+        h ^= ch[i];
+        h *= 16777619U;
+    }
+
+    return h;
+}
+
+static uint32_t hash_literal(lily_literal *lit)
+{
+    uint32_t h;
+
+    switch (lit->class_id) {
+        case LILY_INTEGER_ID:
+            h = hash_integer(lit->value.integer);
+            break;
+        case LILY_DOUBLE_ID:
+            h = hash_double(lit->value.doubleval);
+            break;
+        default:
+            h = hash_bytes(lit->value.string->string, lit->value.string->size,
+                    lit->class_id);
+            break;
+    }
+
+    return h;
+}
+
+static int lit_is_indexed(lily_literal *lit)
+{
+    return (lit->class_id == LILY_INTEGER_ID ||
+            lit->class_id == LILY_DOUBLE_ID ||
+            lit->class_id == LILY_STRING_ID ||
+            lit->class_id == LILY_BYTESTRING_ID);
+}
+
+static void insert_literal_slot(lily_symtab *symtab, uint32_t hash,
+        uint32_t spot)
+{
+    uint32_t mask = symtab->literal_mask;
+    uint32_t i = hash & mask;
+
+    while (symtab->literal_slots[i])
+        i = (i + 1) & mask;
+
+    symtab->literal_slots[i] = spot + 1;
+}
+
+static void remove_literal_slot(lily_symtab *symtab, lily_literal *lit)
+{
+    uint32_t mask = symtab->literal_mask;
+    uint32_t i = hash_literal(lit) & mask;
+    uint32_t want = (uint32_t)lit->reg_spot + 1;
+
+    while (symtab->literal_slots[i] != want)
+        i = (i + 1) & mask;
+
+    symtab->literal_slots[i] = 0;
+    symtab->literal_count--;
+}
+
+static void grow_literal_slots(lily_symtab *symtab)
+{
+    lily_value_stack *literals = symtab->literals;
+    uint32_t slot_count = (symtab->literal_mask + 1) * 2;
+    uint32_t i;
+
+    lily_free(symtab->literal_slots);
+    symtab->literal_slots = lily_malloc(slot_count * sizeof(uint32_t));
+    memset(symtab->literal_slots, 0, slot_count * sizeof(uint32_t));
+    symtab->literal_mask = slot_count - 1;
+
+    /* Going in order keeps popped literals at the end of their runs. */
+    for (i = 0;i < lily_vs_pos(literals);i++) {
+        lily_literal *lit = (lily_literal *)lily_vs_nth(literals, i);
+
+        if (lit_is_indexed(lit))
+            insert_literal_slot(symtab, hash_literal(lit), i);
+    }
+}
+
 static void free_literals(lily_value_stack *literals)
 {
     while (lily_vs_pos(literals)) {
@@ -152,10 +273,38 @@ static void free_literals(lily_value_stack *literals)
     lily_free_value_stack(literals);
 }
 
+static void free_indexes(lily_module_entry *entry)
+{
+    lily_free_symbol_index(entry->link_index);
+    lily_free_symbol_index(entry->class_index);
+    lily_free_symbol_index(entry->var_index);
+    lily_free_symbol_index(entry->dynaload_index);
+    entry->link_index = NULL;
+    entry->class_index = NULL;
+    entry->var_index = NULL;
+    entry->dynaload_index = NULL;
+}
+
+/* Chains that lose their newest symbols must tell their index, since the index
+   has no other way of knowing that those symbols are gone. */
+
+static void rewind_var_index(lily_module_entry *entry, lily_var *stop)
+{
+    if (entry->var_index)
+        lily_si_rewind(entry->var_index, stop, stop ? stop->name : NULL);
+}
+
+static void rewind_class_index(lily_module_entry *entry, lily_class *stop)
+{
+    if (entry->class_index)
+        lily_si_rewind(entry->class_index, stop, stop ? stop->name : NULL);
+}
+
 void lily_hide_module_symbols(lily_symtab *symtab, lily_module_entry *entry)
 {
     hide_classes(symtab, entry->class_chain, NULL);
     free_vars(entry->var_chain);
+    free_indexes(entry);
 }
 
 void lily_free_module_symbols(lily_symtab *symtab, lily_module_entry *entry)
@@ -163,6 +312,7 @@ void lily_free_module_symbols(lily_symtab *symtab, lily_module_entry *entry)
     (void) symtab;
     free_classes(entry->class_chain);
     free_vars(entry->var_chain);
+    free_indexes(entry);
 }
 
 void lily_rewind_symtab(lily_symtab *symtab, lily_module_entry *main_module,
@@ -171,11 +321,14 @@ void lily_rewind_symtab(lily_symtab *symtab, lily_module_entry *main_module,
     symtab->active_module = main_module;
 
     if (main_module->var_chain != stop_var) {
+        rewind_var_index(main_module, stop_var);
         free_vars_since(main_module->var_chain, stop_var);
         main_module->var_chain = stop_var;
     }
 
     if (main_module->class_chain != stop_class) {
+        rewind_class_index(main_module, stop_class);
+
         if (hide)
             free_classes_until(main_module->class_chain, stop_class);
         else
@@ -185,6 +338,165 @@ void lily_rewind_symtab(lily_symtab *symtab, lily_module_entry *main_module,
     }
 }
 
+/* Vars after 'stop_var' are taken out of the current module (emitter does this
+   when leaving a function). The caller is responsible for the vars taken. */
+void lily_rewind_var_chain(lily_symtab *symtab, lily_var *stop_var)
+{
+    lily_module_entry *m = symtab->active_module;
+
+    if (m->var_chain != stop_var) {
+        rewind_var_index(m, stop_var);
+        m->var_chain = stop_var;
+    }
+}
+
+/* This is like the above, except for classes. */
+void lily_rewind_class_chain(lily_symtab *symtab, lily_class *stop_class)
+{
+    lily_module_entry *m = symtab->active_module;
+
+    if (m->class_chain != stop_class) {
+        rewind_class_index(m, stop_class);
+        m->class_chain = stop_class;
+    }
+}
+
+/* If a module was imported like 'import x as y', then it's only visible as 'y'.
+   This prevents fallback access as 'x', just in case something else is
+   imported with the name 'x'. */
+#define link_name(l) (l->as_name ? l->as_name : l->module->loadname)
+
+/* The caller is responsible for freeing the links that come before 'stop'. */
+void lily_rewind_module_links(lily_module_entry *entry,
+        lily_module_link *stop)
+{
+    if (entry->module_chain == stop)
+        return;
+
+    if (entry->link_index) {
+        const char *name = NULL;
+
+        if (stop)
+            name = link_name(stop);
+
+        lily_si_rewind(entry->link_index, stop, name);
+    }
+
+    entry->module_chain = stop;
+}
+
+/* These are used by parser to reset a state back to a mark. Anything made
+   after the mark is destroyed, and anything made before it is kept. Classes to
+   be destroyed have CLS_VISITED set on them beforehand, so that types that use
+   them can be found. */
+
+void lily_rewind_module_symbols(lily_module_entry *entry,
+        lily_class *stop_class, lily_var *stop_var)
+{
+    rewind_class_index(entry, stop_class);
+    free_classes_until(entry->class_chain, stop_class);
+    entry->class_chain = stop_class;
+
+    rewind_var_index(entry, stop_var);
+    free_vars_since(entry->var_chain, stop_var);
+    entry->var_chain = stop_var;
+}
+
+void lily_rewind_old_symbols(lily_symtab *symtab, lily_var *stop_function,
+        lily_class *stop_old, lily_class *stop_hidden)
+{
+    free_vars_since(symtab->old_function_chain, stop_function);
+    symtab->old_function_chain = stop_function;
+
+    free_classes_until(symtab->old_class_chain, stop_old);
+    symtab->old_class_chain = stop_old;
+
+    free_classes_until(symtab->hidden_class_chain, stop_hidden);
+    symtab->hidden_class_chain = stop_hidden;
+}
+
+void lily_rewind_literals(lily_symtab *symtab, uint32_t count)
+{
+    lily_value_stack *literals = symtab->literals;
+
+    while (lily_vs_pos(literals) > count) {
+        lily_literal *lit = (lily_literal *)lily_vs_pop(literals);
+
+        /* This is the newest literal, so its slot can just be emptied. */
+        if (lit_is_indexed(lit))
+            remove_literal_slot(symtab, lit);
+
+        if (lit->class_id != LILY_BOOLEAN_ID &&
+            lit->class_id != LILY_INTEGER_ID &&
+            lit->class_id != LILY_DOUBLE_ID) {
+            lit->flags |= VAL_IS_DEREFABLE;
+            lily_deref((lily_value *)lit);
+        }
+
+        lily_free(lit);
+    }
+}
+
+static int type_is_dead(lily_type *type)
+{
+    if (type == NULL)
+        return 0;
+
+    if (type->cls->flags & CLS_VISITED)
+        return 1;
+
+    int i;
+    for (i = 0;i < type->subtype_count;i++) {
+        if (type_is_dead(type->subtypes[i]))
+            return 1;
+    }
+
+    return 0;
+}
+
+void lily_rewind_class(lily_class *cls, uint32_t literal_count)
+{
+    if (cls->item_kind == ITEM_TYPE_VARIANT)
+        return;
+
+    /* Methods dynaloaded after the mark have a spot past the last literal.
+       They're taken out of the middle of the chain, so the index is made again
+       the next time it's needed. */
+    lily_free_symbol_index(cls->member_index);
+    cls->member_index = NULL;
+
+    lily_named_sym **sym_iter = &cls->members;
+    while (*sym_iter) {
+        lily_named_sym *sym = *sym_iter;
+
+        if (sym->item_kind == ITEM_TYPE_VAR &&
+            sym->reg_spot >= literal_count) {
+            *sym_iter = sym->next;
+            lily_free(sym->name);
+            lily_free(sym);
+        }
+        else
+            sym_iter = &sym->next;
+    }
+
+    /* The table is made again the next time it's needed. */
+    lily_free_type_table(cls->type_table);
+    cls->type_table = NULL;
+
+    lily_type **type_iter = &cls->all_subtypes;
+    while (*type_iter) {
+        lily_type *type = *type_iter;
+
+        if (type_is_dead(type)) {
+            *type_iter = type->next;
+            lily_free(type->subtypes);
+            lily_free(type);
+        }
+        else
+            type_iter = &type->next;
+    }
+}
+
 void lily_free_symtab(lily_symtab *symtab)
 {
     /* __main__'s code is a shallow copy of emitter's code, which has already
@@ -192,6 +504,7 @@ void lily_free_symtab(lily_symtab *symtab)
     symtab->main_function->code = NULL;
 
     free_literals(symtab->literals);
+    lily_free(symtab->literal_slots);
 
     free_classes(symtab->old_class_chain);
     free_classes(symtab->hidden_class_chain);
@@ -255,142 +568,122 @@ static lily_value *new_value_of_string(lily_string_val *sv)
     return v;
 }
 
-/* Literals take advantage of lily_value having extra padding in it. That extra
-   padding will have the index of the next literal of that kind. The only
-   trouble is finding the first one with the given flag to start with. */
-static lily_literal *first_lit_of(lily_value_stack *vs, int to_find)
+static lily_literal *push_literal(lily_symtab *symtab, lily_value *value,
+        uint32_t hash)
 {
-    int stop = lily_vs_pos(vs);
-    int i;
+    lily_literal *lit = (lily_literal *)value;
+    uint32_t spot = lily_vs_pos(symtab->literals);
 
-    for (i = 0;i < stop;i++) {
-        lily_literal *lit = (lily_literal *)lily_vs_nth(vs, i);
-        if (lit->class_id == to_find)
-            return lit;
-    }
+    lit->reg_spot = (uint16_t)spot;
+    lit->pad = 0;
+    lily_vs_push(symtab->literals, value);
+    symtab->literal_count++;
 
-    return NULL;
+    if (symtab->literal_count * 2 > symtab->literal_mask + 1)
+        grow_literal_slots(symtab);
+    else
+        insert_literal_slot(symtab, hash, spot);
+
+    return lit;
 }
 
+#define LITERAL_AT(s, at) ((lily_literal *)lily_vs_nth(s->literals, at - 1))
+
 lily_literal *lily_get_integer_literal(lily_symtab *symtab, int64_t int_val)
 {
-    lily_literal *iter = first_lit_of(symtab->literals, LILY_INTEGER_ID);
+    uint32_t hash = hash_integer(int_val);
+    uint32_t mask = symtab->literal_mask;
+    uint32_t i = hash & mask;
+    uint32_t at;
 
-    while (iter) {
-        if (iter->value.integer == int_val)
-            return iter;
+    while ((at = symtab->literal_slots[i]) != 0) {
+        lily_literal *lit = LITERAL_AT(symtab, at);
 
-        int next = iter->next_index;
+        if (lit->class_id == LILY_INTEGER_ID && lit->value.integer == int_val)
+            return lit;
 
-        if (next == 0)
-            break;
-        else
-            iter = (lily_literal *)lily_vs_nth(symtab->literals, next);
+        i = (i + 1) & mask;
     }
 
-    if (iter)
-        iter->next_index = lily_vs_pos(symtab->literals);
-
-    lily_literal *v = (lily_literal *)new_value_of_integer(int_val);
-    v->reg_spot = lily_vs_pos(symtab->literals);
-    v->next_index = 0;
-
-    lily_vs_push(symtab->literals, (lily_value *)v);
-    return (lily_literal *)v;
+    return push_literal(symtab, new_value_of_integer(int_val), hash);
 }
 
 lily_literal *lily_get_double_literal(lily_symtab *symtab, double dbl_val)
 {
-    lily_literal *iter = first_lit_of(symtab->literals, LILY_DOUBLE_ID);
+    uint32_t hash = hash_double(dbl_val);
+    uint32_t mask = symtab->literal_mask;
+    uint32_t i = hash & mask;
+    uint32_t at;
 
-    while (iter) {
-        if (iter->value.doubleval == dbl_val)
-            return iter;
+    while ((at = symtab->literal_slots[i]) != 0) {
+        lily_literal *lit = LITERAL_AT(symtab, at);
 
-        int next = iter->next_index;
+        if (lit->class_id == LILY_DOUBLE_ID &&
+            lit->value.doubleval == dbl_val)
+            return lit;
 
-        if (next == 0)
-            break;
-        else
-            iter = (lily_literal *)lily_vs_nth(symtab->literals, next);
+        i = (i + 1) & mask;
     }
 
-    if (iter)
-        iter->next_index = lily_vs_pos(symtab->literals);
-
-    lily_literal *v = (lily_literal *)new_value_of_double(dbl_val);
-    v->reg_spot = lily_vs_pos(symtab->literals);
-    v->next_index = 0;
-
-    lily_vs_push(symtab->literals, (lily_value *)v);
-    return (lily_literal *)v;
+    return push_literal(symtab, new_value_of_double(dbl_val), hash);
 }
 
-lily_literal *lily_get_bytestring_literal(lily_symtab *symtab,
-        const char *want_string, int len)
+static lily_literal *find_sized_literal(lily_symtab *symtab,
+        const char *want, uint32_t len, uint16_t class_id, uint32_t hash)
 {
-    lily_literal *iter = first_lit_of(symtab->literals, LILY_BYTESTRING_ID);
+    uint32_t mask = symtab->literal_mask;
+    uint32_t i = hash & mask;
+    uint32_t at;
 
-    while (iter) {
-        if (iter->value.string->size == len &&
-            memcmp(iter->value.string->string, want_string, len) == 0)
-            return iter;
+    while ((at = symtab->literal_slots[i]) != 0) {
+        lily_literal *lit = LITERAL_AT(symtab, at);
 
-        int next = iter->next_index;
+        if (lit->class_id == class_id &&
+            lit->value.string->size == len &&
+            memcmp(lit->value.string->string, want, len) == 0)
+            return lit;
 
-        if (next == 0)
-            break;
-        else
-            iter = (lily_literal *)lily_vs_nth(symtab->literals, next);
+        i = (i + 1) & mask;
     }
 
-    if (iter)
-        iter->next_index = lily_vs_pos(symtab->literals);
+    return NULL;
+}
+
+lily_literal *lily_get_bytestring_literal(lily_symtab *symtab,
+        const char *want_string, int len)
+{
+    uint32_t hash = hash_bytes(want_string, len, LILY_BYTESTRING_ID);
+    lily_literal *lit = find_sized_literal(symtab, want_string, len,
+            LILY_BYTESTRING_ID, hash);
+
+    if (lit)
+        return lit;
 
     lily_bytestring_val *sv = lily_new_bytestring_sized(want_string, len);
-    lily_literal *v = (lily_literal *)new_value_of_bytestring(sv);
+    lily_value *v = new_value_of_bytestring(sv);
 
     /* Drop the derefable marker. */
     v->flags = LILY_BYTESTRING_ID;
-    v->reg_spot = lily_vs_pos(symtab->literals);
-    v->next_index = 0;
-
-    lily_vs_push(symtab->literals, (lily_value *)v);
-    return (lily_literal *)v;
+    return push_literal(symtab, v, hash);
 }
 
 lily_literal *lily_get_string_literal(lily_symtab *symtab,
         const char *want_string)
 {
-    lily_literal *iter = first_lit_of(symtab->literals, LILY_STRING_ID);
-    int want_string_len = strlen(want_string);
-
-    while (iter) {
-        if (iter->value.string->size == want_string_len &&
-            strcmp(iter->value.string->string, want_string) == 0)
-            return iter;
-
-        int next = iter->next_index;
-
-        if (next == 0)
-            break;
-        else
-            iter = (lily_literal *)lily_vs_nth(symtab->literals, next);
-    }
+    uint32_t len = strlen(want_string);
+    uint32_t hash = hash_bytes(want_string, len, LILY_STRING_ID);
+    lily_literal *lit = find_sized_literal(symtab, want_string, len,
+            LILY_STRING_ID, hash);
 
-    if (iter)
-        iter->next_index = lily_vs_pos(symtab->literals);
+    if (lit)
+        return lit;
 
     lily_string_val *sv = lily_new_string(want_string);
-    lily_literal *v = (lily_literal *)new_value_of_string(sv);
+    lily_value *v = new_value_of_string(sv);
 
     /* Drop the derefable marker. */
     v->flags = LILY_STRING_ID;
-    v->reg_spot = lily_vs_pos(symtab->literals);
-    v->next_index = 0;
-
-    lily_vs_push(symtab->literals, (lily_value *)v);
-    return (lily_literal *)v;
+    return push_literal(symtab, v, hash);
 }
 
 /* Literals and defined functions are both immutable, so they occupy the same
@@ -482,23 +775,63 @@ lily_var *lily_new_raw_var(lily_symtab *symtab, lily_type *type,
     return var;
 }
 
-static lily_var *find_var(lily_var *var_iter, const char *name,
-        uint64_t shorthash)
+/* Vars, classes, and class members are searched through an index of their
+   chain. Symbols are put at the front of chains without the index knowing, so
+   this brings the index up to date first. All of them begin like
+   lily_named_sym. */
+static lily_symbol_index *sync_index(lily_symbol_index **index_ref,
+        lily_named_sym *head)
 {
-    while (var_iter != NULL) {
-        /* TODO: Emitter marks vars as being out of scope so that it can grab
-           their types later during function finalize. While that's fine, the
-           vars shouldn't be left for the symtab to have to jump over. */
-        if (var_iter->shorthash == shorthash &&
-            ((var_iter->flags & VAR_OUT_OF_SCOPE) == 0) &&
-            strcmp(var_iter->name, name) == 0) {
+    lily_symbol_index *si = *index_ref;
 
-            break;
+    if (si == NULL) {
+        si = lily_new_symbol_index();
+        *index_ref = si;
+    }
+
+    lily_named_sym *top = lily_si_top(si);
+    lily_named_sym *sym_iter = head;
+    uint32_t count = 0;
+
+    while (sym_iter != top) {
+        if (sym_iter == NULL) {
+            /* The top isn't in the chain anymore, so start over. */
+            lily_si_rewind(si, NULL, NULL);
+            top = NULL;
+            sym_iter = head;
+            count = 0;
+            continue;
         }
-        var_iter = var_iter->next;
+
+        count++;
+        sym_iter = sym_iter->next;
+    }
+
+    if (count) {
+        lily_index_entry *entries = lily_si_reserve(si, count);
+        uint32_t i = count;
+
+        /* The chain is newest first, but the index is oldest first. */
+        for (sym_iter = head;sym_iter != top;sym_iter = sym_iter->next) {
+            i--;
+            entries[i].item = sym_iter;
+            entries[i].name = sym_iter->name;
+        }
+
+        lily_si_commit(si, count);
     }
 
-    return var_iter;
+    return si;
+}
+
+/* Vars that emitter has hidden are still in the chain, so skip over them. */
+static lily_var *find_var(lily_module_entry *module, const char *name,
+        uint32_t hash)
+{
+    lily_symbol_index *si = sync_index(&module->var_index,
+            (lily_named_sym *)module->var_chain);
+
+    return lily_si_find(si, name, hash, VAR_OUT_OF_SCOPE);
 }
 
 /* Try to find a var. If the given module is NULL, then search through both the
@@ -507,17 +840,16 @@ static lily_var *find_var(lily_var *var_iter, const char *name,
 lily_var *lily_find_var(lily_symtab *symtab, lily_module_entry *module,
         const char *name)
 {
-    uint64_t shorthash = shorthash_for_name(name);
+    uint32_t hash = lily_hash_name(name);
     lily_var *result;
 
     if (module == NULL) {
-        result = find_var(symtab->builtin_module->var_chain, name,
-                    shorthash);
+        result = find_var(symtab->builtin_module, name, hash);
         if (result == NULL)
-            result = find_var(symtab->active_module->var_chain, name, shorthash);
+            result = find_var(symtab->active_module, name, hash);
     }
     else
-        result = find_var(module->var_chain, name, shorthash);
+        result = find_var(module, name, hash);
 
     return result;
 }
@@ -568,6 +900,8 @@ lily_class *lily_new_raw_class(const char *name)
     new_class->members = NULL;
     new_class->module = NULL;
     new_class->all_subtypes = NULL;
+    new_class->type_table = NULL;
+    new_class->member_index = NULL;
     new_class->dyna_start = 0;
     new_class->inherit_depth = 0;
 
@@ -605,18 +939,13 @@ lily_class *lily_new_enum_class(lily_symtab *symtab, const char *name)
     return new_class;
 }
 
-static lily_class *find_class(lily_class *class_iter, const char *name,
-        uint64_t shorthash)
+static lily_class *find_class(lily_module_entry *module, const char *name,
+        uint32_t hash)
 {
-    while (class_iter) {
-        if (class_iter->shorthash == shorthash &&
-            strcmp(class_iter->name, name) == 0)
-            break;
+    lily_symbol_index *si = sync_index(&module->class_index,
+            (lily_named_sym *)module->class_chain);
 
-        class_iter = class_iter->next;
-    }
-
-    return class_iter;
+    return lily_si_find(si, name, hash, 0);
 }
 
 
@@ -626,50 +955,69 @@ static lily_class *find_class(lily_class *class_iter, const char *name,
 lily_class *lily_find_class(lily_symtab *symtab, lily_module_entry *module,
         const char *name)
 {
-    uint64_t shorthash = shorthash_for_name(name);
     lily_class *result;
 
     if (module == NULL) {
         if (name[1] != '\0') {
-            result = find_class(symtab->builtin_module->class_chain, name,
-                    shorthash);
+            uint32_t hash = lily_hash_name(name);
+
+            result = find_class(symtab->builtin_module, name, hash);
             if (result == NULL)
-                result = find_class(symtab->active_module->class_chain, name,
-                        shorthash);
+                result = find_class(symtab->active_module, name, hash);
         }
         else
             result = lily_gp_find(symtab->generics, name);
     }
     else
-        result = find_class(module->class_chain, name, shorthash);
+        result = find_class(module, name, lily_hash_name(name));
 
     return result;
 }
 
+/* Classes with up to this many members have them searched by walking them.
+   A class with more gets an index, which is made when it's first searched. */
+#define MEMBER_INDEX_START 8
+
 /* Does 'name' exist within 'cls' as either a var or a name? If so, return it.
-   If not, then return NULL. */
+   If not, then return NULL. Parent classes are searched after the class. */
 lily_named_sym *lily_find_member(lily_class *cls, const char *name)
 {
-    lily_named_sym *ret = NULL;
+    uint64_t shorthash = shorthash_for_name(name);
+    uint32_t hash = 0;
 
-    if (cls->members != NULL) {
-        uint64_t shorthash = shorthash_for_name(name);
+    do {
         lily_named_sym *sym_iter = cls->members;
-        while (sym_iter) {
-            if (sym_iter->name_shorthash == shorthash &&
-                strcmp(sym_iter->name, name) == 0) {
-                ret = (lily_named_sym *)sym_iter;
-                break;
+
+        if (cls->member_index == NULL) {
+            int count = 0;
+
+            while (sym_iter && count != MEMBER_INDEX_START) {
+                if (sym_iter->name_shorthash == shorthash &&
+                    strcmp(sym_iter->name, name) == 0)
+                    return sym_iter;
+
+                sym_iter = sym_iter->next;
+                count++;
             }
+        }
+
+        /* Either there's an index, or there are too many to walk. */
+        if (sym_iter) {
+            if (hash == 0)
+                hash = lily_hash_name(name);
+
+            lily_symbol_index *si = sync_index(&cls->member_index,
+                    cls->members);
+            lily_named_sym *sym = lily_si_find(si, name, hash, 0);
 
-            sym_iter = sym_iter->next;
+            if (sym)
+                return sym;
         }
-    }
 
-    if (ret == NULL && cls->parent != NULL)
-        ret = lily_find_member(cls->parent, name);
+        cls = cls->parent;
+    } while (cls);
 
-    return ret;
+    return NULL;
 }
 
 /* Try to find a method within the class given. The given class is search first,
@@ -702,7 +1050,7 @@ void lily_add_class_method(lily_symtab *symtab, lily_class *cls,
     /* Prevent class methods from being accessed globally, because they're now
        longer globals. */
     if (method_var == symtab->active_module->var_chain)
-        symtab->active_module->var_chain = method_var->next;
+        lily_rewind_var_chain(symtab, method_var->next);
 
     method_var->next = (lily_var *)cls->members;
     cls->members = (lily_named_sym *)method_var;
@@ -711,24 +1059,43 @@ void lily_add_class_method(lily_symtab *symtab, lily_class *cls,
 static lily_module_entry *find_module(lily_module_entry *module,
         const char *name)
 {
+    lily_symbol_index *si = module->link_index;
+
+    if (si == NULL) {
+        si = lily_new_symbol_index();
+        module->link_index = si;
+    }
+
+    lily_module_link *top = lily_si_top(si);
     lily_module_link *link_iter = module->module_chain;
-    lily_module_entry *result = NULL;
-    while (link_iter) {
-        char *as_name = link_iter->as_name;
-        char *loadname = link_iter->module->loadname;
-
-        /* If it was imported like 'import x as y', then as_name will be
-           non-null. In such a case, don't allow fallback access as 'x', just
-           in case something else is imported with the name 'x'. */
-        if ((as_name && strcmp(as_name, name) == 0) ||
-            (as_name == NULL && strcmp(loadname, name) == 0)) {
-            result = link_iter->module;
-            break;
-        }
+    uint32_t count = 0;
 
+    while (link_iter != top) {
+        count++;
         link_iter = link_iter->next_module;
     }
 
+    if (count) {
+        lily_index_entry *entries = lily_si_reserve(si, count);
+        uint32_t i = count;
+
+        for (link_iter = module->module_chain;
+             link_iter != top;
+             link_iter = link_iter->next_module) {
+            i--;
+            entries[i].item = link_iter;
+            entries[i].name = link_name(link_iter);
+        }
+
+        lily_si_commit(si, count);
+    }
+
+    lily_module_link *link = lily_si_find(si, name, lily_hash_name(name), 0);
+    lily_module_entry *result = NULL;
+
+    if (link)
+        result = link->module;
+
     return result;
 }
 
@@ -849,7 +1216,7 @@ void lily_finish_enum(lily_symtab *symtab, lily_class *enum_cls, int is_scoped,
         enum_cls->flags |= CLS_ENUM_IS_SCOPED;
         /* This removes the variants from symtab's classes, so that parser has
            to get them from the enum. */
-        symtab->active_module->class_chain = enum_cls;
+        lily_rewind_class_chain(symtab, enum_cls);
     }
 }
 
@@ -864,15 +1231,22 @@ void lily_finish_enum(lily_symtab *symtab, lily_class *enum_cls, int is_scoped,
 
 /* This loads the symtab's classes into the vm's class table. That class table
    is used to give classes out to instances and enums that are built. The class
-   information is later used to differentiate different instances. */
+   information is later used to differentiate different instances.
+   New classes are always put at the front of a module's chain, so the walk
+   through a module stops at the first class that the vm already has. That
+   keeps this proportional to the classes made since the last call. */
 void lily_register_classes(lily_symtab *symtab, lily_vm_state *vm)
 {
     lily_vm_ensure_class_table(vm, symtab->next_class_id + 1);
 
+    lily_class **class_table = vm->class_table;
     lily_module_entry *module_iter = symtab->builtin_module;
     while (module_iter) {
         lily_class *class_iter = module_iter->class_chain;
         while (class_iter) {
+            if (class_table[class_iter->id] == class_iter)
+                break;
+
             lily_vm_add_class_unchecked(vm, class_iter);
 
             if (class_iter->flags & CLS_ENUM_IS_SCOPED) {
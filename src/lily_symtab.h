@@ -14,6 +14,12 @@ typedef struct lily_symtab_ {
 
     lily_value_stack *literals;
 
+    /* A hash index of the literals above, by class and value. Each slot holds
+       the spot of a literal plus one, or 0 if the slot is empty. */
+    uint32_t *literal_slots;
+    uint32_t literal_mask;
+    uint32_t literal_count;
+
     lily_module_entry *builtin_module;
     lily_module_entry *active_module;
 
@@ -65,6 +71,14 @@ void lily_free_module_symbols(lily_symtab *, lily_module_entry *);
 void lily_hide_module_symbols(lily_symtab *, lily_module_entry *);
 void lily_rewind_symtab(lily_symtab *, lily_module_entry *, lily_class *,
         lily_var *, int);
+void lily_rewind_module_symbols(lily_module_entry *, lily_class *, lily_var *);
+void lily_rewind_var_chain(lily_symtab *, lily_var *);
+void lily_rewind_class_chain(lily_symtab *, lily_class *);
+void lily_rewind_module_links(lily_module_entry *, lily_module_link *);
+void lily_rewind_old_symbols(lily_symtab *, lily_var *, lily_class *,
+        lily_class *);
+void lily_rewind_literals(lily_symtab *, uint32_t);
+void lily_rewind_class(lily_class *, uint32_t);
 void lily_free_symtab(lily_symtab *);
 
 lily_literal *lily_get_integer_literal(lily_symtab *, int64_t);
@@ -8,6 +8,10 @@
 #define BUBBLE_FLAGS \
     (TYPE_IS_UNRESOLVED | TYPE_IS_INCOMPLETE | TYPE_HAS_SCOOP)
 
+/* Classes with up to this many types have them searched by walking them. A
+   class with more gets a table. */
+#define TYPE_TABLE_START 8
+
 lily_type_maker *lily_new_type_maker(void)
 {
     lily_type_maker *tm = lily_malloc(sizeof(lily_type_maker));
@@ -29,6 +33,8 @@ lily_type *lily_new_raw_type(lily_class *cls)
     new_type->subtype_count = 0;
     new_type->subtypes = NULL;
     new_type->next = NULL;
+    new_type->hash = 0;
+    new_type->pad = 0;
 
     return new_type;
 }
@@ -84,35 +90,178 @@ lily_type *lily_tm_pop(lily_type_maker *tm)
     return result;
 }
 
+/* Types are hashed by their content, never by where they are. Types made by
+   a snapshot's setup must have the same table layout every time. */
+
+static uint32_t mix_hash(uint32_t hash)
+{
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bU;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35U;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+/* The hash of a type that's inside of another type. Types without subtypes
+   (including classes acting as types) don't have a hash stored, so their class
+   and generic position stand in. */
+static uint32_t subtype_hash(lily_type *type)
+{
+    if (type == NULL)
+        return 0;
+
+    if (type->subtype_count == 0)
+        return mix_hash(((uint32_t)type->cls->id << 16) | type->generic_pos);
+
+    return type->hash;
+}
+
+static uint32_t hash_type(lily_type *type)
+{
+    uint32_t hash = 2166136261U ^ (type->flags & ~BUBBLE_FLAGS);
+    int i;
+
+    hash = (hash ^ type->subtype_count) * 16777619U;
+
+    for (i = 0;i < type->subtype_count;i++)
+        hash = (hash ^ subtype_hash(type->subtypes[i])) * 16777619U;
+
+    return mix_hash(hash);
+}
+
+static int type_matches(lily_type *iter_type, lily_type *input_type)
+{
+    if (iter_type->subtypes      == NULL ||
+        iter_type->subtype_count != input_type->subtype_count ||
+        (iter_type->flags & ~BUBBLE_FLAGS) !=
+            (input_type->flags & ~BUBBLE_FLAGS))
+        return 0;
+
+    int i;
+    for (i = 0;i < iter_type->subtype_count;i++) {
+        if (iter_type->subtypes[i] != input_type->subtypes[i])
+            return 0;
+    }
+
+    return 1;
+}
+
+static void table_insert(lily_type_table *table, lily_type *type)
+{
+    uint32_t mask = table->mask;
+    uint32_t i = type->hash & mask;
+
+    while (table->slots[i])
+        i = (i + 1) & mask;
+
+    table->slots[i] = type;
+    table->count++;
+}
+
+/* Tables are kept at most half full, so that runs of used slots stay short. */
+static void table_resize(lily_type_table *table, uint32_t slot_count)
+{
+    lily_type **old_slots = table->slots;
+    uint32_t old_count = table->mask + 1;
+    uint32_t i;
+
+    table->slots = lily_malloc(slot_count * sizeof(lily_type *));
+    memset(table->slots, 0, slot_count * sizeof(lily_type *));
+    table->mask = slot_count - 1;
+    table->count = 0;
+
+    for (i = 0;i < old_count;i++) {
+        if (old_slots[i])
+            table_insert(table, old_slots[i]);
+    }
+
+    lily_free(old_slots);
+}
+
+static void add_to_table(lily_type_table *table, lily_type *type)
+{
+    if ((table->count + 1) * 2 > table->mask + 1)
+        table_resize(table, (table->mask + 1) * 2);
+
+    table_insert(table, type);
+}
+
+static lily_type_table *new_type_table(lily_class *cls)
+{
+    lily_type_table *table = lily_malloc(sizeof(lily_type_table));
+    lily_type *iter_type = cls->all_subtypes;
+
+    table->slots = lily_malloc(4 * TYPE_TABLE_START * sizeof(lily_type *));
+    memset(table->slots, 0, 4 * TYPE_TABLE_START * sizeof(lily_type *));
+    table->count = 0;
+    table->mask = (4 * TYPE_TABLE_START) - 1;
+
+    /* Generics have a type without subtypes here, which is never looked up. */
+    while (iter_type) {
+        if (iter_type->subtypes)
+            add_to_table(table, iter_type);
+
+        iter_type = iter_type->next;
+    }
+
+    return table;
+}
+
+void lily_free_type_table(lily_type_table *table)
+{
+    if (table == NULL)
+        return;
+
+    lily_free(table->slots);
+    lily_free(table);
+}
+
+static lily_type *table_find(lily_type_table *table, lily_type *input_type)
+{
+    uint32_t mask = table->mask;
+    uint32_t hash = input_type->hash;
+    uint32_t i = hash & mask;
+
+    while (table->slots[i]) {
+        lily_type *iter_type = table->slots[i];
+
+        if (iter_type->hash == hash &&
+            type_matches(iter_type, input_type))
+            return iter_type;
+
+        i = (i + 1) & mask;
+    }
+
+    return NULL;
+}
+
 /* Try to see if a type that describes 'input_type' already exists. If so,
    return the existing type. If not, return NULL. */
 static lily_type *lookup_type(lily_type *input_type)
 {
-    lily_type *iter_type = input_type->cls->all_subtypes;
+    lily_class *cls = input_type->cls;
+
+    if (cls->type_table)
+        return table_find(cls->type_table, input_type);
+
+    lily_type *iter_type = cls->all_subtypes;
     lily_type *ret = NULL;
+    int count = 0;
 
     while (iter_type) {
-        if (iter_type->subtypes      != NULL &&
-            iter_type->subtype_count == input_type->subtype_count &&
-            (iter_type->flags & ~BUBBLE_FLAGS) ==
-                (input_type->flags & ~BUBBLE_FLAGS)) {
-            int i, match = 1;
-            for (i = 0;i < iter_type->subtype_count;i++) {
-                if (iter_type->subtypes[i] != input_type->subtypes[i]) {
-                    match = 0;
-                    break;
-                }
-            }
-
-            if (match == 1) {
-                ret = iter_type;
-                break;
-            }
+        if (type_matches(iter_type, input_type)) {
+            ret = iter_type;
+            break;
         }
 
         iter_type = iter_type->next;
+        count++;
     }
 
+    if (count > TYPE_TABLE_START)
+        cls->type_table = new_type_table(cls);
+
     return ret;
 }
 
@@ -134,6 +283,9 @@ static lily_type *build_real_type_for(lily_type *fake_type)
     new_type->next = new_type->cls->all_subtypes;
     new_type->cls->all_subtypes = new_type;
 
+    if (new_type->cls->type_table)
+        add_to_table(new_type->cls->type_table, new_type);
+
     int i;
     for (i = 0;i < new_type->subtype_count;i++) {
         lily_type *subtype = new_type->subtypes[i];
@@ -155,6 +307,8 @@ lily_type *lily_tm_make(lily_type_maker *tm, int flags, lily_class *cls,
     fake_type.subtype_count = num_entries;
     fake_type.flags = flags;
     fake_type.next = NULL;
+    fake_type.hash = hash_type(&fake_type);
+    fake_type.pad = 0;
 
     lily_type *result_type = lookup_type(&fake_type);
     if (result_type == NULL) {
@@ -14,6 +14,14 @@ typedef struct {
     lily_type *dynamic_class_type;
 } lily_type_maker;
 
+/* This is a hash table over the types of a class that has a lot of them. The
+   class's all_subtypes still owns the types. */
+typedef struct lily_type_table_ {
+    lily_type **slots;
+    uint32_t count;
+    uint32_t mask;
+} lily_type_table;
+
 lily_type_maker *lily_new_type_maker(void);
 void lily_tm_add(lily_type_maker *, lily_type *);
 void lily_tm_add_unchecked(lily_type_maker *, lily_type *);
@@ -29,5 +37,6 @@ void lily_tm_restore(lily_type_maker *, int);
 void lily_free_type_maker(lily_type_maker *);
 
 lily_type *lily_new_raw_type(lily_class *);
+void lily_free_type_table(lily_type_table *);
 
 #endif
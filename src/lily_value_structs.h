@@ -33,10 +33,8 @@ typedef union lily_raw_value_ {
    to receive it. These come in the following flavors:
    * Foreign values, which will be consumed by the vm to initialize globals.
      These don't need to store any additional information.
-   * The common kind of literals: Integers, Strings, and so on. These each use
-     the 'next_index' to store where the next of their group is, so that symtab
-     can search through them faster. The last one will have 'next_index' set to
-     0.
+   * The common kind of literals: Integers, Strings, and so on. Symtab keeps
+     a hash index to find these by their value.
 
    It is both intentional and important that these are the same size as a real
    value. This allows them to be manipulated by the vm using value-handling
@@ -46,10 +44,7 @@ typedef struct lily_literal_ {
         uint16_t class_id;
         uint32_t flags;
     };
-    union {
-        uint16_t pad;
-        uint16_t next_index;
-    };
+    uint16_t pad;
     uint16_t reg_spot;
     lily_raw_value value;
 } lily_literal;
@@ -87,6 +82,7 @@ typedef struct lily_value_ {
 typedef struct lily_string_val_ {
     uint32_t refcount;
     uint32_t size;
+    /* This points to the text, which is in the same block, after the string. */
     char *string;
 } lily_string_val;
 
@@ -101,14 +97,19 @@ typedef struct lily_bytestring_val_ {
 
 /* This serves List, Tuple, Dynamic, class instances, and variants. All they
    need is some container that holds N number of inner values. Some of them will
-   make use of the gc_entry, but others won't. */
+   make use of the gc_entry, but others won't.
+   The values are stored inline, in one array. A List grows that array, with
+   'extra_space' being how many values past 'num_values' it has room for. Since
+   the array can move when that happens, pointers to values inside of a List
+   are only good until it next changes size. Other containers never grow, so
+   their array is in the same block as the container (just after it). */
 typedef struct lily_container_val_ {
     uint32_t refcount;
     uint16_t class_id;
     uint16_t instance_ctor_need;
     uint32_t num_values;
     uint32_t extra_space;
-    struct lily_value_ **values;
+    struct lily_value_ *values;
     struct lily_gc_entry_ *gc_entry;
 } lily_container_val;
 
@@ -131,10 +131,20 @@ lily_vm_state *lily_new_vm_state(lily_options *options,
     vm->class_count = 0;
     vm->class_table = NULL;
     vm->stdout_reg = NULL;
+    vm->sink = NULL;
     vm->exception_value = NULL;
     vm->pending_line = 0;
     vm->include_last_frame_in_trace = 1;
     vm->options = options;
+    vm->lazy_imports = lily_new_buffer_u16(4);
+    vm->lazy_import_spots = lily_new_buffer_u16(4);
+    vm->lazy_owners = NULL;
+    vm->lazy_owner_size = 0;
+    vm->lazy_pending = 0;
+    vm->mark_global_count = 0;
+    vm->mark_lazy_count = 0;
+    vm->mark_globals = NULL;
+    vm->mark_lazy_imports = NULL;
 
     lily_vm_catch_entry *catch_entry = lily_malloc(sizeof(lily_vm_catch_entry));
     catch_entry->prev = NULL;
@@ -146,6 +156,7 @@ lily_vm_state *lily_new_vm_state(lily_options *options,
 }
 
 static void grow_vm_registers(lily_vm_state *, int);
+static void drop_mark(lily_vm_state *);
 
 void lily_setup_toplevel(lily_vm_state *vm, lily_function_val *toplevel)
 {
@@ -196,6 +207,10 @@ void lily_free_vm(lily_vm_state *vm)
     lily_value **regs_from_main = vm->regs_from_main;
     lily_value *reg;
     int i;
+
+    /* This goes first, since the sink may point to literals. */
+    if (vm->sink)
+        lily_free_sink(vm->sink);
     if (vm->catch_chain != NULL) {
         while (vm->catch_chain->prev)
             vm->catch_chain = vm->catch_chain->prev;
@@ -209,6 +224,10 @@ void lily_free_vm(lily_vm_state *vm)
         }
     }
 
+    /* The values held by the mark may be tagged, so they go before the gc
+       destroys what they point to. */
+    drop_mark(vm);
+
     /* If there are any entries left over, then do a final gc pass that will
        destroy the tagged values. */
     if (vm->gc_live_entry_count) {
@@ -241,6 +260,9 @@ void lily_free_vm(lily_vm_state *vm)
 
     destroy_gc_entries(vm);
 
+    lily_free_buffer_u16(vm->lazy_imports);
+    lily_free_buffer_u16(vm->lazy_import_spots);
+    lily_free(vm->lazy_owners);
     lily_free(vm->class_table);
     lily_free(vm);
 }
@@ -302,6 +324,14 @@ static void invoke_gc(lily_vm_state *vm)
             gc_mark(pass, reg);
     }
 
+    /* Globals given new values after a mark still hold their old values
+       here. */
+    for (i = 0;i < vm->mark_global_count;i++) {
+        lily_value *v = vm->mark_globals + i;
+        if (v->flags & VAL_IS_GC_SWEEPABLE)
+            gc_mark(pass, v);
+    }
+
     /* Stage 2: Start destroying everything that wasn't marked as visible.
                 Don't forget to check ->value for NULL in case the value was
                 destroyed through normal ref/deref means. */
@@ -396,7 +426,7 @@ static void list_marker(int pass, lily_value *v)
     int i;
 
     for (i = 0;i < list_val->num_values;i++) {
-        lily_value *elem = list_val->values[i];
+        lily_value *elem = list_val->values + i;
 
         if (elem->flags & VAL_IS_GC_SWEEPABLE)
             gc_mark(pass, elem);
@@ -455,18 +485,8 @@ static void gc_mark(int pass, lily_value *v)
     }
 }
 
-/* This will attempt to grab a spare entry and associate it with the value
-   given. If there are no spare entries, then a new entry is made. These entries
-   are how the gc is able to locate values later.
-
-   If the number of living gc objects is at or past the threshold, then the
-   collector will run BEFORE the association. This is intentional, as 'value' is
-   not guaranteed to be in a register. */
-void lily_value_tag(lily_vm_state *vm, lily_value *v)
+static void tag_value(lily_vm_state *vm, lily_value *v)
 {
-    if (vm->gc_live_entry_count >= vm->gc_threshold)
-        invoke_gc(vm);
-
     lily_gc_entry *new_entry;
     if (vm->gc_spare_entries != NULL) {
         new_entry = vm->gc_spare_entries;
@@ -489,6 +509,21 @@ void lily_value_tag(lily_vm_state *vm, lily_value *v)
     v->flags |= VAL_IS_GC_TAGGED;
 }
 
+/* This will attempt to grab a spare entry and associate it with the value
+   given. If there are no spare entries, then a new entry is made. These entries
+   are how the gc is able to locate values later.
+
+   If the number of living gc objects is at or past the threshold, then the
+   collector will run BEFORE the association. This is intentional, as 'value' is
+   not guaranteed to be in a register. */
+void lily_value_tag(lily_vm_state *vm, lily_value *v)
+{
+    if (vm->gc_live_entry_count >= vm->gc_threshold)
+        invoke_gc(vm);
+
+    tag_value(vm, v);
+}
+
 /***
  *      ____            _     _
  *     |  _ \ ___  __ _(_)___| |_ ___ _ __ ___
@@ -768,6 +803,25 @@ void lily_builtin__calltrace(lily_vm_state *vm)
 
 static void do_print(lily_vm_state *vm, FILE *target, lily_value *source)
 {
+    if (target == stdout && vm->sink) {
+        lily_sink *sink = vm->sink;
+
+        if (source->class_id == LILY_STRING_ID)
+            lily_sink_add_string(sink, source);
+        else {
+            lily_msgbuf *msgbuf = vm->vm_buffer;
+            lily_mb_flush(msgbuf);
+            lily_mb_add_value(msgbuf, vm, source);
+
+            const char *text = lily_mb_get(msgbuf);
+            lily_sink_add(sink, text, strlen(text));
+        }
+
+        lily_sink_add(sink, "\n", 1);
+        lily_return_unit(vm);
+        return;
+    }
+
     if (source->class_id == LILY_STRING_ID)
         fputs(source->value.string->string, target);
     else {
@@ -849,7 +903,7 @@ static void do_o_set_property(lily_vm_state *vm, uint16_t *code)
     ival = vm_regs[code[3]]->value.container;
     rhs_reg = vm_regs[code[4]];
 
-    lily_value_assign(ival->values[index], rhs_reg);
+    lily_value_assign(ival->values + index, rhs_reg);
 }
 
 static void do_o_get_property(lily_vm_state *vm, uint16_t *code)
@@ -863,7 +917,7 @@ static void do_o_get_property(lily_vm_state *vm, uint16_t *code)
     ival = vm_regs[code[3]]->value.container;
     result_reg = vm_regs[code[4]];
 
-    lily_value_assign(result_reg, ival->values[index]);
+    lily_value_assign(result_reg, ival->values + index);
 }
 
 /* This handles subscript assignment. The index is a register, and needs to be
@@ -908,7 +962,7 @@ static void do_o_set_item(lily_vm_state *vm, uint16_t *code)
             else if (index_int >= list_val->num_values)
                 boundary_error(vm, index_int);
 
-            lily_value_assign(list_val->values[index_int], rhs_reg);
+            lily_value_assign(list_val->values + index_int, rhs_reg);
         }
     }
     else
@@ -957,7 +1011,7 @@ static void do_o_get_item(lily_vm_state *vm, uint16_t *code)
             else if (index_int >= list_val->num_values)
                 boundary_error(vm, index_int);
 
-            lily_value_assign(result_reg, list_val->values[index_int]);
+            lily_value_assign(result_reg, list_val->values + index_int);
         }
     }
     else {
@@ -1018,12 +1072,12 @@ static void do_o_build_list_tuple(lily_vm_state *vm, uint16_t *code)
         lily_move_tuple_f(MOVE_DEREF_SPECULATIVE, result, (lily_container_val *)lv);
     }
 
-    lily_value **elems = lv->values;
+    lily_value *elems = lv->values;
 
     int i;
     for (i = 0;i < num_elems;i++) {
         lily_value *rhs_reg = vm_regs[code[3+i]];
-        lily_value_assign(elems[i], rhs_reg);
+        lily_value_assign(elems + i, rhs_reg);
     }
 }
 
@@ -1035,14 +1089,14 @@ static void do_o_build_enum(lily_vm_state *vm, uint16_t *code)
     lily_value *result = vm_regs[code[code[3] + 4]];
 
     lily_container_val *ival = lily_new_variant(variant_id, count);
-    lily_value **slots = ival->values;
+    lily_value *slots = ival->values;
 
     lily_move_variant_f(MOVE_DEREF_SPECULATIVE, result, ival);
 
     int i;
     for (i = 0;i < count;i++) {
         lily_value *rhs_reg = vm_regs[code[4+i]];
-        lily_value_assign(slots[i], rhs_reg);
+        lily_value_assign(slots + i, rhs_reg);
     }
 }
 
@@ -1054,7 +1108,7 @@ static void do_o_raise(lily_vm_state *vm, lily_value *exception_val)
        container for traceback. */
 
     lily_container_val *ival = exception_val->value.container;
-    char *message = ival->values[0]->value.string->string;
+    char *message = ival->values[0].value.string->string;
     lily_class *raise_cls = vm->class_table[ival->class_id];
 
     /* There's no need for a ref/deref here, because the gc cannot trigger
@@ -1414,7 +1468,7 @@ static lily_container_val *build_traceback_raw(lily_vm_state *vm)
         const char *str = lily_mb_sprintf(msgbuf, "%s:%s from %s%s%s", path,
                 line, class_name, separator, name);
 
-        lily_move_string(lv->values[i - 1], lily_new_string(str));
+        lily_move_string(lv->values + i - 1, lily_new_string(str));
     }
 
     return lv;
@@ -1433,8 +1487,9 @@ static void make_proper_exception_val(lily_vm_state *vm,
     lily_mb_flush(vm->raiser->msgbuf);
 
     /* Stick with moves just to be safe. */
-    lily_move_string(ival->values[0], message);
-    lily_move_list_f(MOVE_DEREF_NO_GC, ival->values[1], build_traceback_raw(vm));
+    lily_move_string(ival->values, message);
+    lily_move_list_f(MOVE_DEREF_NO_GC, ival->values + 1,
+            build_traceback_raw(vm));
 
     lily_move_instance_f(MOVE_DEREF_SPECULATIVE, result, ival);
 }
@@ -1451,6 +1506,20 @@ static void fixup_exception_val(lily_vm_state *vm, lily_value *result)
     lily_move_list_f(MOVE_DEREF_SPECULATIVE, lily_nth_get(iv, 1), raw_trace);
 }
 
+/* This checks if 'f' is the import function of a lazy import. */
+static int is_lazy_import(lily_vm_state *vm, lily_function_val *f)
+{
+    uint16_t *spots = vm->lazy_import_spots->data;
+    uint32_t i, count = lily_u16_pos(vm->lazy_import_spots);
+
+    for (i = 0;i < count;i++) {
+        if (vm->readonly_table[spots[i]]->value.function == f)
+            return 1;
+    }
+
+    return 0;
+}
+
 /* This attempts to catch the exception that the raiser currently holds. If it
    succeeds, then the vm's state is updated and the exception is cleared out.
 
@@ -1528,6 +1597,22 @@ static int maybe_catch_exception(lily_vm_state *vm)
         catch_iter = catch_iter->prev;
     }
 
+    /* An exception that leaves a lazy import can't be caught. The module's
+       vars might not have values, so it can't be used after that. Imports
+       that aren't lazy are never inside of a try block. */
+    if (match && lily_u16_pos(vm->lazy_import_spots)) {
+        lily_call_frame *frame_iter = vm->call_chain;
+
+        while (frame_iter != catch_iter->call_frame) {
+            if (is_lazy_import(vm, frame_iter->function)) {
+                match = 0;
+                break;
+            }
+
+            frame_iter = frame_iter->prev;
+        }
+    }
+
     if (match) {
         if (do_unbox) {
             /* There is a var that the exception needs to be dropped into. If
@@ -1666,6 +1751,20 @@ void lily_call_simple(lily_vm_state *vm, lily_function_val *f, int count)
     lily_call_exec_prepared(vm, count);
 }
 
+/* This calls 'func' (which takes no arguments) from the toplevel frame, when
+   nothing else is running. Parser uses this to render a prepared template. The
+   result goes just past the globals, so that register is made sure to exist. */
+void lily_vm_call_toplevel(lily_vm_state *vm, lily_function_val *func)
+{
+    lily_call_frame *toplevel_frame = vm->call_chain;
+
+    if (toplevel_frame->total_regs >= vm->max_registers)
+        grow_vm_registers(vm, toplevel_frame->total_regs + 1);
+
+    lily_call_prepare(vm, func);
+    lily_call_exec_prepared(vm, 0);
+}
+
 /***
  *      ____
  *     |  _ \ _ __ ___ _ __
@@ -1698,16 +1797,14 @@ void lily_vm_ensure_class_table(lily_vm_state *vm, int size)
 
         vm->class_table = lily_realloc(vm->class_table,
                 sizeof(lily_class *) * vm->class_count);
-    }
 
-    /* For the first pass, make sure the spots for Exception and its built-in
-       children are zero'ed out. This allows vm_error to safely check if an
-       exception class has been loaded by testing the class field for being NULL
-       (and relies on holes being set aside for these exceptions). */
-    if (old_count == 0) {
-        int i;
-        for (i = LILY_EXCEPTION_ID;i < START_CLASS_ID;i++)
-            vm->class_table[i] = NULL;
+        /* New spots are zero'ed out. This allows vm_error to safely check if
+           an exception class has been loaded by testing the class field for
+           being NULL (and relies on holes being set aside for these
+           exceptions). Class registration also uses this to tell which
+           classes it has already seen. */
+        memset(vm->class_table + old_count, 0,
+                sizeof(lily_class *) * (vm->class_count - old_count));
     }
 }
 
@@ -1799,6 +1896,377 @@ void lily_vm_prep(lily_vm_state *vm, lily_symtab *symtab,
     vm->call_depth = 1;
 }
 
+static void drop_mark(lily_vm_state *vm)
+{
+    uint32_t i;
+
+    for (i = 0;i < vm->mark_global_count;i++)
+        lily_deref(vm->mark_globals + i);
+
+    lily_free(vm->mark_globals);
+    lily_free(vm->mark_lazy_imports);
+    vm->mark_globals = NULL;
+    vm->mark_lazy_imports = NULL;
+    vm->mark_global_count = 0;
+    vm->mark_lazy_count = 0;
+}
+
+/* While values are copied, this maps each container (or hash) seen to its
+   copy. Values shared by globals (or by a value and itself) stay shared. */
+typedef struct {
+    void **from;
+    void **to;
+    uint32_t size;
+    uint32_t count;
+} lily_copy_memo;
+
+#define memo_slot(memo, p) \
+    ((uint32_t)((uintptr_t)(p) >> 4) & ((memo)->size - 1))
+
+static void init_memo(lily_copy_memo *memo)
+{
+    memo->size = 16;
+    memo->count = 0;
+    memo->from = lily_malloc(memo->size * sizeof(*memo->from));
+    memo->to = lily_malloc(memo->size * sizeof(*memo->to));
+    memset(memo->from, 0, memo->size * sizeof(*memo->from));
+}
+
+static void free_memo(lily_copy_memo *memo)
+{
+    lily_free(memo->from);
+    lily_free(memo->to);
+}
+
+static void *memo_find(lily_copy_memo *memo, void *from)
+{
+    uint32_t i = memo_slot(memo, from);
+
+    while (memo->from[i]) {
+        if (memo->from[i] == from)
+            return memo->to[i];
+
+        i = (i + 1) & (memo->size - 1);
+    }
+
+    return NULL;
+}
+
+static void memo_add(lily_copy_memo *memo, void *from, void *to)
+{
+    uint32_t i;
+
+    if ((memo->count + 1) * 2 > memo->size) {
+        void **old_from = memo->from;
+        void **old_to = memo->to;
+        uint32_t old_size = memo->size;
+
+        memo->size *= 2;
+        memo->count = 0;
+        memo->from = lily_malloc(memo->size * sizeof(*memo->from));
+        memo->to = lily_malloc(memo->size * sizeof(*memo->to));
+        memset(memo->from, 0, memo->size * sizeof(*memo->from));
+
+        for (i = 0;i < old_size;i++) {
+            if (old_from[i])
+                memo_add(memo, old_from[i], old_to[i]);
+        }
+
+        lily_free(old_from);
+        lily_free(old_to);
+    }
+
+    i = memo_slot(memo, from);
+
+    while (memo->from[i])
+        i = (i + 1) & (memo->size - 1);
+
+    memo->from[i] = from;
+    memo->to[i] = to;
+    memo->count++;
+}
+
+static void copy_value(lily_vm_state *, lily_copy_memo *, lily_value *,
+        lily_value *);
+
+static void *copy_hash(lily_vm_state *vm, lily_copy_memo *memo,
+        lily_hash_val *hv)
+{
+    lily_hash_val *new_hv = lily_new_hash_copy(hv);
+    int i;
+
+    memo_add(memo, hv, new_hv);
+
+    for (i = 0;i < new_hv->num_bins;i++) {
+        lily_hash_entry *entry;
+
+        for (entry = new_hv->bins[i];entry;entry = entry->next)
+            copy_value(vm, memo, entry->record, entry->record);
+    }
+
+    return new_hv;
+}
+
+static void *copy_container(lily_vm_state *vm, lily_copy_memo *memo,
+        lily_value *v)
+{
+    lily_container_val *cv = v->value.container;
+    lily_container_val *new_cv;
+    uint32_t i;
+
+    if (cv->class_id == LILY_LIST_ID)
+        new_cv = lily_new_list(cv->num_values);
+    else
+        new_cv = lily_new_variant(cv->class_id, cv->num_values);
+
+    new_cv->instance_ctor_need = 0;
+    memo_add(memo, cv, new_cv);
+
+    /* Tag the copy without letting the gc run, since the copies made so far
+       aren't anywhere that it looks. */
+    if (v->flags & VAL_IS_GC_TAGGED) {
+        lily_value tagged;
+
+        tagged.flags = v->flags;
+        tagged.value.container = new_cv;
+        tag_value(vm, &tagged);
+    }
+
+    for (i = 0;i < cv->num_values;i++)
+        copy_value(vm, memo, new_cv->values + i, cv->values + i);
+
+    return new_cv;
+}
+
+/* This assigns 'dest' a copy of 'src'. Lists, Hashes, and other containers
+   are copied all the way down, since code can change what's inside of them.
+   Other values are shared, since they can't be changed. */
+static void copy_value(lily_vm_state *vm, lily_copy_memo *memo,
+        lily_value *dest, lily_value *src)
+{
+    lily_value v = *src;
+    int class_id = src->class_id;
+
+    if (class_id == LILY_HASH_ID ||
+        class_id == LILY_LIST_ID ||
+        src->flags & VAL_IS_CONTAINER) {
+        void *copy = memo_find(memo, src->value.generic);
+
+        if (copy == NULL) {
+            if (class_id == LILY_HASH_ID)
+                copy = copy_hash(vm, memo, src->value.hash);
+            else
+                copy = copy_container(vm, memo, src);
+        }
+
+        v.value.generic = copy;
+    }
+
+    lily_value_assign(dest, &v);
+}
+
+/* This is called when parser marks the state. The globals made so far keep a
+   copy of their values, which is copied again for each reset. Code run after
+   the mark can change what's inside of them, or assign them values of classes
+   that a reset destroys. Which lazy imports have run is saved for the same
+   reason. */
+void lily_vm_mark(lily_vm_state *vm, uint16_t global_count)
+{
+    lily_value **regs_from_main = vm->regs_from_main;
+    lily_copy_memo memo;
+    uint32_t i;
+
+    drop_mark(vm);
+
+    /* Globals past the registers haven't been given a value yet. */
+    if (global_count > vm->max_registers)
+        global_count = (uint16_t)vm->max_registers;
+
+    vm->mark_globals = lily_malloc((global_count + 1) * sizeof(lily_value));
+    init_memo(&memo);
+
+    for (i = 0;i < global_count;i++) {
+        vm->mark_globals[i].flags = 0;
+        copy_value(vm, &memo, vm->mark_globals + i, regs_from_main[i]);
+    }
+
+    free_memo(&memo);
+
+    uint32_t lazy_count = lily_u16_pos(vm->lazy_imports);
+
+    vm->mark_lazy_imports = lily_malloc((lazy_count + 1) * sizeof(uint16_t));
+
+    for (i = 0;i < lazy_count;i++)
+        vm->mark_lazy_imports[i] = lily_u16_get(vm->lazy_imports, i);
+
+    vm->mark_global_count = global_count;
+    vm->mark_lazy_count = (uint16_t)lazy_count;
+}
+
+/* This is called when parser resets the state to the mark. Globals from before
+   the mark get a fresh copy of the values they had, so the next reset finds
+   the mark as it was. Registers from 'global_count' onward belong to vars made
+   after the mark, so their values are dropped. Like teardown, the gc goes first
+   so that it can take care of values that are only held by those registers. */
+void lily_vm_reset(lily_vm_state *vm, uint16_t global_count)
+{
+    lily_value **regs_from_main = vm->regs_from_main;
+    lily_copy_memo memo;
+    int i;
+
+    init_memo(&memo);
+
+    for (i = 0;i < vm->mark_global_count;i++)
+        copy_value(vm, &memo, regs_from_main[i], vm->mark_globals + i);
+
+    free_memo(&memo);
+
+    if (vm->stdout_reg) {
+        for (i = global_count;i < vm->max_registers;i++) {
+            if (regs_from_main[i] == vm->stdout_reg)
+                break;
+        }
+
+        /* stdout is about to go away, so print goes back to C's stdout. */
+        if (i != vm->max_registers) {
+            lily_symtab *symtab = vm->symtab;
+            lily_var *print_var = lily_find_var(symtab,
+                    symtab->builtin_module, "print");
+
+            if (print_var) {
+                lily_value *print_value =
+                        vm->readonly_table[print_var->reg_spot];
+                print_value->value.function->foreign_func = lily_builtin__print;
+            }
+
+            vm->stdout_reg = NULL;
+        }
+    }
+
+    if (vm->gc_live_entry_count) {
+        vm->call_chain->total_regs = global_count;
+        invoke_gc(vm);
+    }
+
+    for (i = global_count;i < vm->max_registers;i++) {
+        lily_value *reg = regs_from_main[i];
+
+        lily_deref(reg);
+        reg->flags = 0;
+    }
+
+    vm->call_chain->regs_used = global_count;
+    vm->call_chain->total_regs = global_count;
+
+    /* Globals past this point are gone, so nothing owns them anymore. */
+    if (vm->lazy_owner_size > global_count)
+        memset(vm->lazy_owners + global_count, 0,
+                (vm->lazy_owner_size - global_count) * sizeof(uint16_t));
+
+    /* Lazy imports that ran after the mark have to run again, since their
+       globals were just put back. */
+    lily_u16_set_pos(vm->lazy_imports, vm->mark_lazy_count);
+    lily_u16_set_pos(vm->lazy_import_spots, vm->mark_lazy_count);
+    vm->lazy_pending = 0;
+
+    for (i = 0;i < vm->mark_lazy_count;i++) {
+        uint16_t import_spot = vm->mark_lazy_imports[i];
+
+        lily_u16_insert(vm->lazy_imports, i, import_spot);
+
+        if (import_spot)
+            vm->lazy_pending++;
+    }
+}
+
+/* Parser calls this when a module has been imported lazily. The globals that
+   are claimed after this belong to it, until the next lazy import. */
+void lily_vm_add_lazy_import(lily_vm_state *vm, uint16_t import_spot)
+{
+    lily_u16_write_1(vm->lazy_imports, import_spot + 1);
+    lily_u16_write_1(vm->lazy_import_spots, import_spot);
+    vm->lazy_pending++;
+}
+
+void lily_vm_claim_global(lily_vm_state *vm, uint16_t spot)
+{
+    if (spot >= vm->lazy_owner_size) {
+        uint32_t new_size = vm->lazy_owner_size ? vm->lazy_owner_size : 64;
+
+        while (spot >= new_size)
+            new_size *= 2;
+
+        vm->lazy_owners = lily_realloc(vm->lazy_owners,
+                new_size * sizeof(uint16_t));
+        memset(vm->lazy_owners + vm->lazy_owner_size, 0,
+                (new_size - vm->lazy_owner_size) * sizeof(uint16_t));
+        vm->lazy_owner_size = new_size;
+    }
+
+    vm->lazy_owners[spot] = (uint16_t)lily_u16_pos(vm->lazy_imports);
+}
+
+/* If the global given belongs to a lazy import that hasn't run, this returns
+   the import function to run first. The import is marked as run, so that it's
+   only ever started once. Otherwise, this returns NULL. */
+static lily_function_val *take_lazy_import(lily_vm_state *vm, uint16_t spot)
+{
+    if (spot >= vm->lazy_owner_size || vm->lazy_owners[spot] == 0)
+        return NULL;
+
+    uint16_t pos = vm->lazy_owners[spot] - 1;
+    uint16_t import_spot = lily_u16_get(vm->lazy_imports, pos);
+
+    if (import_spot == 0)
+        return NULL;
+
+    lily_u16_insert(vm->lazy_imports, pos, 0);
+    vm->lazy_pending--;
+    return vm->readonly_table[import_spot - 1]->value.function;
+}
+
+/* This pushes a frame for a call to the native function 'fval'. The caller is
+   left at 'resume' (on 'line'), which is where it picks up once the call
+   returns. The new frame's registers are not set up, and the frame is not made
+   current. Registers may grow, so the caller must reload its copies of them. */
+static lily_call_frame *push_native_frame(lily_vm_state *vm,
+        lily_function_val *fval, uint16_t line, uint16_t *resume,
+        lily_value **upvalues, lily_value *return_target)
+{
+    lily_call_frame *current_frame = vm->call_chain;
+
+    if (current_frame->next == NULL) {
+        if (vm->call_depth > 100)
+            vm_error(vm, LILY_RUNTIMEERROR_ID,
+                    "Function call recursion limit reached.");
+        add_call_frame(vm);
+    }
+
+    current_frame->line_num = line;
+    current_frame->code = resume;
+    current_frame->upvalues = upvalues;
+    int register_need = fval->reg_count + current_frame->total_regs;
+
+    lily_call_frame *next_frame = current_frame->next;
+    next_frame->offset_to_start = current_frame->total_regs;
+    next_frame->function = fval;
+    next_frame->line_num = -1;
+    next_frame->code = fval->code;
+    next_frame->upvalues = NULL;
+    next_frame->regs_used = fval->reg_count;
+    next_frame->locals = vm->regs_from_main + next_frame->offset_to_start;
+    next_frame->total_regs = next_frame->offset_to_start + fval->reg_count;
+    next_frame->return_target = return_target;
+
+    if (register_need > (int)vm->max_registers) {
+        vm->call_chain = next_frame;
+        grow_vm_registers(vm, register_need);
+    }
+
+    vm->call_chain = current_frame;
+    return next_frame;
+}
+
 /***
  *      _____                     _
  *     | ____|_  _____  ___ _   _| |_ ___
@@ -2080,38 +2548,12 @@ void lily_vm_execute(lily_vm_state *vm)
 
                 native_func_body: ;
 
-                if (current_frame->next == NULL) {
-                    if (vm->call_depth > 100)
-                        vm_error(vm, LILY_RUNTIMEERROR_ID,
-                                "Function call recursion limit reached.");
-                    add_call_frame(vm);
-                }
-
                 i = code[3];
-                current_frame->line_num = code[1];
-                current_frame->code = code + i + 5;
-                current_frame->upvalues = upvalues;
-                int register_need = fval->reg_count + current_frame->total_regs;
-
-                next_frame = current_frame->next;
-                next_frame->offset_to_start = current_frame->total_regs;
-                next_frame->function = fval;
-                next_frame->line_num = -1;
-                next_frame->code = fval->code;
-                next_frame->upvalues = NULL;
-                next_frame->regs_used = fval->reg_count;
-                next_frame->locals = vm->regs_from_main + next_frame->offset_to_start;
-                next_frame->total_regs =
-                        next_frame->offset_to_start + fval->reg_count;
-                next_frame->return_target = vm_regs[code[4]];
-
-                if (register_need > max_registers) {
-                    vm->call_chain = next_frame;
-                    grow_vm_registers(vm, register_need);
-                    /* Don't forget to update local info... */
-                    regs_from_main = vm->regs_from_main;
-                    max_registers  = vm->max_registers;
-                }
+                next_frame = push_native_frame(vm, fval, code[1],
+                        code + i + 5, upvalues, vm_regs[code[4]]);
+                /* Don't forget to update local info... */
+                regs_from_main = vm->regs_from_main;
+                max_registers = vm->max_registers;
 
                 /* Prepare the registers for what the function wants. */
                 prep_registers(current_frame, code);
@@ -2120,7 +2562,7 @@ void lily_vm_execute(lily_vm_state *vm)
 
                 /* !PAST HERE TARGETS THE NEW FRAME! */
 
-                current_frame = current_frame->next;
+                current_frame = next_frame;
                 vm->call_chain = current_frame;
 
                 vm->call_depth++;
@@ -2178,6 +2620,12 @@ void lily_vm_execute(lily_vm_state *vm)
                 code = current_frame->code;
                 break;
             case o_get_global:
+                if (vm->lazy_pending &&
+                    (fval = take_lazy_import(vm, code[2])) != NULL) {
+                    lhs_reg = vm_regs[code[3]];
+                    goto lazy_import_body;
+                }
+
                 rhs_reg = regs_from_main[code[2]];
                 lhs_reg = vm_regs[code[3]];
 
@@ -2185,12 +2633,42 @@ void lily_vm_execute(lily_vm_state *vm)
                 code += 4;
                 break;
             case o_set_global:
+                if (vm->lazy_pending &&
+                    (fval = take_lazy_import(vm, code[3])) != NULL) {
+                    lhs_reg = regs_from_main[code[3]];
+                    goto lazy_import_body;
+                }
+
                 rhs_reg = vm_regs[code[2]];
                 lhs_reg = regs_from_main[code[3]];
 
                 lily_value_assign(lhs_reg, rhs_reg);
                 code += 4;
                 break;
+
+                /* The module that owns the global runs first, as a call that
+                   takes no arguments and returns to the instruction that
+                   wanted the global. That instruction then runs again. */
+                lazy_import_body:
+
+                next_frame = push_native_frame(vm, fval, code[1], code,
+                        upvalues, lhs_reg);
+                regs_from_main = vm->regs_from_main;
+                max_registers = vm->max_registers;
+                vm_regs = next_frame->locals;
+
+                for (i = 0;i < fval->reg_count;i++) {
+                    lily_deref(vm_regs[i]);
+                    vm_regs[i]->flags = 0;
+                }
+
+                current_frame = next_frame;
+                vm->call_chain = current_frame;
+
+                vm->call_depth++;
+                code = fval->code;
+                upvalues = NULL;
+                break;
             case o_assign:
                 rhs_reg = vm_regs[code[2]];
                 lhs_reg = vm_regs[code[3]];
@@ -2254,6 +2732,19 @@ void lily_vm_execute(lily_vm_state *vm)
             case o_optarg_dispatch:
                 code += do_o_optarg_dispatch(vm, code);
                 break;
+            case o_render_content:
+                rhs_reg = vm->readonly_table[code[2]];
+
+                if (vm->sink)
+                    lily_sink_add_static(vm->sink,
+                            rhs_reg->value.string->string,
+                            rhs_reg->value.string->size);
+                else
+                    vm->options->render_func(rhs_reg->value.string->string,
+                            vm->options->data);
+
+                code += 3;
+                break;
             case o_integer_for:
                 /* loop_reg is an internal counter, while lhs_reg is an external
                    counter. rhs_reg is the stopping point. */
@@ -2333,13 +2824,13 @@ void lily_vm_execute(lily_vm_state *vm)
             case o_variant_decompose:
             {
                 rhs_reg = vm_regs[code[2]];
-                lily_value **decompose_values = rhs_reg->value.container->values;
+                lily_value *decompose_values = rhs_reg->value.container->values;
 
                 /* Each variant value gets mapped away to a register. The
                    emitter ensures that the decomposition won't go too far. */
                 for (i = 0;i < code[3];i++) {
                     lhs_reg = vm_regs[code[4 + i]];
-                    lily_value_assign(lhs_reg, decompose_values[i]);
+                    lily_value_assign(lhs_reg, decompose_values + i);
                 }
 
                 code += 4 + i;
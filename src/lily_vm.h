@@ -1,9 +1,11 @@
 #ifndef LILY_VM_H
 # define LILY_VM_H
 
+# include "lily_buffer_u16.h"
 # include "lily_raiser.h"
 # include "lily_symtab.h"
 # include "lily_options.h"
+# include "lily_sink.h"
 
 typedef struct lily_call_frame_ {
     lily_value **locals;
@@ -107,6 +109,35 @@ typedef struct lily_vm_state_ {
     /* If stdout has been dynaloaded, then this is the register that holds
        Lily's stdout. Otherwise, this is NULL. */
     lily_value *stdout_reg;
+
+    /* If the embedder gave a flush function, template content and writes to
+       stdout go here. Otherwise, this is NULL. */
+    lily_sink *sink;
+
+    /* Modules imported lazily (see lily_op_lazy_imports) don't run until one
+       of their globals is used. This holds the spot of each one's import
+       function plus one, or 0 once that module has run. */
+    lily_buffer_u16 *lazy_imports;
+
+    /* The spot of each lazy import's function, in the same order. Unlike the
+       above, these stay after the module runs. */
+    lily_buffer_u16 *lazy_import_spots;
+
+    /* For each global, the position of the lazy import that owns it plus one,
+       or 0 if the global isn't owned by one. */
+    uint16_t *lazy_owners;
+    uint32_t lazy_owner_size;
+
+    /* How many lazy imports haven't run yet. Globals aren't checked against
+       the owners unless this is above 0. */
+    uint32_t lazy_pending;
+
+    /* The values of the globals and the lazy imports when the state was last
+       marked, which a reset puts back. The gc marks these values too. */
+    uint16_t mark_global_count;
+    uint16_t mark_lazy_count;
+    lily_value *mark_globals;
+    uint16_t *mark_lazy_imports;
 } lily_vm_state;
 
 struct lily_value_stack_;
@@ -115,6 +146,11 @@ lily_vm_state *lily_new_vm_state(lily_options *, lily_raiser *);
 void lily_free_vm(lily_vm_state *);
 void lily_vm_prep(lily_vm_state *, lily_symtab *, lily_value **,
         struct lily_value_stack_ *);
+void lily_vm_mark(lily_vm_state *, uint16_t);
+void lily_vm_reset(lily_vm_state *, uint16_t);
+void lily_vm_add_lazy_import(lily_vm_state *, uint16_t);
+void lily_vm_claim_global(lily_vm_state *, uint16_t);
+void lily_vm_call_toplevel(lily_vm_state *, lily_function_val *);
 void lily_setup_toplevel(lily_vm_state *, lily_function_val *);
 void lily_vm_execute(lily_vm_state *);
 uint64_t lily_siphash(lily_vm_state *, lily_value *);
@@ -170,6 +170,40 @@ lily_hash_val *lily_new_hash_like_sized(lily_hash_val *other, int size)
     return new_table_sized(size, other->compare_fn, other->hash_fn);
 }
 
+/* This makes a hash with the same bins as 'other', with entries in the same
+   order, so that both are walked alike. The keys and records are shared. */
+lily_hash_val *lily_new_hash_copy(lily_hash_val *other)
+{
+    lily_hash_val *tbl = lily_malloc(sizeof(lily_hash_val));
+    int i;
+
+    *tbl = *other;
+    tbl->refcount = 0;
+    tbl->iter_count = 0;
+    tbl->bins = (lily_hash_entry **)lily_malloc(
+            tbl->num_bins * sizeof(lily_hash_entry *));
+
+    for (i = 0;i < tbl->num_bins;i++) {
+        lily_hash_entry *ptr = other->bins[i];
+        lily_hash_entry **link = &tbl->bins[i];
+
+        while (ptr) {
+            lily_hash_entry *entry = lily_malloc(sizeof(lily_hash_entry));
+
+            *entry = *ptr;
+            entry->boxed_key = lily_value_copy(ptr->boxed_key);
+            entry->record = lily_value_copy(ptr->record);
+            *link = entry;
+            link = &entry->next;
+            ptr = ptr->next;
+        }
+
+        *link = NULL;
+    }
+
+    return tbl;
+}
+
 static void rehash(lily_hash_val *table)
 {
     lily_hash_entry *ptr, *next, **new_bins;
@@ -0,0 +1,1010 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+
+#ifdef _WIN32
+# include <direct.h>
+# include <sys/utime.h>
+# define chdir _chdir
+#else
+# include <unistd.h>
+# include <utime.h>
+#endif
+
+#ifdef LILY_API_TEST_THREADS
+# include <pthread.h>
+#endif
+
+#include "lily_api_embed.h"
+#include "lily_api_value.h"
+#include "lily_api_dyna.h"
+
+/* These test parts of the embedding api that can't be reached from a script.
+   pre-commit-hook.py runs each test in a process of its own, by name. A test
+   that passes doesn't print anything. A test that fails writes why to stderr.
+   Most checks are done by the Lily code given to a state, which raises an error
+   (and fails the parse) if something is wrong. */
+
+static int fail_count = 0;
+
+static void fail(const char *fmt, ...)
+{
+    va_list var_args;
+    va_start(var_args, fmt);
+    vfprintf(stderr, fmt, var_args);
+    va_end(var_args);
+    fputc('\n', stderr);
+    fail_count++;
+}
+
+/* Parse the code given, failing the test (with the error) if it doesn't
+   work. */
+static void expect_parse(lily_state *s, const char *context,
+        const char *source)
+{
+    if (lily_parse_string(s, context, source) == 0)
+        fail("%s: Unexpected error.\n%s", context, lily_get_error(s));
+}
+
+/* Tests write their files into a directory in the build tree. */
+static const char *test_path(char *buffer, const char *name)
+{
+    sprintf(buffer, "%s/%s", LILY_API_TEST_DIR, name);
+    return buffer;
+}
+
+static void write_file(const char *path, const char *text)
+{
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        fail("Cannot open '%s' for writing.", path);
+        return;
+    }
+
+    fputs(text, f);
+    fclose(f);
+}
+
+/* This writes 'text' over the file at 'path', then puts the file's time back.
+   If 'text' is the same size as before, then the file looks unchanged to a
+   code cache. */
+static void rewrite_keeping_stamp(const char *path, const char *text)
+{
+    struct stat st;
+    struct utimbuf times;
+
+    if (stat(path, &st) != 0) {
+        fail("Cannot stat '%s'.", path);
+        return;
+    }
+
+    write_file(path, text);
+    times.actime = st.st_atime;
+    times.modtime = st.st_mtime;
+    utime(path, &times);
+}
+
+static int file_exists(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0;
+}
+
+/* Tests collect what a state prints through a flush function. */
+static char output[4096];
+static size_t output_pos;
+
+static void collect_output(lily_out_chunk *chunks, int count, void *data)
+{
+    int i;
+
+    for (i = 0;i < count;i++) {
+        size_t size = chunks[i].size;
+
+        if (output_pos + size >= sizeof(output))
+            size = sizeof(output) - output_pos - 1;
+
+        memcpy(output + output_pos, chunks[i].data, size);
+        output_pos += size;
+        output[output_pos] = '\0';
+    }
+}
+
+static lily_state *new_collecting_state(void)
+{
+    lily_state *s = lily_new_state();
+
+    output_pos = 0;
+    output[0] = '\0';
+    lily_op_flush_func(s, collect_output);
+    return s;
+}
+
+static void expect_output(lily_state *s, const char *context,
+        const char *expect)
+{
+    lily_flush_output(s);
+
+    if (strcmp(output, expect) != 0)
+        fail("%s: Expected output '%s', but got '%s'.", context, expect,
+                output);
+
+    output_pos = 0;
+    output[0] = '\0';
+}
+
+/* This parses 'path' on a new state that caches it next to the file, and
+   checks what it printed. */
+static void run_cached(const char *context, const char *path,
+        const char *expect)
+{
+    lily_state *s = new_collecting_state();
+
+    lily_op_code_cache(s, "");
+
+    if (lily_parse_file(s, path) == 0)
+        fail("%s: Unexpected error.\n%s", context, lily_get_error(s));
+    else
+        expect_output(s, context, expect);
+
+    lily_free_state(s);
+}
+
+static void test_code_cache(void)
+{
+    char lib_path[512], main_path[512], cache_path[512];
+
+    test_path(lib_path, "cache_lib.lily");
+    test_path(main_path, "cache_main.lily");
+    test_path(cache_path, "cache_main.lilyc");
+    remove(cache_path);
+
+    write_file(lib_path,
+        "var scale = 3\n"
+        "define scaled(x: Integer): Integer { return x * scale }\n");
+    write_file(main_path,
+        "import cache_lib\n"
+        "print(cache_lib.scaled(2))\n");
+
+    run_cached("cache write", main_path, "6\n");
+
+    if (file_exists(cache_path) == 0) {
+        fail("cache write: No cache was written.");
+        return;
+    }
+
+    /* If the cache is used, the new text of the file isn't seen. */
+    rewrite_keeping_stamp(main_path,
+        "import cache_lib\n"
+        "print(cache_lib.scaled(5))\n");
+    run_cached("cache read", main_path, "6\n");
+
+    /* Changing an imported module makes the cache stale. */
+    write_file(lib_path,
+        "var scale = 10\n"
+        "define scaled(x: Integer): Integer { return x * scale }\n");
+    run_cached("cache invalidate", main_path, "50\n");
+    run_cached("cache rewrite", main_path, "50\n");
+}
+
+static void test_code_cache_class(void)
+{
+    char main_path[512], cache_path[512];
+
+    test_path(main_path, "cache_class.lily");
+    test_path(cache_path, "cache_class.lilyc");
+    remove(cache_path);
+
+    write_file(main_path,
+        "class Point(x: Integer) { var @x = x\n"
+        "    define twice: Integer { return @x * 2 } }\n"
+        "class Point3(x: Integer, z: Integer) < Point(x) { var @z = z }\n"
+        "enum Shape { Circle(Integer), Empty\n"
+        "    define size: Integer {\n"
+        "        match self: { case Circle(r): return r case Empty: return 0 }\n"
+        "    } }\n"
+        "scoped enum Color { Red, Blue }\n"
+        "class Box[A](v: A) { var @v = v }\n"
+        "print([Point3(4, 1).twice(), Circle(3).size(), Box(7).v])\n"
+        "print([Color.Red, Color.Blue])\n");
+
+    run_cached("cache class", main_path, "[8, 3, 7]\n[Color.Red, Color.Blue]\n");
+
+    if (file_exists(cache_path) == 0) {
+        fail("cache class: No cache was written.");
+        return;
+    }
+
+    /* Same size, so the cache doesn't see the change. */
+    rewrite_keeping_stamp(main_path,
+        "class Point(x: Integer) { var @x = x\n"
+        "    define twice: Integer { return @x * 3 } }\n"
+        "class Point3(x: Integer, z: Integer) < Point(x) { var @z = z }\n"
+        "enum Shape { Circle(Integer), Empty\n"
+        "    define size: Integer {\n"
+        "        match self: { case Circle(r): return r case Empty: return 0 }\n"
+        "    } }\n"
+        "scoped enum Color { Red, Blue }\n"
+        "class Box[A](v: A) { var @v = v }\n"
+        "print([Point3(4, 1).twice(), Circle(3).size(), Box(7).v])\n"
+        "print([Color.Red, Color.Blue])\n");
+
+    lily_state *s = new_collecting_state();
+
+    lily_op_code_cache(s, "");
+
+    if (lily_parse_file(s, main_path) == 0) {
+        fail("cache class read: Unexpected error.\n%s", lily_get_error(s));
+        lily_free_state(s);
+        return;
+    }
+
+    expect_output(s, "cache class read",
+            "[8, 3, 7]\n[Color.Red, Color.Blue]\n");
+
+    /* The classes are made again with their members, so later code can use
+       them like any others. */
+    expect_parse(s, "[cache class after]",
+        "var p = Point3(5, 2)\n"
+        "var b = Box(\"b\")\n"
+        "print([p.twice() + p.z, Circle(4).size()])\n"
+        "print($\"^(b.v)!\")\n"
+        "class Point4(x: Integer) < Point3(x, 0) {}\n"
+        "print(Point4(1).twice())\n"
+        "print(Color.Blue)\n");
+    expect_output(s, "[cache class after]", "[12, 4]\nb!\n2\nColor.Blue\n");
+    lily_free_state(s);
+}
+
+#ifdef LILY_API_TEST_CC
+/* This translates a module with -aot, and builds it into a library in the
+   test directory. Returns 1 on success, 0 on failure. */
+static int build_aot_module(void)
+{
+    char src_dir[512], src_path[512], c_path[512], lib_path[512],
+         command[2048];
+
+    /* The source is kept apart from the library, so that importing the module
+       can't find the source instead. */
+    test_path(src_dir, "aot_src");
+    mkdir(src_dir, 0755);
+    test_path(src_path, "aot_src/aot_numeric.lily");
+    test_path(c_path, "aot_numeric.c");
+    test_path(lib_path, "aot_numeric.so");
+
+    write_file(src_path,
+        "define _half(x: Integer): Integer { return x / 2 }\n"
+        "define fold_half(x: Integer): Integer {\n"
+        "    var total = 0\n"
+        "    for i in 0...x: {\n"
+        "        total += _half(i)\n"
+        "    }\n"
+        "    return total\n"
+        "}\n"
+        "define scale(a: Double, b: Double): Double { return a * b + 0.5 }\n"
+        "define is_big(x: Integer): Boolean { return x > 100 }\n");
+
+    lily_state *s = lily_new_state();
+    const char *text;
+
+    if (lily_aot_file(s, src_path, &text) == 0) {
+        fail("aot: Translation failed.\n%s", lily_get_error(s));
+        lily_free_state(s);
+        return 0;
+    }
+
+    write_file(c_path, text);
+    lily_free_state(s);
+
+    sprintf(command, "%s -shared -fPIC "
+#ifdef __APPLE__
+            "-undefined dynamic_lookup "
+#endif
+            "-I%s -o %s %s", LILY_API_TEST_CC, LILY_API_TEST_INCLUDE, lib_path,
+            c_path);
+
+    if (system(command) != 0) {
+        fail("aot: Compiling the translation failed.\n%s", command);
+        return 0;
+    }
+
+    return 1;
+}
+
+static void test_aot_import(void)
+{
+    char main_path[512];
+
+    if (build_aot_module() == 0)
+        return;
+
+    test_path(main_path, "aot_main.lily");
+    write_file(main_path,
+        "import aot_numeric\n"
+        "if aot_numeric.fold_half(10) != 25:\n"
+        "    raise ValueError(\"fold_half\")\n"
+        "if aot_numeric._half(9) != 4:\n"
+        "    raise ValueError(\"_half\")\n"
+        "if aot_numeric.scale(2.0, 3.0) != 6.5:\n"
+        "    raise ValueError(\"scale\")\n"
+        "if aot_numeric.is_big(5) || aot_numeric.is_big(500) == false:\n"
+        "    raise ValueError(\"is_big\")\n");
+
+    lily_state *s = lily_new_state();
+    if (lily_parse_file(s, main_path) == 0)
+        fail("aot: Importing the library failed.\n%s", lily_get_error(s));
+
+    lily_free_state(s);
+}
+
+static void test_code_cache_library(void)
+{
+    char main_path[512], cache_path[512];
+
+    if (build_aot_module() == 0)
+        return;
+
+    test_path(main_path, "cache_aot.lily");
+    test_path(cache_path, "cache_aot.lilyc");
+    remove(cache_path);
+
+    write_file(main_path,
+        "import aot_numeric\n"
+        "print(aot_numeric.fold_half(10))\n");
+
+    run_cached("cache library", main_path, "25\n");
+
+    if (file_exists(cache_path) == 0) {
+        fail("cache library: No cache was written.");
+        return;
+    }
+
+    rewrite_keeping_stamp(main_path,
+        "import aot_numeric\n"
+        "print(aot_numeric.fold_half(12))\n");
+    run_cached("cache library read", main_path, "25\n");
+}
+#endif
+
+/* Render functions append what they're given to the buffer in the data. The
+   second marks each piece, so that the output shows which one was used. */
+static void render_plain(const char *text, void *data)
+{
+    strcat((char *)data, text);
+}
+
+static void render_marked(const char *text, void *data)
+{
+    strcat((char *)data, "[");
+    strcat((char *)data, text);
+    strcat((char *)data, "]");
+}
+
+static void expect_rendered(const char *context, const char *buffer,
+        const char *expect)
+{
+    if (strcmp(buffer, expect) != 0)
+        fail("%s: Expected '%s', but rendered '%s'.", context, expect, buffer);
+}
+
+static void test_prepared_template(void)
+{
+    lily_state *s = lily_new_state();
+    char first[256] = "", second[256] = "";
+
+    lily_op_render_func(s, render_plain);
+    lily_op_data(s, first);
+
+    struct lily_function_val_ *f = lily_prepare_template(s, "[template]",
+        "<?lily var total = 1 + 2 ?>Hello"
+        "<?lily if total != 3: raise ValueError(\"total\") ?> world");
+
+    if (f == NULL) {
+        fail("template: Unexpected error.\n%s", lily_get_error(s));
+        lily_free_state(s);
+        return;
+    }
+
+    /* Preparing doesn't render anything. */
+    expect_rendered("template prepare", first, "");
+
+    if (lily_render_prepared(s, f) == 0)
+        fail("template render: Unexpected error.\n%s", lily_get_error(s));
+
+    /* Like other source strings, the text ends with a newline. */
+    expect_rendered("template render", first, "Hello world\n");
+
+    /* The render function and data are taken from the state each time. */
+    lily_op_render_func(s, render_marked);
+    lily_op_data(s, second);
+
+    if (lily_render_prepared(s, f) == 0)
+        fail("template render again: Unexpected error.\n%s",
+                lily_get_error(s));
+
+    expect_rendered("template render again", first, "Hello world\n");
+    expect_rendered("template render again", second, "[Hello][ world\n]");
+    lily_free_state(s);
+}
+
+static void test_prepared_template_error(void)
+{
+    lily_state *s = lily_new_state();
+    char buffer[256] = "";
+
+    lily_op_render_func(s, render_plain);
+    lily_op_data(s, buffer);
+
+    struct lily_function_val_ *f = lily_prepare_template(s, "[bad template]",
+        "Hello<?lily var total: Integer = \"3\" ?> world");
+
+    if (f != NULL)
+        fail("template error: A template that doesn't compile was prepared.");
+    else if (strstr(lily_get_error(s), "SyntaxError") == NULL)
+        fail("template error: Wrong error.\n%s", lily_get_error(s));
+
+    expect_rendered("template error", buffer, "");
+
+    /* The state can still prepare templates after the failure. */
+    f = lily_prepare_template(s, "[template]", "<?lily ?>Hello");
+
+    if (f == NULL)
+        fail("template after error: Unexpected error.\n%s",
+                lily_get_error(s));
+    else if (lily_render_prepared(s, f) == 0)
+        fail("template after error: Unexpected error.\n%s",
+                lily_get_error(s));
+
+    expect_rendered("template after error", buffer, "Hello\n");
+    lily_free_state(s);
+}
+
+/* Imports are searched for from the current directory, so tests of them start
+   by moving into the test directory. */
+static int enter_test_dir(const char *context)
+{
+    if (chdir(LILY_API_TEST_DIR) == 0)
+        return 1;
+
+    fail("%s: Cannot enter the test directory.", context);
+    return 0;
+}
+
+static void test_import_memo_reset(void)
+{
+    if (enter_test_dir("memo reset") == 0)
+        return;
+
+    lily_state *s = new_collecting_state();
+    int i;
+
+    write_file("memo_mod.lily", "var where = \"first\"\n");
+    lily_mark_state(s);
+
+    /* The module imported after the mark is freed by the reset. If the import
+       was still remembered, the next import would find the freed module
+       instead of loading the file again. */
+    for (i = 0;i < 3;i++) {
+        expect_parse(s, "[memo reset]",
+            "import memo_mod\n"
+            "print(memo_mod.where)\n");
+        expect_output(s, "[memo reset]", i == 0 ? "first\n" : "second\n");
+        lily_reset_state(s);
+        write_file("memo_mod.lily", "var where = \"second\"\n");
+    }
+
+    lily_free_state(s);
+}
+
+static void test_register_source(void)
+{
+    lily_state *s = new_collecting_state();
+    int i;
+
+    lily_register_source(s, "reg_before",
+        "print(\"before ran\")\n"
+        "var count = 0\n");
+    lily_register_source(s, "reg_after",
+        "import reg_before\n"
+        "print(\"after ran\")\n"
+        "reg_before.count += 1\n"
+        "define twice(x: Integer): Integer { return x * 2 }\n");
+
+    /* Registered sources run when they're first imported. */
+    expect_parse(s, "[register]", "import reg_before\n");
+    expect_output(s, "[register]", "before ran\n");
+    lily_mark_state(s);
+
+    /* A source first imported after the mark runs again after each reset. The
+       one imported before the mark doesn't, and gets its count back. */
+    for (i = 0;i < 3;i++) {
+        expect_parse(s, "[register after mark]",
+            "import reg_after\n"
+            "print(reg_after.twice(reg_before.count + 3))\n");
+        expect_output(s, "[register after mark]", "after ran\n8\n");
+        lily_reset_state(s);
+    }
+
+    expect_parse(s, "[register after reset]",
+        "print(reg_before.count)\n");
+    expect_output(s, "[register after reset]", "0\n");
+    lily_free_state(s);
+}
+
+static const char *lazy_source =
+    "print(\"lazy ran\")\n"
+    "var items = [1, 2]\n"
+    "define plain(x: Integer): Integer { return x + 1 }\n"
+    "define total: Integer { return items[0] + items[1] }\n";
+
+static lily_state *new_lazy_state(void)
+{
+    lily_state *s = new_collecting_state();
+
+    lily_op_lazy_imports(s, 1);
+    lily_register_source(s, "lazy_mod", lazy_source);
+    return s;
+}
+
+static void test_lazy_import(void)
+{
+    lily_state *s = new_lazy_state();
+    int i;
+
+    /* Functions that don't use the module's vars don't run it. The first one
+       that does runs the module before it continues. */
+    expect_parse(s, "[lazy call]",
+        "import lazy_mod\n"
+        "print(lazy_mod.plain(1))\n"
+        "print(lazy_mod.total())\n"
+        "print(lazy_mod.items[1])\n");
+    expect_output(s, "[lazy call]", "2\nlazy ran\n3\n2\n");
+    lily_free_state(s);
+
+    /* Reading a var of the module first runs it. */
+    s = new_lazy_state();
+    expect_parse(s, "[lazy get]",
+        "import lazy_mod\n"
+        "print(\"before\")\n"
+        "var v = lazy_mod.items\n"
+        "print(v[0])\n");
+    expect_output(s, "[lazy get]", "before\nlazy ran\n1\n");
+    lily_free_state(s);
+
+    /* So does assigning to one, and the assignment comes after the module's
+       own. */
+    s = new_lazy_state();
+    expect_parse(s, "[lazy set]",
+        "import lazy_mod\n"
+        "lazy_mod.items = [5, 6]\n"
+        "print(lazy_mod.total())\n");
+    expect_output(s, "[lazy set]", "lazy ran\n11\n");
+    lily_free_state(s);
+
+    /* A module imported before a mark that first runs after it has its vars
+       put back by a reset, so it runs again. */
+    s = new_lazy_state();
+    expect_parse(s, "[lazy mark]", "import lazy_mod\n");
+    lily_mark_state(s);
+
+    for (i = 0;i < 2;i++) {
+        expect_parse(s, "[lazy reset]", "print(lazy_mod.items[0])\n");
+        expect_output(s, "[lazy reset]", "lazy ran\n1\n");
+        lily_reset_state(s);
+    }
+
+    lily_free_state(s);
+}
+
+static void test_lazy_import_error(void)
+{
+    lily_state *s = new_collecting_state();
+
+    lily_op_lazy_imports(s, 1);
+    lily_register_source(s, "lazy_bad",
+        "var value = 1\n"
+        "raise ValueError(\"lazy failed\")\n");
+
+    /* The module never finished, so its vars might not have values. The
+       exception can't be caught by the code that wanted one of them. */
+    if (lily_parse_string(s, "[lazy error]",
+            "import lazy_bad\n"
+            "try: {\n"
+            "    print(lazy_bad.value)\n"
+            "except ValueError:\n"
+            "    print(\"caught\")\n"
+            "}\n"))
+        fail("[lazy error]: The exception was caught.");
+    else if (strstr(lily_get_error(s), "lazy failed") == NULL)
+        fail("[lazy error]: Wrong error.\n%s", lily_get_error(s));
+
+    expect_output(s, "[lazy error]", "");
+
+    /* Exceptions that don't leave a lazy import are still caught. */
+    expect_parse(s, "[after lazy error]",
+        "try: {\n"
+        "    raise ValueError(\"plain\")\n"
+        "except ValueError:\n"
+        "    print(\"caught\")\n"
+        "}\n");
+    expect_output(s, "[after lazy error]", "caught\n");
+    lily_free_state(s);
+}
+
+static const char *memo_pkg_table[] = {
+    "\0D"
+    ,"F\0where\0:String\0\000(\000String\000"
+    ,"Z"
+};
+
+static void memo_pkg_where(lily_state *s)
+{
+    lily_return_string(s, lily_new_string("package"));
+}
+
+static void *memo_pkg_loader(lily_state *s, int id)
+{
+    return id == 1 ? memo_pkg_where : NULL;
+}
+
+static void test_import_memo_register(void)
+{
+    if (enter_test_dir("memo register") == 0)
+        return;
+
+    lily_state *s = new_collecting_state();
+
+    write_file("memo_pkg.lily",
+        "define where: String { return \"file\" }\n");
+    write_file("memo_user.lily",
+        "import memo_pkg\n"
+        "define where: String { return memo_pkg.where() }\n");
+
+    /* This remembers that memo_pkg is the file. */
+    expect_parse(s, "[memo file]",
+        "import memo_pkg\n"
+        "print(memo_pkg.where())\n");
+    expect_output(s, "[memo file]", "file\n");
+
+    /* A package registered with the same name comes before files, so later
+       imports have to find it instead. */
+    lily_register_package(s, "memo_pkg", memo_pkg_table, memo_pkg_loader);
+    expect_parse(s, "[memo package]",
+        "import memo_user\n"
+        "print(memo_user.where())\n");
+    expect_output(s, "[memo package]", "package\n");
+
+    lily_free_state(s);
+}
+
+/* This parses 'path' with memo_pkg registered and a cache next to it. */
+static void run_cached_pkg(const char *context, const char *path,
+        const char *expect)
+{
+    lily_state *s = new_collecting_state();
+
+    lily_op_code_cache(s, "");
+    lily_register_package(s, "memo_pkg", memo_pkg_table, memo_pkg_loader);
+
+    if (lily_parse_file(s, path) == 0)
+        fail("%s: Unexpected error.\n%s", context, lily_get_error(s));
+    else
+        expect_output(s, context, expect);
+
+    lily_free_state(s);
+}
+
+static void test_code_cache_mismatch(void)
+{
+    char main_path[512], cache_path[512];
+
+    test_path(main_path, "cache_pkg.lily");
+    test_path(cache_path, "cache_pkg.lilyc");
+    remove(cache_path);
+
+    write_file(main_path,
+        "import memo_pkg\n"
+        "print(memo_pkg.where())\n");
+    run_cached_pkg("cache pkg write", main_path, "package\n");
+
+    /* Make the cache name a function that the package doesn't have. */
+    FILE *f = fopen(cache_path, "r+b");
+    char buffer[4096];
+    size_t size, i;
+
+    if (f == NULL) {
+        fail("cache pkg write: No cache was written.");
+        return;
+    }
+
+    size = fread(buffer, 1, sizeof(buffer), f);
+
+    for (i = 0;i + 6 <= size;i++) {
+        if (memcmp(buffer + i, "where", 6) == 0)
+            break;
+    }
+
+    if (i + 6 > size) {
+        fclose(f);
+        fail("cache pkg write: The cache doesn't name the function.");
+        return;
+    }
+
+    fseek(f, (long)i, SEEK_SET);
+    fwrite("wharf", 1, 5, f);
+    fclose(f);
+
+    /* The file is parsed instead, and the cache is written again. */
+    run_cached_pkg("cache pkg mismatch", main_path, "package\n");
+
+    rewrite_keeping_stamp(main_path,
+        "import memo_pkg\n"
+        "print(\"other programs\")\n");
+    run_cached_pkg("cache pkg reread", main_path, "package\n");
+}
+
+static int snapshot_setup(lily_state *s, void *data)
+{
+    return lily_parse_string(s, "[setup]",
+        "var names = [\"a\"]\n"
+        "define add(n: String): Integer {\n"
+        "    names.push(n)\n"
+        "    return names.size()\n"
+        "}\n");
+}
+
+/* Returns 1 if the clone's code ran, 0 otherwise. */
+static int run_clone(lily_state *s, const char *context, const char *source)
+{
+    if (lily_parse_string(s, context, source))
+        return 1;
+
+    fprintf(stderr, "%s: Unexpected error.\n%s\n", context, lily_get_error(s));
+    return 0;
+}
+
+static void test_snapshot_clone(void)
+{
+    lily_snapshot *snap = lily_new_snapshot(snapshot_setup, NULL);
+    lily_state *clones[3];
+    int i;
+
+    if (snap == NULL) {
+        fail("snapshot: Setup failed.");
+        return;
+    }
+
+    for (i = 0;i < 3;i++) {
+        clones[i] = lily_clone_state(snap);
+
+        if (run_clone(clones[i], "[clone]",
+                "if add(\"b\") != 2: raise ValueError(\"add\")\n") == 0)
+            fail_count++;
+    }
+
+    /* Clones share the snapshot's code, but outlive it. */
+    lily_free_snapshot(snap);
+
+    for (i = 0;i < 3;i++) {
+        if (run_clone(clones[i], "[after free]",
+                "if add(\"c\") != 3: raise ValueError(\"add\")\n"
+                "if names.join(\"\") != \"abc\": raise ValueError(\"names\")\n")
+                == 0)
+            fail_count++;
+
+        lily_free_state(clones[i]);
+    }
+}
+
+static void test_flush_held_strings(void)
+{
+    lily_state *s = new_collecting_state();
+
+    /* Strings this long are held by the sink instead of copied. A small flush
+       size makes the sink flush (and drop them) while the code runs. */
+    lily_op_flush_size(s, 128);
+    expect_parse(s, "[held]",
+        "var line = \"\"\n"
+        "for i in 0...99: {\n"
+        "    line = $\"^(line)-\"\n"
+        "}\n"
+        "for i in 0...2: {\n"
+        "    print($\"^(line)^(i)\")\n"
+        "}\n"
+        "line = \"\"\n");
+    expect_output(s, "[held]",
+        "----------------------------------------------------------------------"
+        "------------------------------0\n"
+        "----------------------------------------------------------------------"
+        "------------------------------1\n"
+        "----------------------------------------------------------------------"
+        "------------------------------2\n");
+    lily_free_state(s);
+}
+
+static void test_reset_globals(void)
+{
+    lily_state *s = new_collecting_state();
+    int i;
+
+    expect_parse(s, "[setup]",
+        "var counter = 1\n"
+        "var keep = Dynamic(0)\n");
+    lily_mark_state(s);
+
+    /* The globals from before the mark are given values of a class that the
+       reset destroys. They have to get their old values back. */
+    for (i = 0;i < 3;i++) {
+        expect_parse(s, "[after mark]",
+            "class Point(x: Integer) { var @x = x }\n"
+            "keep = Dynamic(Point(5))\n"
+            "counter += 10\n");
+        lily_reset_state(s);
+        expect_parse(s, "[after reset]",
+            "if counter != 1: raise ValueError(\"counter\")\n"
+            "if keep.@(Integer).unwrap() != 0: raise ValueError(\"keep\")\n"
+            "print(counter)\n");
+        expect_output(s, "[after reset]", "1\n");
+        lily_reset_state(s);
+    }
+
+    lily_free_state(s);
+}
+
+static void test_reset_containers(void)
+{
+    lily_state *s = new_collecting_state();
+    int i;
+
+    expect_parse(s, "[setup]",
+        "class Box { var @v = 0 }\n"
+        "var h: Hash[Integer, String] = []\n"
+        "var l: List[Integer] = []\n"
+        "var n = 0\n"
+        "var b = Box()\n"
+        "var same = l\n");
+    lily_mark_state(s);
+
+    /* Code after the mark changes what's inside of the globals. Each reset has
+       to leave them as they were at the mark, and still sharing. */
+    for (i = 0;i < 3;i++) {
+        expect_parse(s, "[after mark]",
+            "h[h.size()] = \"req\"\n"
+            "l.push(1)\n"
+            "n += 1\n"
+            "b.v += 1\n"
+            "print([h.size(), l.size(), n, b.v, same.size()])\n");
+        expect_output(s, "[after mark]", "[1, 1, 1, 1, 1]\n");
+        lily_reset_state(s);
+    }
+
+    lily_free_state(s);
+}
+
+#ifdef LILY_API_TEST_THREADS
+#define THREAD_COUNT 4
+#define THREAD_ROUNDS 25
+
+static lily_snapshot *shared_snap;
+
+/* Each thread makes a snapshot of its own (so an arena is active on it) while
+   the others clone the shared snapshot, run, and free their clones. */
+static void *snapshot_thread(void *data)
+{
+    lily_snapshot *own = lily_new_snapshot(snapshot_setup, NULL);
+    int *ok = data;
+    int i;
+
+    if (own == NULL) {
+        fprintf(stderr, "snapshot threads: Setup failed.\n");
+        return NULL;
+    }
+
+    for (i = 0;i < THREAD_ROUNDS;i++) {
+        lily_state *a = lily_clone_state(shared_snap);
+        lily_state *b = lily_clone_state(own);
+
+        if (run_clone(a, "[shared]",
+                "if add(\"b\") != 2: raise ValueError(\"add\")\n") == 0 ||
+            run_clone(b, "[own]",
+                "if add(\"b\") + add(\"c\") != 5: raise ValueError(\"add\")\n")
+                == 0) {
+            lily_free_state(a);
+            lily_free_state(b);
+            lily_free_snapshot(own);
+            return NULL;
+        }
+
+        lily_free_state(a);
+        lily_free_state(b);
+    }
+
+    lily_free_snapshot(own);
+    *ok = 1;
+    return NULL;
+}
+
+static void test_snapshot_threads(void)
+{
+    pthread_t threads[THREAD_COUNT];
+    int ok[THREAD_COUNT] = {0};
+    int i;
+
+    shared_snap = lily_new_snapshot(snapshot_setup, NULL);
+
+    if (shared_snap == NULL) {
+        fail("snapshot threads: Setup failed.");
+        return;
+    }
+
+    for (i = 0;i < THREAD_COUNT;i++)
+        pthread_create(&threads[i], NULL, snapshot_thread, &ok[i]);
+
+    for (i = 0;i < THREAD_COUNT;i++) {
+        pthread_join(threads[i], NULL);
+
+        if (ok[i] == 0)
+            fail("snapshot threads: Thread %d failed.", i);
+    }
+
+    lily_free_snapshot(shared_snap);
+}
+#endif
+
+typedef struct {
+    const char *name;
+    void (*func)(void);
+} api_test;
+
+static api_test tests[] = {
+    {"code_cache", test_code_cache},
+    {"code_cache_class", test_code_cache_class},
+    {"code_cache_mismatch", test_code_cache_mismatch},
+#ifdef LILY_API_TEST_CC
+    {"aot_import", test_aot_import},
+    {"code_cache_library", test_code_cache_library},
+#endif
+    {"import_memo_reset", test_import_memo_reset},
+    {"import_memo_register", test_import_memo_register},
+    {"lazy_import", test_lazy_import},
+    {"lazy_import_error", test_lazy_import_error},
+    {"prepared_template", test_prepared_template},
+    {"prepared_template_error", test_prepared_template_error},
+    {"flush_held_strings", test_flush_held_strings},
+    {"register_source", test_register_source},
+    {"reset_globals", test_reset_globals},
+    {"reset_containers", test_reset_containers},
+    {"snapshot_clone", test_snapshot_clone},
+#ifdef LILY_API_TEST_THREADS
+    {"snapshot_threads", test_snapshot_threads},
+#endif
+    {NULL, NULL}
+};
+
+/* With no arguments, every test is run. '-list' lists the tests by name, and
+   any other argument is the name of a test to run. */
+int main(int argc, char **argv)
+{
+    int i, found = 0;
+
+    for (i = 0;tests[i].name;i++) {
+        if (argc == 1)
+            tests[i].func();
+        else if (strcmp(argv[1], "-list") == 0)
+            printf("%s\n", tests[i].name);
+        else if (strcmp(argv[1], tests[i].name) == 0) {
+            tests[i].func();
+            found = 1;
+        }
+    }
+
+    if (argc > 1 && strcmp(argv[1], "-list") != 0 && found == 0) {
+        fprintf(stderr, "No test named '%s'.\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    return fail_count ? EXIT_FAILURE : EXIT_SUCCESS;
+}